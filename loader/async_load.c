@@ -0,0 +1,320 @@
+/* async_load.c -- IMG_Load decoding on a worker core
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Images whose path matches an async=<pattern> line of settings.txt are not
+ * decoded by IMG_Load_hook. The game right away gets an ABGR8888 surface of
+ * the size read from the PNG/JPEG header, filled by a worker thread pinned
+ * to the third core, and textures made from it are backed by a 1x1
+ * transparent texel until the decoded pixels are uploaded at the next frame
+ * boundary. The surface is referenced until then, so the game can free it.
+ * Only callers turning the surface into a texture should be allowed: any
+ * other use of its pixels sees them being written.
+ */
+
+#include <psp2/kernel/threadmgr.h>
+#include <vitaGL.h>
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "async_load.h"
+#include "gl_state.h"
+#include "image_cache.h"
+#include "settings.h"
+#include "tex_format.h"
+
+#define MAX_PATTERNS 16
+#define MAX_JOBS 64 // Power of two
+#define JOB_USERS_STEP 4
+
+enum {
+	JOB_FREE,
+	JOB_QUEUED,
+	JOB_DONE
+};
+
+typedef struct {
+	SDL_Texture *texture; // Either an SDL texture...
+	GLuint gl_texture; // ...or one of the game
+	GLint internalformat;
+	GLenum format;
+	GLenum type;
+} job_user;
+
+typedef struct {
+	volatile int state;
+	int failed;
+	char path[256];
+	char rel[128];
+	SDL_Surface *surface;
+	job_user *users;
+	int users_num;
+	int users_size;
+} load_job;
+
+static char patterns[MAX_PATTERNS][96];
+static int patterns_num = 0;
+static load_job jobs[MAX_JOBS];
+static uint32_t submit_idx = 0, worker_idx = 0, done_idx = 0;
+static SceUID sema = -1;
+static const uint32_t placeholder = 0x00000000;
+
+void async_load_add_pattern(const char *pattern) {
+	if (patterns_num == MAX_PATTERNS) {
+		printf("[AsyncLoad] Too many patterns, %s ignored\n", pattern);
+		return;
+	}
+	strncpy(patterns[patterns_num++], pattern, sizeof(patterns[0]) - 1);
+}
+
+static uint32_t be32(const uint8_t *p) {
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// Size from the PNG IHDR or the JPEG SOF marker, 0 for anything else
+static int image_size(const char *path, int *w, int *h) {
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return 0;
+	uint8_t b[24];
+	int res = 0;
+	if (fread(b, 1, sizeof(b), f) == sizeof(b)) {
+		if (!memcmp(b, "\x89PNG", 4) && !memcmp(&b[12], "IHDR", 4)) {
+			*w = be32(&b[16]);
+			*h = be32(&b[20]);
+			res = 1;
+		} else if (b[0] == 0xFF && b[1] == 0xD8) {
+			long pos = 2;
+			uint8_t m[9];
+			while (!fseek(f, pos, SEEK_SET) && fread(m, 1, sizeof(m), f) == sizeof(m) && m[0] == 0xFF) {
+				// SOF0-SOF15, minus DHT, JPG and DAC
+				if (m[1] >= 0xC0 && m[1] <= 0xCF && m[1] != 0xC4 && m[1] != 0xC8 && m[1] != 0xCC) {
+					*h = (m[5] << 8) | m[6];
+					*w = (m[7] << 8) | m[8];
+					res = 1;
+					break;
+				}
+				pos += 2 + ((m[2] << 8) | m[3]);
+			}
+		}
+	}
+	fclose(f);
+	return res && *w > 0 && *h > 0;
+}
+
+static int worker(SceSize args, void *argp) {
+	for (;;) {
+		sceKernelWaitSema(sema, 1, NULL);
+		load_job *j = &jobs[worker_idx++ & (MAX_JOBS - 1)];
+		SDL_Surface *s = image_cache_load(j->path);
+		SDL_Surface *conv = s ? SDL_ConvertSurfaceFormat(s, SDL_PIXELFORMAT_ABGR8888, 0) : NULL;
+		if (conv && conv->w == j->surface->w && conv->h == j->surface->h) {
+			for (int y = 0; y < conv->h; y++)
+				memcpy((uint8_t *)j->surface->pixels + y * j->surface->pitch, (uint8_t *)conv->pixels + y * conv->pitch, conv->w * 4);
+		} else {
+			j->failed = 1;
+		}
+		SDL_FreeSurface(conv);
+		SDL_FreeSurface(s);
+		__sync_synchronize();
+		j->state = JOB_DONE;
+	}
+	return 0;
+}
+
+static load_job *find_job(SDL_Surface *surface, const void *pixels) {
+	for (uint32_t i = done_idx; i != submit_idx; i++) {
+		load_job *j = &jobs[i & (MAX_JOBS - 1)];
+		// Once decoded the pixels are good to use as they are, even before being swapped in
+		if (j->state == JOB_QUEUED && (j->surface == surface || (pixels && j->surface->pixels == pixels)))
+			return j;
+	}
+	return NULL;
+}
+
+// Out of memory, the caller falls through to the pixels once they are complete
+static job_user *add_user(load_job *j) {
+	if (j->users_num == j->users_size) {
+		job_user *users = (job_user *)realloc(j->users, (j->users_size + JOB_USERS_STEP) * sizeof(job_user));
+		if (!users) {
+			while (j->state != JOB_DONE)
+				sceKernelDelayThread(1000);
+			return NULL;
+		}
+		j->users = users;
+		j->users_size += JOB_USERS_STEP;
+	}
+	job_user *u = &j->users[j->users_num++];
+	memset(u, 0, sizeof(job_user));
+	return u;
+}
+
+SDL_Surface *async_load(const char *rel, const char *path) {
+	while (rel[0] == '.' && rel[1] == '/')
+		rel += 2;
+	int i = 0;
+	while (i < patterns_num && !settings_match(patterns[i], rel))
+		i++;
+	if (i == patterns_num || submit_idx - done_idx == MAX_JOBS)
+		return NULL;
+
+	int w, h;
+	if (!image_size(path, &w, &h))
+		return NULL;
+	if (sema < 0) {
+		sema = sceKernelCreateSema("async_load", 0, 0, MAX_JOBS, NULL);
+		SceUID thid = sceKernelCreateThread("async_load", worker, 0x10000100, 0x10000, 0, SCE_KERNEL_CPU_MASK_USER_2, NULL);
+		if (sema < 0 || thid < 0 || sceKernelStartThread(thid, 0, NULL) < 0) {
+			printf("[AsyncLoad] Failed to start the worker, loading synchronously\n");
+			patterns_num = 0;
+			return NULL;
+		}
+	}
+
+	SDL_Surface *s = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ABGR8888);
+	if (!s)
+		return NULL;
+	s->refcount++; // Dropped once swapped in
+
+	load_job *j = &jobs[submit_idx & (MAX_JOBS - 1)];
+	memset(j, 0, sizeof(load_job));
+	strncpy(j->path, path, sizeof(j->path) - 1);
+	strncpy(j->rel, rel, sizeof(j->rel) - 1);
+	j->surface = s;
+	j->state = JOB_QUEUED;
+	submit_idx++;
+	sceKernelSignalSema(sema, 1);
+	return s;
+}
+
+SDL_Texture *async_load_create_texture(SDL_Renderer *renderer, SDL_Surface *surface) {
+	load_job *j = find_job(surface, NULL);
+	if (!j)
+		return NULL;
+
+	SDL_Texture *t = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STATIC, surface->w, surface->h);
+	if (!t)
+		return NULL;
+	// Same defaults SDL_CreateTextureFromSurface would have picked
+	Uint8 r, g, b, a;
+	SDL_BlendMode blend;
+	SDL_GetSurfaceColorMod(surface, &r, &g, &b);
+	SDL_GetSurfaceAlphaMod(surface, &a);
+	SDL_GetSurfaceBlendMode(surface, &blend);
+	SDL_SetTextureColorMod(t, r, g, b);
+	SDL_SetTextureAlphaMod(t, a);
+	SDL_SetTextureBlendMode(t, blend);
+
+	if (!SDL_GL_BindTexture(t, NULL, NULL)) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &placeholder);
+		SDL_GL_UnbindTexture(t);
+	}
+	job_user *u = add_user(j);
+	if (!u) {
+		SDL_DestroyTexture(t);
+		return NULL;
+	}
+	u->texture = t;
+	return t;
+}
+
+int async_load_tex_image(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels) {
+	if (!pixels || target != GL_TEXTURE_2D || level != 0)
+		return 0;
+	load_job *j = find_job(NULL, pixels);
+	if (!j || j->surface->w != width || j->surface->h != height)
+		return 0;
+
+	GLuint bound = gl_state_get_texture(GL_TEXTURE_2D);
+	if (bound == GL_STATE_UNKNOWN)
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, (GLint *)&bound);
+	if (!bound)
+		return 0;
+
+	job_user *u = add_user(j);
+	if (!u)
+		return 0;
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &placeholder);
+	u->gl_texture = bound;
+	u->internalformat = internalformat;
+	u->format = format;
+	u->type = type;
+	return 1;
+}
+
+void async_load_forget_texture(SDL_Texture *texture) {
+	for (uint32_t i = done_idx; i != submit_idx; i++) {
+		load_job *j = &jobs[i & (MAX_JOBS - 1)];
+		for (int k = 0; k < j->users_num; k++) {
+			if (j->users[k].texture == texture)
+				j->users[k].texture = NULL;
+		}
+	}
+}
+
+void async_load_forget_gl_texture(GLuint texture) {
+	for (uint32_t i = done_idx; i != submit_idx; i++) {
+		load_job *j = &jobs[i & (MAX_JOBS - 1)];
+		for (int k = 0; k < j->users_num; k++) {
+			if (j->users[k].gl_texture == texture)
+				j->users[k].gl_texture = 0;
+		}
+	}
+}
+
+static void swap_in(load_job *j) {
+	SDL_Surface *s = j->surface;
+	if (j->failed) {
+		printf("[AsyncLoad] Failed to decode %s, its textures keep the placeholder\n", j->rel);
+		return;
+	}
+
+	tex_format_tag(s, j->rel);
+	for (int k = 0; k < j->users_num; k++) {
+		job_user *u = &j->users[k];
+		if (u->texture) {
+			if (!tex_format_sdl_texture(u->texture, s) && !SDL_GL_BindTexture(u->texture, NULL, NULL)) {
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, s->w, s->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, s->pixels);
+				SDL_GL_UnbindTexture(u->texture);
+			}
+		} else if (u->gl_texture) {
+			glBindTexture(GL_TEXTURE_2D, u->gl_texture);
+			if (!tex_format_tex_image(GL_TEXTURE_2D, 0, s->w, s->h, u->format, u->type, s->pixels))
+				glTexImage2D(GL_TEXTURE_2D, 0, u->internalformat, s->w, s->h, 0, u->format, u->type, s->pixels);
+			// Mipmaps generated from the placeholder are gone with it
+			GLint min_filter;
+			glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &min_filter);
+			if (min_filter != GL_NEAREST && min_filter != GL_LINEAR)
+				glGenerateMipmap(GL_TEXTURE_2D);
+		}
+	}
+	tex_format_untag(s);
+}
+
+void async_load_frame(void) {
+	int swapped = 0;
+	while (done_idx != submit_idx) {
+		load_job *j = &jobs[done_idx & (MAX_JOBS - 1)];
+		if (j->state != JOB_DONE)
+			break;
+		__sync_synchronize();
+		if (!swapped)
+			gl_state_push();
+		swap_in(j);
+		SDL_FreeSurface(j->surface);
+		free(j->users);
+		j->state = JOB_FREE;
+		done_idx++;
+		swapped++;
+	}
+	if (swapped) {
+		gl_state_pop();
+		printf("[AsyncLoad] %d images swapped in\n", swapped);
+	}
+}
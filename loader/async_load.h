@@ -0,0 +1,20 @@
+#ifndef __ASYNC_LOAD_H__
+#define __ASYNC_LOAD_H__
+
+#include <vitaGL.h>
+
+// Also included by gl_state.c, which is built without SDL for tools/gl_replay
+typedef struct SDL_Surface SDL_Surface;
+typedef struct SDL_Renderer SDL_Renderer;
+typedef struct SDL_Texture SDL_Texture;
+
+void async_load_add_pattern(const char *pattern);
+SDL_Surface *async_load(const char *rel, const char *path); // NULL if rel has to be loaded right away
+SDL_Texture *async_load_create_texture(SDL_Renderer *renderer, SDL_Surface *surface); // NULL if surface isn't being decoded
+// 1 if pixels are being decoded and a placeholder was uploaded instead, texture must be bound
+int async_load_tex_image(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels);
+void async_load_forget_texture(SDL_Texture *texture);
+void async_load_forget_gl_texture(GLuint texture);
+void async_load_frame(void);
+
+#endif
@@ -0,0 +1,476 @@
+/* atlas.c -- runtime texture atlas for small UI surfaces
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Surfaces up to ATLAS_MAX_SPRITE_SIZE turned into textures through
+ * SDL_CreateTextureFromSurface are packed (skyline, bottom-left) into shared
+ * ATLAS_PAGE_SIZE pages with a 1px extruded border. The game gets back a
+ * sprite handle in place of the SDL_Texture: SDL_RenderCopy gets its source
+ * rect offset into the page, while SDL_GL_BindTexture binds the page and
+ * has batch2d.c remap the texture coordinates of the following draws. The
+ * first draw batch2d.c can't remap copies the sprite out of its page into a
+ * texture of its own, which SDL_GL_BindTexture binds from then on.
+ */
+
+#include <vitaGL.h>
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atlas.h"
+#include "batch2d.h"
+#include "config.h"
+#include "gl_state.h"
+#include "glyph_atlas.h"
+#include "render_batch.h"
+#include "stats.h"
+
+#define MAX_SKYLINE_NODES 512
+#define MAX_SPRITES 4096
+#define SPRITE_PADDING 1
+
+typedef struct {
+	int x, y, w;
+} skyline_node;
+
+typedef struct {
+	SDL_Texture *tex;
+	GLuint gl_tex;
+	skyline_node nodes[MAX_SKYLINE_NODES];
+	int num_nodes;
+	uint32_t used_px;
+	int sprites;
+} atlas_page;
+
+typedef struct {
+	uint8_t in_use;
+	uint8_t page;
+	uint8_t color_mod[3];
+	uint8_t alpha_mod;
+	SDL_BlendMode blend_mode;
+	int x, y, w, h; // Inner rect, padding excluded
+	GLuint gl_tex; // Copy of the sprite for draws which can't be remapped (0 = none)
+} atlas_sprite;
+
+static atlas_page pages[ATLAS_MAX_PAGES];
+static int pages_num = 0;
+static atlas_sprite sprites[MAX_SPRITES];
+
+static SDL_Texture *last_copy_tex = NULL;
+static SDL_Texture *last_copy_page = NULL;
+
+static atlas_sprite *bound_sprite = NULL;
+static GLuint copy_fb = 0;
+
+static atlas_sprite *get_sprite(SDL_Texture *texture) {
+	atlas_sprite *s = (atlas_sprite *)texture;
+	if (s < sprites || s >= sprites + MAX_SPRITES)
+		return NULL;
+	return s;
+}
+
+static void reset_page(atlas_page *p) {
+	p->nodes[0].x = 0;
+	p->nodes[0].y = 0;
+	p->nodes[0].w = ATLAS_PAGE_SIZE;
+	p->num_nodes = 1;
+	p->used_px = 0;
+	p->sprites = 0;
+}
+
+// Lowest y a w*h rect can sit at when its left edge is aligned with node i
+static int skyline_fit(atlas_page *p, int i, int w, int h) {
+	int x = p->nodes[i].x;
+	if (x + w > ATLAS_PAGE_SIZE)
+		return -1;
+	int y = 0, left = w;
+	while (left > 0) {
+		if (p->nodes[i].y > y)
+			y = p->nodes[i].y;
+		if (y + h > ATLAS_PAGE_SIZE)
+			return -1;
+		left -= p->nodes[i].w;
+		i++;
+	}
+	return y;
+}
+
+static int skyline_insert(atlas_page *p, int w, int h, int *out_x, int *out_y) {
+	int best = -1, best_y = ATLAS_PAGE_SIZE + 1, best_w = ATLAS_PAGE_SIZE;
+	for (int i = 0; i < p->num_nodes; i++) {
+		int y = skyline_fit(p, i, w, h);
+		if (y >= 0 && (y + h < best_y || (y + h == best_y && p->nodes[i].w < best_w))) {
+			best = i;
+			best_y = y + h;
+			best_w = p->nodes[i].w;
+		}
+	}
+	if (best < 0 || p->num_nodes == MAX_SKYLINE_NODES)
+		return -1;
+
+	*out_x = p->nodes[best].x;
+	*out_y = best_y - h;
+
+	// New segment on top of the placed rect, then shrink/drop the ones it now covers
+	memmove(&p->nodes[best + 1], &p->nodes[best], (p->num_nodes - best) * sizeof(skyline_node));
+	p->nodes[best].x = *out_x;
+	p->nodes[best].y = best_y;
+	p->nodes[best].w = w;
+	p->num_nodes++;
+	for (int i = best + 1; i < p->num_nodes; i++) {
+		skyline_node *prev = &p->nodes[i - 1];
+		skyline_node *n = &p->nodes[i];
+		if (n->x >= prev->x + prev->w)
+			break;
+		int shrink = prev->x + prev->w - n->x;
+		n->x += shrink;
+		n->w -= shrink;
+		if (n->w > 0)
+			break;
+		memmove(n, n + 1, (p->num_nodes - i - 1) * sizeof(skyline_node));
+		p->num_nodes--;
+		i--;
+	}
+	for (int i = 0; i < p->num_nodes - 1; i++) {
+		if (p->nodes[i].y == p->nodes[i + 1].y) {
+			p->nodes[i].w += p->nodes[i + 1].w;
+			memmove(&p->nodes[i + 1], &p->nodes[i + 2], (p->num_nodes - i - 2) * sizeof(skyline_node));
+			p->num_nodes--;
+			i--;
+		}
+	}
+	return 0;
+}
+
+static int new_page(SDL_Renderer *renderer) {
+	atlas_page *p = &pages[pages_num];
+	p->tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STATIC, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+	if (!p->tex)
+		return -1;
+
+	// Pages are bound through gl_state when used by the game's own shaders
+	GLint id = 0;
+	SDL_GL_BindTexture(p->tex, NULL, NULL);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &id);
+	SDL_GL_UnbindTexture(p->tex);
+	p->gl_tex = id;
+
+	reset_page(p);
+	printf("[Atlas] Allocated page %d (%dx%d)\n", pages_num, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+	return pages_num++;
+}
+
+static void upload_sprite(atlas_sprite *s, const uint8_t *pixels, int pitch) {
+	int pw = s->w + SPRITE_PADDING * 2, ph = s->h + SPRITE_PADDING * 2;
+	uint32_t *buf = (uint32_t *)malloc(pw * ph * 4);
+
+	// Replicate edge texels into the padding so bilinear filtering never picks a neighbour
+	for (int y = 0; y < ph; y++) {
+		int sy = y - SPRITE_PADDING;
+		sy = sy < 0 ? 0 : (sy >= s->h ? s->h - 1 : sy);
+		const uint32_t *src = (const uint32_t *)(pixels + sy * pitch);
+		uint32_t *dst = buf + y * pw;
+		for (int x = 0; x < pw; x++) {
+			int sx = x - SPRITE_PADDING;
+			sx = sx < 0 ? 0 : (sx >= s->w ? s->w - 1 : sx);
+			dst[x] = src[sx];
+		}
+	}
+
+	SDL_Rect r = {s->x - SPRITE_PADDING, s->y - SPRITE_PADDING, pw, ph};
+	SDL_UpdateTexture(pages[s->page].tex, &r, buf, pw * 4);
+	free(buf);
+}
+
+// Copies the sprite's rect of its page into its own texture, leaves that texture bound
+static void copy_sprite(atlas_sprite *s) {
+	GLint prev_fb = 0, min_filter = GL_LINEAR, mag_filter = GL_LINEAR;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fb);
+	if (!copy_fb)
+		glGenFramebuffers(1, &copy_fb);
+	gl_state_bind_framebuffer(GL_FRAMEBUFFER, copy_fb);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pages[s->page].gl_tex, 0);
+
+	if (!s->gl_tex) {
+		// Same filtering SDL picked for the page
+		gl_state_bind_texture(GL_TEXTURE_2D, pages[s->page].gl_tex);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &min_filter);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &mag_filter);
+		glGenTextures(1, &s->gl_tex);
+		gl_state_bind_texture(GL_TEXTURE_2D, s->gl_tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		printf("[Atlas] Sprite %dx%d drawn without remapping, moved to its own texture\n", s->w, s->h);
+	} else {
+		gl_state_bind_texture(GL_TEXTURE_2D, s->gl_tex);
+	}
+	glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, s->x, s->y, s->w, s->h, 0);
+	gl_state_bind_framebuffer(GL_FRAMEBUFFER, prev_fb);
+}
+
+// Called by batch2d.c before a draw sampling the bound sprite it can't remap
+static void bind_unmapped(void) {
+	if (!bound_sprite)
+		return;
+	copy_sprite(bound_sprite);
+	stats_cur.tex_binds++;
+}
+
+SDL_Texture *atlas_create_texture(SDL_Renderer *renderer, SDL_Surface *surface) {
+	if (!surface || surface->w > ATLAS_MAX_SPRITE_SIZE || surface->h > ATLAS_MAX_SPRITE_SIZE)
+		return NULL;
+
+	atlas_sprite *s = NULL;
+	for (int i = 0; i < MAX_SPRITES; i++) {
+		if (!sprites[i].in_use) {
+			s = &sprites[i];
+			break;
+		}
+	}
+	if (!s)
+		return NULL;
+
+	int pw = surface->w + SPRITE_PADDING * 2, ph = surface->h + SPRITE_PADDING * 2;
+	int page = -1, x, y;
+	for (int i = 0; i < pages_num; i++) {
+		if (skyline_insert(&pages[i], pw, ph, &x, &y) == 0) {
+			page = i;
+			break;
+		}
+	}
+
+	batch2d_flush();
+	if (page < 0 && pages_num < ATLAS_MAX_PAGES) {
+		page = new_page(renderer);
+		if (page >= 0 && skyline_insert(&pages[page], pw, ph, &x, &y) < 0)
+			page = -1;
+	}
+	if (page < 0) {
+		gl_state_invalidate();
+		return NULL;
+	}
+
+	SDL_Surface *conv = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ABGR8888, 0);
+	if (!conv) {
+		gl_state_invalidate();
+		return NULL;
+	}
+
+	memset(s, 0, sizeof(atlas_sprite));
+	s->in_use = 1;
+	s->page = page;
+	s->x = x + SPRITE_PADDING;
+	s->y = y + SPRITE_PADDING;
+	s->w = surface->w;
+	s->h = surface->h;
+
+	// Same defaults SDL_CreateTextureFromSurface would have picked
+	SDL_GetSurfaceColorMod(surface, &s->color_mod[0], &s->color_mod[1], &s->color_mod[2]);
+	SDL_GetSurfaceAlphaMod(surface, &s->alpha_mod);
+	if (SDL_HasColorKey(surface))
+		s->blend_mode = SDL_BLENDMODE_BLEND;
+	else
+		SDL_GetSurfaceBlendMode(surface, &s->blend_mode);
+
+	SDL_LockSurface(conv);
+	upload_sprite(s, (const uint8_t *)conv->pixels, conv->pitch);
+	SDL_UnlockSurface(conv);
+	SDL_FreeSurface(conv);
+	gl_state_invalidate();
+
+	pages[page].used_px += pw * ph;
+	pages[page].sprites++;
+	return (SDL_Texture *)s;
+}
+
+int atlas_is_sprite(SDL_Texture *texture) {
+	return get_sprite(texture) != NULL;
+}
+
+int atlas_update_texture(SDL_Texture *texture, const SDL_Rect *rect, const void *pixels, int pitch) {
+	atlas_sprite *s = get_sprite(texture);
+	SDL_Rect r = {s->x, s->y, s->w, s->h};
+	if (rect) {
+		r.x += rect->x;
+		r.y += rect->y;
+		r.w = rect->w;
+		r.h = rect->h;
+	}
+	batch2d_flush();
+	int res = SDL_UpdateTexture(pages[s->page].tex, &r, pixels, pitch);
+	gl_state_invalidate();
+	if (s->gl_tex && !res)
+		copy_sprite(s);
+	return res;
+}
+
+void atlas_destroy_texture(SDL_Texture *texture) {
+	atlas_sprite *s = get_sprite(texture);
+	atlas_page *p = &pages[s->page];
+	p->used_px -= (s->w + SPRITE_PADDING * 2) * (s->h + SPRITE_PADDING * 2);
+	s->in_use = 0;
+	if (last_copy_tex == texture)
+		last_copy_tex = NULL;
+	if (bound_sprite == s)
+		bound_sprite = NULL;
+	if (s->gl_tex) {
+		glDeleteTextures_hook(1, &s->gl_tex);
+		s->gl_tex = 0;
+	}
+
+	// Freed rects aren't reclaimed one by one, the skyline restarts once the page is empty
+	if (--p->sprites == 0)
+		reset_page(p);
+}
+
+int atlas_bind_texture(SDL_Texture *texture, float *texw, float *texh) {
+	atlas_sprite *s = get_sprite(texture);
+	bound_sprite = s;
+	stats_cur.tex_binds++;
+	if (s->gl_tex) {
+		batch2d_clear_uv_remap();
+		if (!gl_state_bind_texture(GL_TEXTURE_2D, s->gl_tex))
+			stats_cur.tex_binds_saved++;
+	} else {
+		if (!gl_state_bind_texture(GL_TEXTURE_2D, pages[s->page].gl_tex))
+			stats_cur.tex_binds_saved++;
+		batch2d_set_uv_remap((float)s->x / ATLAS_PAGE_SIZE, (float)s->y / ATLAS_PAGE_SIZE,
+			(float)s->w / ATLAS_PAGE_SIZE, (float)s->h / ATLAS_PAGE_SIZE, bind_unmapped);
+	}
+	if (texw)
+		*texw = 1.0f;
+	if (texh)
+		*texh = 1.0f;
+	return 0;
+}
+
+int atlas_render_copy(SDL_Renderer *renderer, SDL_Texture *texture, const SDL_Rect *srcrect, const SDL_Rect *dstrect) {
+	atlas_sprite *s = get_sprite(texture);
+	SDL_Texture *page = texture;
+	SDL_Rect r;
+
+	if (s) {
+		page = pages[s->page].tex;
+		r.x = s->x;
+		r.y = s->y;
+		r.w = s->w;
+		r.h = s->h;
+		if (srcrect) {
+			r.x += srcrect->x;
+			r.y += srcrect->y;
+			r.w = srcrect->w;
+			r.h = srcrect->h;
+		}
+		srcrect = &r;
+		SDL_SetTextureColorMod(page, s->color_mod[0], s->color_mod[1], s->color_mod[2]);
+		SDL_SetTextureAlphaMod(page, s->alpha_mod);
+		SDL_SetTextureBlendMode(page, s->blend_mode);
+	}
+
+	// SDL only has to switch texture between copies if the page changes
+	if (texture != last_copy_tex) {
+		stats_cur.tex_binds++;
+		if (page == last_copy_page)
+			stats_cur.tex_binds_saved++;
+		last_copy_tex = texture;
+		last_copy_page = page;
+	}
+
+	return render_batch_copy(renderer, page, srcrect, dstrect);
+}
+
+void atlas_frame(void) {
+	uint32_t used = 0;
+	for (int i = 0; i < pages_num; i++)
+		used += pages[i].used_px;
+	stats_cur.atlas_pages = pages_num;
+	stats_cur.atlas_occupancy = pages_num ? (uint64_t)used * 100 / ((uint64_t)pages_num * ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE) : 0;
+}
+
+int SDL_QueryTexture_hook(SDL_Texture *texture, Uint32 *format, int *access, int *w, int *h) {
+	if (glyph_atlas_is_run(texture))
+		return glyph_atlas_query_texture(texture, format, access, w, h);
+	atlas_sprite *s = get_sprite(texture);
+	if (!s)
+		return SDL_QueryTexture(texture, format, access, w, h);
+	if (format)
+		*format = SDL_PIXELFORMAT_ABGR8888;
+	if (access)
+		*access = SDL_TEXTUREACCESS_STATIC;
+	if (w)
+		*w = s->w;
+	if (h)
+		*h = s->h;
+	return 0;
+}
+
+int SDL_SetTextureColorMod_hook(SDL_Texture *texture, Uint8 r, Uint8 g, Uint8 b) {
+	if (glyph_atlas_is_run(texture)) {
+		Uint8 rgb[3] = {r, g, b};
+		return glyph_atlas_color_mod(texture, 1, rgb);
+	}
+	atlas_sprite *s = get_sprite(texture);
+	if (!s)
+		return SDL_SetTextureColorMod(texture, r, g, b);
+	s->color_mod[0] = r;
+	s->color_mod[1] = g;
+	s->color_mod[2] = b;
+	return 0;
+}
+
+int SDL_GetTextureColorMod_hook(SDL_Texture *texture, Uint8 *r, Uint8 *g, Uint8 *b) {
+	if (glyph_atlas_is_run(texture)) {
+		Uint8 rgb[3];
+		glyph_atlas_color_mod(texture, 0, rgb);
+		if (r)
+			*r = rgb[0];
+		if (g)
+			*g = rgb[1];
+		if (b)
+			*b = rgb[2];
+		return 0;
+	}
+	atlas_sprite *s = get_sprite(texture);
+	if (!s)
+		return SDL_GetTextureColorMod(texture, r, g, b);
+	if (r)
+		*r = s->color_mod[0];
+	if (g)
+		*g = s->color_mod[1];
+	if (b)
+		*b = s->color_mod[2];
+	return 0;
+}
+
+int SDL_SetTextureBlendMode_hook(SDL_Texture *texture, SDL_BlendMode blendMode) {
+	if (glyph_atlas_is_run(texture))
+		return glyph_atlas_blend_mode(texture, 1, &blendMode);
+	atlas_sprite *s = get_sprite(texture);
+	if (!s)
+		return SDL_SetTextureBlendMode(texture, blendMode);
+	s->blend_mode = blendMode;
+	return 0;
+}
+
+int SDL_GetTextureBlendMode_hook(SDL_Texture *texture, SDL_BlendMode *blendMode) {
+	if (glyph_atlas_is_run(texture)) {
+		SDL_BlendMode mode;
+		glyph_atlas_blend_mode(texture, 0, &mode);
+		if (blendMode)
+			*blendMode = mode;
+		return 0;
+	}
+	atlas_sprite *s = get_sprite(texture);
+	if (!s)
+		return SDL_GetTextureBlendMode(texture, blendMode);
+	if (blendMode)
+		*blendMode = s->blend_mode;
+	return 0;
+}
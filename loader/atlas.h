@@ -0,0 +1,20 @@
+#ifndef __ATLAS_H__
+#define __ATLAS_H__
+
+#include <SDL2/SDL.h>
+
+SDL_Texture *atlas_create_texture(SDL_Renderer *renderer, SDL_Surface *surface); // NULL if the surface isn't atlased
+int atlas_is_sprite(SDL_Texture *texture);
+int atlas_update_texture(SDL_Texture *texture, const SDL_Rect *rect, const void *pixels, int pitch);
+void atlas_destroy_texture(SDL_Texture *texture);
+int atlas_bind_texture(SDL_Texture *texture, float *texw, float *texh);
+int atlas_render_copy(SDL_Renderer *renderer, SDL_Texture *texture, const SDL_Rect *srcrect, const SDL_Rect *dstrect);
+void atlas_frame(void);
+
+int SDL_QueryTexture_hook(SDL_Texture *texture, Uint32 *format, int *access, int *w, int *h);
+int SDL_SetTextureColorMod_hook(SDL_Texture *texture, Uint8 r, Uint8 g, Uint8 b);
+int SDL_GetTextureColorMod_hook(SDL_Texture *texture, Uint8 *r, Uint8 *g, Uint8 *b);
+int SDL_SetTextureBlendMode_hook(SDL_Texture *texture, SDL_BlendMode blendMode);
+int SDL_GetTextureBlendMode_hook(SDL_Texture *texture, SDL_BlendMode *blendMode);
+
+#endif
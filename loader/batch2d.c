@@ -0,0 +1,642 @@
+/* batch2d.c -- draw call batching for the 2D UI program (vp_2d/fp_2d)
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Draws issued with the 2D program are not submitted right away: their
+ * vertices are expanded to a triangle list and appended to a client side
+ * stream, which is drawn once any call able to change the result reaches
+ * vitaGL (state changes surviving gl_state.c, uniform updates with a new
+ * value, texture uploads, clears, SDL renderer calls, swaps...), the
+ * batched SDL_Renderer quads of render_batch.c included.
+ * Vertex data is read either from client memory or from CPU copies of
+ * small GL_ARRAY_BUFFER/GL_ELEMENT_ARRAY_BUFFER uploads. Draws which can't
+ * be batched read streamed buffers (see stream_ring.c) from the ring.
+ * While an atlased texture is bound (see atlas.c), a_TexCoords is remapped
+ * to the sprite's rect in its atlas page while being copied. Draws which
+ * can't be batched have the sprite bound on its own instead.
+ */
+
+#include <vitaGL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch2d.h"
+#include "buffer_table.h"
+#include "index_reorder.h"
+#include "render_batch.h"
+#include "render_target.h"
+#include "stats.h"
+#include "stream_ring.h"
+#include "uniform_cache.h"
+#include "vertex_compress.h"
+
+#define MAX_ATTRIBS 16
+#define MAX_PROGRAMS 64
+#define MAX_SHADOW_BUFFERS 512 // Power of two
+#define MAX_SHADOW_BUFFER_SIZE (64 * 1024)
+#define BATCH_MAX_VERTS 6144
+#define BATCH_MAX_ELEM_SIZE 16 // vec4 of floats
+
+typedef struct {
+	GLuint prog;
+	uint8_t is_2d;
+	GLint uv_attrib;
+} program_info;
+
+typedef struct {
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLsizei stride;
+	const void *ptr;
+	GLuint buffer;
+} attrib_ptr;
+
+typedef struct {
+	GLuint id;
+	uint8_t *data;
+	GLsizeiptr size;
+} shadow_buffer;
+
+typedef struct {
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	int elem_size;
+} attrib_fmt;
+
+static program_info programs[MAX_PROGRAMS];
+static int programs_num = 0;
+static program_info *cur = NULL;
+
+static attrib_ptr attribs[MAX_ATTRIBS];
+static uint32_t enabled_mask = 0;
+static GLuint array_buffer = 0, element_buffer = 0;
+static uint32_t ring_mask = 0; // Attributes currently pointed at the ring
+static uintptr_t ring_offs[MAX_ATTRIBS];
+
+static shadow_buffer shadows[MAX_SHADOW_BUFFERS];
+
+static struct {
+	uint8_t active;
+	float offs[2];
+	float scale[2];
+	void (*unmapped)(void);
+} uv_remap;
+
+static struct {
+	int draws;
+	int num_verts;
+	uint32_t mask;
+	attrib_fmt fmt[MAX_ATTRIBS];
+	uint8_t *stream[MAX_ATTRIBS];
+} batch;
+
+static int type_size(GLenum type) {
+	switch (type) {
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+		return 2;
+	case GL_FLOAT:
+	case GL_FIXED:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static shadow_buffer *find_shadow(GLuint id, int create) {
+	return (shadow_buffer *)buffer_table_find(shadows, MAX_SHADOW_BUFFERS, sizeof(shadow_buffer), id, create);
+}
+
+static program_info *get_program_info(GLuint prog) {
+	for (int i = 0; i < programs_num; i++) {
+		if (programs[i].prog == prog)
+			return &programs[i];
+	}
+	if (!prog || programs_num == MAX_PROGRAMS)
+		return NULL;
+
+	// Other programs are kept too, so that switching to them doesn't query vitaGL again
+	program_info *p = &programs[programs_num++];
+	memset(p, 0, sizeof(program_info));
+	p->prog = prog;
+	GLint wh = glGetUniformLocation(prog, "u_WH");
+	GLint cam = glGetUniformLocation(prog, "u_CamPos");
+	if (wh != -1 && cam != -1) {
+		p->is_2d = 1;
+		p->uv_attrib = glGetAttribLocation(prog, "a_TexCoords");
+	}
+	return p;
+}
+
+static void set_pointer(int i) {
+	attrib_ptr *a = &attribs[i];
+	GLint size = a->size;
+	GLenum type = a->type;
+	GLboolean normalized = a->normalized;
+	GLsizei stride = a->stride;
+	const void *ptr = a->ptr;
+	vertex_compress_pointer(i, a->buffer, &size, &type, &normalized, &stride, &ptr);
+	glVertexAttribPointer(i, size, type, normalized, stride, ptr);
+	ring_mask &= ~(1 << i);
+}
+
+void batch2d_flush(void) {
+	render_batch_flush();
+	if (!batch.draws)
+		return;
+
+	int num_verts = batch.num_verts;
+	batch.draws = 0;
+	batch.num_verts = 0;
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	for (int i = 0; i < MAX_ATTRIBS; i++) {
+		if (batch.mask & (1 << i))
+			glVertexAttribPointer(i, batch.fmt[i].size, batch.fmt[i].type, batch.fmt[i].normalized, 0, batch.stream[i]);
+	}
+	glDrawArrays(GL_TRIANGLES, 0, num_verts);
+	stats_cur.draws_issued++;
+
+	batch2d_restore_attribs(batch.mask);
+}
+
+void batch2d_restore_attribs(uint32_t mask) {
+	// Put back the game's own attribute sources
+	for (int i = 0; i < MAX_ATTRIBS; i++) {
+		if ((mask & (1 << i)) && attribs[i].size) {
+			glBindBuffer(GL_ARRAY_BUFFER, attribs[i].buffer);
+			set_pointer(i);
+			if (!(enabled_mask & (1 << i)))
+				glDisableVertexAttribArray(i);
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, array_buffer);
+}
+
+int batch2d_is_2d(void) {
+	return cur && cur->is_2d;
+}
+
+void batch2d_use_program(GLuint program) {
+	cur = get_program_info(program);
+}
+
+void batch2d_forget_program(GLuint program) {
+	for (int i = 0; i < programs_num; i++) {
+		if (programs[i].prog == program) {
+			program_info *last = &programs[--programs_num];
+			if (cur == &programs[i])
+				cur = NULL;
+			else if (cur == last)
+				cur = &programs[i];
+			programs[i] = *last;
+			return;
+		}
+	}
+}
+
+void batch2d_set_uv_remap(float u, float v, float su, float sv, void (*unmapped)(void)) {
+	uv_remap.active = 1;
+	uv_remap.unmapped = unmapped;
+	uv_remap.offs[0] = u;
+	uv_remap.offs[1] = v;
+	uv_remap.scale[0] = su;
+	uv_remap.scale[1] = sv;
+}
+
+void batch2d_clear_uv_remap(void) {
+	uv_remap.active = 0;
+}
+
+// Number of triangle list vertices a draw expands to, 0 if the mode can't be batched
+static int expanded_count(GLenum mode, GLsizei count) {
+	switch (mode) {
+	case GL_TRIANGLES:
+		return count - count % 3;
+	case GL_TRIANGLE_STRIP:
+	case GL_TRIANGLE_FAN:
+		return count < 3 ? 0 : (count - 2) * 3;
+	default:
+		return 0;
+	}
+}
+
+static int expanded_index(GLenum mode, int j) {
+	int tri = j / 3, k = j % 3;
+	switch (mode) {
+	case GL_TRIANGLE_STRIP:
+		// Keep winding consistent on odd triangles
+		if (tri & 1)
+			return tri + (k == 0 ? 1 : (k == 1 ? 0 : 2));
+		return tri + k;
+	case GL_TRIANGLE_FAN:
+		return k == 0 ? 0 : tri + k;
+	default:
+		return j;
+	}
+}
+
+static const uint8_t *attrib_source(int i, GLsizeiptr *avail) {
+	attrib_ptr *a = &attribs[i];
+	if (!a->buffer) {
+		*avail = -1;
+		return (const uint8_t *)a->ptr;
+	}
+	shadow_buffer *s = find_shadow(a->buffer, 0);
+	if (!s || !s->data)
+		return NULL;
+	*avail = s->size - (GLsizeiptr)(uintptr_t)a->ptr;
+	return s->data + (uintptr_t)a->ptr;
+}
+
+static int batch_draw(GLenum mode, GLint first, GLsizei count, GLenum idx_type, const void *indices) {
+	if (!cur || !cur->is_2d || !enabled_mask)
+		return 0;
+	render_batch_flush();
+
+	int out_verts = expanded_count(mode, count);
+	if (!out_verts || out_verts > BATCH_MAX_VERTS)
+		return 0;
+
+	const uint8_t *idx = NULL;
+	if (indices || idx_type) {
+		if (idx_type != GL_UNSIGNED_SHORT && idx_type != GL_UNSIGNED_BYTE)
+			return 0;
+		if (element_buffer) {
+			shadow_buffer *s = find_shadow(element_buffer, 0);
+			if (!s || !s->data || (uintptr_t)indices + count * type_size(idx_type) > s->size)
+				return 0;
+			idx = s->data + (uintptr_t)indices;
+		} else {
+			idx = (const uint8_t *)indices;
+		}
+	}
+
+	const uint8_t *src[MAX_ATTRIBS];
+	GLsizeiptr avail[MAX_ATTRIBS];
+	attrib_fmt fmt[MAX_ATTRIBS];
+	for (int i = 0; i < MAX_ATTRIBS; i++) {
+		if (!(enabled_mask & (1 << i)))
+			continue;
+		fmt[i].size = attribs[i].size;
+		fmt[i].type = attribs[i].type;
+		fmt[i].normalized = attribs[i].normalized;
+		fmt[i].elem_size = attribs[i].size * type_size(attribs[i].type);
+		if (!fmt[i].elem_size || fmt[i].elem_size > BATCH_MAX_ELEM_SIZE)
+			return 0;
+		src[i] = attrib_source(i, &avail[i]);
+		if (!src[i])
+			return 0;
+		if (uv_remap.active && i == cur->uv_attrib && (fmt[i].type != GL_FLOAT || fmt[i].size != 2))
+			return 0;
+	}
+
+	// Only draws sharing the exact same vertex layout can be merged
+	if (batch.draws && (batch.mask != enabled_mask || batch.num_verts + out_verts > BATCH_MAX_VERTS))
+		batch2d_flush();
+	if (batch.draws) {
+		for (int i = 0; i < MAX_ATTRIBS; i++) {
+			if ((enabled_mask & (1 << i)) && memcmp(&batch.fmt[i], &fmt[i], sizeof(attrib_fmt))) {
+				batch2d_flush();
+				break;
+			}
+		}
+	}
+
+	for (int i = 0; i < MAX_ATTRIBS; i++) {
+		if (!(enabled_mask & (1 << i)))
+			continue;
+		if (!batch.stream[i])
+			batch.stream[i] = (uint8_t *)malloc(BATCH_MAX_VERTS * BATCH_MAX_ELEM_SIZE);
+		int elem_size = fmt[i].elem_size;
+		int stride = attribs[i].stride ? attribs[i].stride : elem_size;
+		uint8_t *dst = batch.stream[i] + batch.num_verts * elem_size;
+		for (int j = 0; j < out_verts; j++) {
+			int v = expanded_index(mode, j);
+			if (idx)
+				v = idx_type == GL_UNSIGNED_SHORT ? ((const uint16_t *)idx)[v] : idx[v];
+			else
+				v += first;
+			if (avail[i] >= 0 && (GLsizeiptr)v * stride + elem_size > avail[i])
+				return 0; // Out of the shadowed data, let vitaGL deal with it
+			memcpy(dst, src[i] + v * stride, elem_size);
+			dst += elem_size;
+		}
+		if (uv_remap.active && i == cur->uv_attrib) {
+			float *uv = (float *)(batch.stream[i] + batch.num_verts * elem_size);
+			for (int j = 0; j < out_verts; j++, uv += 2) {
+				uv[0] = uv_remap.offs[0] + uv[0] * uv_remap.scale[0];
+				uv[1] = uv_remap.offs[1] + uv[1] * uv_remap.scale[1];
+			}
+		}
+		batch.fmt[i] = fmt[i];
+	}
+
+	batch.mask = enabled_mask;
+	batch.num_verts += out_verts;
+	batch.draws++;
+	return 1;
+}
+
+// Draws going straight to vitaGL can't sample the atlas page with their own texture coordinates
+static void unmap_texture(void) {
+	if (!uv_remap.active)
+		return;
+	uv_remap.active = 0;
+	uv_remap.unmapped();
+}
+
+// Points the attributes read from a streamed buffer at its current bytes in the ring
+static void stream_attribs(void) {
+	int rebound = 0;
+	for (int i = 0; i < MAX_ATTRIBS; i++) {
+		attrib_ptr *a = &attribs[i];
+		uintptr_t offs;
+		if (!(enabled_mask & (1 << i)) || !a->buffer || !stream_ring_offset(a->buffer, &offs))
+			continue;
+		if ((ring_mask & (1 << i)) && ring_offs[i] == offs)
+			continue;
+		if (!rebound) {
+			glBindBuffer(GL_ARRAY_BUFFER, stream_ring_buffer());
+			rebound = 1;
+		}
+		glVertexAttribPointer(i, a->size, a->type, a->normalized, a->stride, (const uint8_t *)a->ptr + offs);
+		ring_mask |= (1 << i);
+		ring_offs[i] = offs;
+	}
+	if (rebound)
+		glBindBuffer(GL_ARRAY_BUFFER, array_buffer);
+}
+
+void batch2d_draw_arrays(GLenum mode, GLint first, GLsizei count) {
+	if (batch_draw(mode, first, count, 0, NULL))
+		return;
+	batch2d_flush();
+	unmap_texture();
+	vertex_compress_draw(enabled_mask, array_buffer);
+	stream_attribs();
+	glDrawArrays(mode, first, count);
+	stats_cur.draws_issued++;
+}
+
+void batch2d_draw_elements(GLenum mode, GLsizei count, GLenum type, const void *indices) {
+	if (batch_draw(mode, 0, count, type, indices))
+		return;
+	batch2d_flush();
+	unmap_texture();
+	vertex_compress_draw(enabled_mask, array_buffer);
+	index_reorder_draw(element_buffer, mode, count, type, indices);
+	stream_attribs();
+	uintptr_t offs;
+	if (element_buffer && stream_ring_offset(element_buffer, &offs)) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, stream_ring_buffer());
+		glDrawElements(mode, count, type, (const uint8_t *)indices + offs);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+	} else {
+		glDrawElements(mode, count, type, indices);
+	}
+	stats_cur.draws_issued++;
+}
+
+void glBindBuffer_hook(GLenum target, GLuint buffer) {
+	if (target == GL_ARRAY_BUFFER)
+		array_buffer = buffer;
+	else if (target == GL_ELEMENT_ARRAY_BUFFER)
+		element_buffer = buffer;
+	stream_ring_bind(target, buffer);
+	glBindBuffer(target, buffer);
+}
+
+void glBufferData_hook(GLenum target, GLsizeiptr size, const void *data, GLenum usage) {
+	GLuint id = target == GL_ARRAY_BUFFER ? array_buffer : (target == GL_ELEMENT_ARRAY_BUFFER ? element_buffer : 0);
+	shadow_buffer *s = find_shadow(id, size <= MAX_SHADOW_BUFFER_SIZE);
+	if (s) {
+		if (size <= MAX_SHADOW_BUFFER_SIZE) {
+			if (s->size != size) {
+				free(s->data);
+				s->data = (uint8_t *)malloc(size);
+				s->size = size;
+			}
+			if (data)
+				memcpy(s->data, data, size);
+		} else {
+			free(s->data);
+			s->data = NULL;
+			s->size = 0;
+		}
+	}
+	if (stream_ring_buffer_data(target, id, size, data, usage)) {
+		// Streamed buffers have no place in the caches built from static data
+		vertex_compress_delete(id);
+		index_reorder_delete(id);
+		return;
+	}
+	if (target == GL_ARRAY_BUFFER)
+		vertex_compress_buffer_data(id, size, data, usage);
+	else if (target == GL_ELEMENT_ARRAY_BUFFER)
+		index_reorder_buffer_data(id, size, data, usage);
+	glBufferData(target, size, data, usage);
+}
+
+void glBufferSubData_hook(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) {
+	GLuint id = target == GL_ARRAY_BUFFER ? array_buffer : (target == GL_ELEMENT_ARRAY_BUFFER ? element_buffer : 0);
+	shadow_buffer *s = find_shadow(id, 0);
+	if (s && s->data && offset + size <= s->size)
+		memcpy(s->data + offset, data, size);
+	if (stream_ring_buffer_sub_data(id, offset, size, data))
+		return;
+	if (target == GL_ARRAY_BUFFER)
+		vertex_compress_buffer_sub_data(id, offset, size, data);
+	else if (target == GL_ELEMENT_ARRAY_BUFFER)
+		index_reorder_buffer_sub_data(id, offset, size, data);
+	glBufferSubData(target, offset, size, data);
+}
+
+void glDeleteBuffers_hook(GLsizei n, const GLuint *buffers) {
+	for (int i = 0; i < n; i++) {
+		shadow_buffer *s = find_shadow(buffers[i], 0);
+		if (s) {
+			free(s->data);
+			s->data = NULL;
+			s->size = 0;
+		}
+		vertex_compress_delete(buffers[i]);
+		index_reorder_delete(buffers[i]);
+		stream_ring_delete(buffers[i]);
+	}
+	glDeleteBuffers(n, buffers);
+}
+
+void glVertexAttribPointer_hook(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer) {
+	if (index < MAX_ATTRIBS) {
+		attrib_ptr *a = &attribs[index];
+		a->size = size;
+		a->type = type;
+		a->normalized = normalized;
+		a->stride = stride;
+		a->ptr = pointer;
+		a->buffer = array_buffer;
+		ring_mask &= ~(1 << index);
+	}
+	vertex_compress_pointer(index, array_buffer, &size, &type, &normalized, &stride, &pointer);
+	glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+}
+
+void glEnableVertexAttribArray_hook(GLuint index) {
+	if (index < MAX_ATTRIBS && !(enabled_mask & (1 << index))) {
+		batch2d_flush();
+		enabled_mask |= (1 << index);
+	}
+	glEnableVertexAttribArray(index);
+}
+
+void glDisableVertexAttribArray_hook(GLuint index) {
+	if (index < MAX_ATTRIBS && (enabled_mask & (1 << index))) {
+		batch2d_flush();
+		enabled_mask &= ~(1 << index);
+	}
+	glDisableVertexAttribArray(index);
+}
+
+// Uniform updates with the value already set don't reach vitaGL, nor break the batch
+void glUniform1i_hook(GLint location, GLint v0) {
+	if (uniform_cache_unchanged(location, &v0, sizeof(v0)))
+		return;
+	batch2d_flush();
+	glUniform1i(location, v0);
+}
+
+void glUniform1f_hook(GLint location, GLfloat v0) {
+	if (uniform_cache_unchanged(location, &v0, sizeof(v0)))
+		return;
+	batch2d_flush();
+	glUniform1f(location, v0);
+}
+
+void glUniform2f_hook(GLint location, GLfloat v0, GLfloat v1) {
+	GLfloat v[2] = {v0, v1};
+	if (uniform_cache_unchanged(location, v, sizeof(v)))
+		return;
+	batch2d_flush();
+	glUniform2f(location, v0, v1);
+}
+
+void glUniform2fv_hook(GLint location, GLsizei count, const GLfloat *value) {
+	if (uniform_cache_unchanged(location, value, count * sizeof(GLfloat) * 2))
+		return;
+	batch2d_flush();
+	glUniform2fv(location, count, value);
+}
+
+void glUniform1fv_hook(GLint location, GLsizei count, const GLfloat *value) {
+	if (uniform_cache_unchanged(location, value, count * sizeof(GLfloat)))
+		return;
+	batch2d_flush();
+	glUniform1fv(location, count, value);
+}
+
+void glUniform1iv_hook(GLint location, GLsizei count, const GLint *value) {
+	if (uniform_cache_unchanged(location, value, count * sizeof(GLint)))
+		return;
+	batch2d_flush();
+	glUniform1iv(location, count, value);
+}
+
+void glUniform3f_hook(GLint location, GLfloat v0, GLfloat v1, GLfloat v2) {
+	GLfloat v[3] = {v0, v1, v2};
+	if (uniform_cache_unchanged(location, v, sizeof(v)))
+		return;
+	batch2d_flush();
+	glUniform3f(location, v0, v1, v2);
+}
+
+void glUniform3fv_hook(GLint location, GLsizei count, const GLfloat *value) {
+	if (uniform_cache_unchanged(location, value, count * sizeof(GLfloat) * 3))
+		return;
+	batch2d_flush();
+	glUniform3fv(location, count, value);
+}
+
+void glUniform4f_hook(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3) {
+	GLfloat v[4] = {v0, v1, v2, v3};
+	if (uniform_cache_unchanged(location, v, sizeof(v)))
+		return;
+	batch2d_flush();
+	glUniform4f(location, v0, v1, v2, v3);
+}
+
+void glUniform4fv_hook(GLint location, GLsizei count, const GLfloat *value) {
+	if (uniform_cache_unchanged(location, value, count * sizeof(GLfloat) * 4))
+		return;
+	batch2d_flush();
+	glUniform4fv(location, count, value);
+}
+
+void glUniformMatrix3fv_hook(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
+	if (!transpose && uniform_cache_unchanged(location, value, count * sizeof(GLfloat) * 9))
+		return;
+	batch2d_flush();
+	glUniformMatrix3fv(location, count, transpose, value);
+}
+
+void glClear_hook(GLbitfield mask) {
+	if (render_target_skip_pass())
+		return;
+	batch2d_flush();
+	glClear(mask);
+}
+
+void glScissor_hook(GLint x, GLint y, GLsizei width, GLsizei height) {
+	batch2d_flush();
+	glScissor(x, y, width, height);
+}
+
+void glDepthMask_hook(GLboolean flag) {
+	batch2d_flush();
+	glDepthMask(flag);
+}
+
+void glColorMask_hook(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {
+	batch2d_flush();
+	glColorMask(red, green, blue, alpha);
+}
+
+void glDepthFunc_hook(GLenum func) {
+	batch2d_flush();
+	glDepthFunc(func);
+}
+
+void glCullFace_hook(GLenum mode) {
+	batch2d_flush();
+	glCullFace(mode);
+}
+
+void glTexSubImage2D_hook(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels) {
+	batch2d_flush();
+	glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+}
+
+void glTexParameteri_hook(GLenum target, GLenum pname, GLint param) {
+	batch2d_flush();
+	glTexParameteri(target, pname, param);
+}
+
+void glReadPixels_hook(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *pixels) {
+	batch2d_flush();
+	glReadPixels(x, y, width, height, format, type, pixels);
+}
+
+void glFinish_hook(void) {
+	batch2d_flush();
+	glFinish();
+}
@@ -0,0 +1,45 @@
+#ifndef __BATCH2D_H__
+#define __BATCH2D_H__
+
+#include <vitaGL.h>
+
+void batch2d_flush(void);
+void batch2d_use_program(GLuint program);
+void batch2d_forget_program(GLuint program); // Deleted or relinked, its id may come back as another program
+int batch2d_is_2d(void); // Current program is the 2D UI one
+void batch2d_restore_attribs(uint32_t mask); // Reissues the game's attribute pointers after direct vitaGL calls
+void batch2d_set_uv_remap(float u, float v, float su, float sv, void (*unmapped)(void)); // unmapped binds a texture draws can sample as is
+void batch2d_clear_uv_remap(void);
+void batch2d_draw_arrays(GLenum mode, GLint first, GLsizei count);
+void batch2d_draw_elements(GLenum mode, GLsizei count, GLenum type, const void *indices);
+
+void glBindBuffer_hook(GLenum target, GLuint buffer);
+void glBufferData_hook(GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+void glBufferSubData_hook(GLenum target, GLintptr offset, GLsizeiptr size, const void *data);
+void glDeleteBuffers_hook(GLsizei n, const GLuint *buffers);
+void glVertexAttribPointer_hook(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer);
+void glEnableVertexAttribArray_hook(GLuint index);
+void glDisableVertexAttribArray_hook(GLuint index);
+void glUniform1i_hook(GLint location, GLint v0);
+void glUniform1f_hook(GLint location, GLfloat v0);
+void glUniform2f_hook(GLint location, GLfloat v0, GLfloat v1);
+void glUniform2fv_hook(GLint location, GLsizei count, const GLfloat *value);
+void glUniform1fv_hook(GLint location, GLsizei count, const GLfloat *value);
+void glUniform1iv_hook(GLint location, GLsizei count, const GLint *value);
+void glUniform3f_hook(GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+void glUniform3fv_hook(GLint location, GLsizei count, const GLfloat *value);
+void glUniform4f_hook(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
+void glUniform4fv_hook(GLint location, GLsizei count, const GLfloat *value);
+void glUniformMatrix3fv_hook(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+void glClear_hook(GLbitfield mask);
+void glScissor_hook(GLint x, GLint y, GLsizei width, GLsizei height);
+void glDepthMask_hook(GLboolean flag);
+void glColorMask_hook(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+void glDepthFunc_hook(GLenum func);
+void glCullFace_hook(GLenum mode);
+void glTexSubImage2D_hook(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels);
+void glTexParameteri_hook(GLenum target, GLenum pname, GLint param);
+void glReadPixels_hook(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *pixels);
+void glFinish_hook(void);
+
+#endif
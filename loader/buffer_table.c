@@ -0,0 +1,36 @@
+/* buffer_table.c -- open addressing tables of per GL buffer records
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Shared by the modules tracking buffers of the game (batch2d.c shadows,
+ * vertex_compress.c, index_reorder.c, stream_ring.c). Records are found by
+ * linear probing from a hash of the id. A record is never removed: once its
+ * buffer is deleted, the owning module clears the rest of it but leaves the
+ * id, so that the records placed after it on a probing chain stay reachable,
+ * and the same id gets the record back if the game reuses it.
+ */
+
+#include <stdint.h>
+
+#include "buffer_table.h"
+
+void *buffer_table_find(void *records, int num, size_t size, GLuint id, int create) {
+	if (!id)
+		return NULL;
+	uint32_t h = (id * 2654435761u) & (num - 1);
+	for (int i = 0; i < num; i++) {
+		GLuint *r = (GLuint *)((uint8_t *)records + ((h + i) & (num - 1)) * size);
+		if (*r == id)
+			return r;
+		if (!*r) {
+			if (!create)
+				return NULL;
+			*r = id;
+			return r;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,11 @@
+#ifndef __BUFFER_TABLE_H__
+#define __BUFFER_TABLE_H__
+
+#include <vitaGL.h>
+#include <stddef.h>
+
+// Record of the buffer id in an array of num (power of two) records of size bytes, each starting with its GLuint id.
+// NULL if there's none and create is 0, or if the array is full
+void *buffer_table_find(void *records, int num, size_t size, GLuint id, int create);
+
+#endif
@@ -11,4 +11,51 @@
 #define SCREEN_W 960
 #define SCREEN_H 544
 
+// Side of the depth buffers backing the game's shadow maps
+#define SHADOW_MAP_SIZE 512
+
+// User settings file, see settings.c
+#define SETTINGS_PATH "ux0:data/rrm/settings.txt"
+
+// Shadow quality when not set in SETTINGS_PATH (0 off, 1 low, 2 full)
+#define SHADOW_QUALITY 2
+
+// Frame rate cap when not set in SETTINGS_PATH (60, 30 or 20, 0 disables it)
+#define FRAMECAP 0
+
+// Frame rate the 3D pass resolution is scaled down to keep (0 disables it)
+#define DYNRES_TARGET_FPS 30
+
+// Frames between two per-frame statistics averages in the log (0 disables it)
+#define STATS_LOG_INTERVAL 300
+
+// Surfaces up to ATLAS_MAX_SPRITE_SIZE in both dimensions are packed in shared textures
+#define ATLAS_MAX_SPRITE_SIZE 128
+#define ATLAS_PAGE_SIZE 1024
+#define ATLAS_MAX_PAGES 4
+
+// Output folder of tools/texture_transcoder.c
+#define DXT_CACHE_PATH "ux0:data/rrm/texcache"
+
+// Decoded images kept in memory, and folder of the on-disk raw pixels cache
+#define IMAGE_CACHE_BUDGET_MB 16
+#define IMAGE_CACHE_PATH "ux0:data/rrm/imgcache"
+#define IMAGE_CACHE_L2_BUDGET_MB 256
+
+// Lowest PSNR (dB) of an image converted to 16 bit by a texformat=<pattern> auto rule, see tex_format.c
+#define TEX_FORMAT_MIN_PSNR 36.0f
+
+// Vertex cache optimized index ranges, see index_reorder.c
+#define INDEX_CACHE_PATH "ux0:data/rrm/idxcache"
+
+// Buffers re-specified every frame are sub-allocated from a ring of this size, see stream_ring.c
+#define STREAM_RING_SIZE_MB 4
+
+// Rendered strings and their sizes kept by ttf_cache.c
+#define TTF_CACHE_BUDGET_KB 4096
+
+// GL commands are recorded to CAPTURE_PATH for as many frames as written in CAPTURE_TRIGGER, if it exists
+#define CAPTURE_TRIGGER "ux0:data/rrm/capture.txt"
+#define CAPTURE_PATH "ux0:data/rrm/capture.bin"
+
 #endif
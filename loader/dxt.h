@@ -0,0 +1,25 @@
+#ifndef __DXT_H__
+#define __DXT_H__
+
+#include <stdint.h>
+
+// Same values as the GL_EXT_texture_compression_s3tc enums
+#define DXT_FORMAT_DXT1 0x83F0 // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define DXT_FORMAT_DXT5 0x83F3 // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+
+#define DXT_MAGIC 0x54584452 // "RDXT"
+
+// On-disk layout of a transcoded texture, followed by size bytes of blocks
+typedef struct {
+	uint32_t magic;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;
+	uint32_t size;
+} dxt_header;
+
+static inline uint32_t dxt_size(uint32_t format, int w, int h) {
+	return ((w + 3) / 4) * ((h + 3) / 4) * (format == DXT_FORMAT_DXT1 ? 8 : 16);
+}
+
+#endif
@@ -0,0 +1,183 @@
+/* dxt_cache.c -- runtime side of the offline DXT texture transcoder
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * tools/texture_transcoder.c stores every image of the data folder as
+ * DXT_CACHE_PATH/<sha1 of the source>.dxt, plus an index.txt mapping source
+ * paths (and sizes, to catch replaced files) to keys. IMG_Load_hook still
+ * decodes the source, since surfaces going to SDL_CreateTextureFromSurface
+ * are uploaded as RGBA8 anyway and would only lose quality, but remembers
+ * the key of those having a transcoded version until they're freed. A
+ * glTexImage2D of such a surface's pixels is then served with the blocks
+ * through glCompressedTexImage2D.
+ */
+
+#include <vitaGL.h>
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "async_load.h"
+#include "batch2d.h"
+#include "glyph_atlas.h"
+#include "config.h"
+#include "dxt.h"
+#include "dxt_cache.h"
+#include "render_target.h"
+#include "tex_format.h"
+
+#define INDEX_SIZE 8192 // Power of two
+#define MAX_PENDING_UPLOADS 256
+
+typedef struct {
+	uint32_t path_hash;
+	uint32_t size;
+	char *path;
+	char key[41];
+} index_entry;
+
+typedef struct {
+	SDL_Surface *surface;
+	const void *pixels;
+	int width;
+	int height;
+	char key[41];
+} pending_upload;
+
+static index_entry *index_table = NULL;
+static int index_loaded = 0;
+static pending_upload pending[MAX_PENDING_UPLOADS];
+static int pending_next = 0;
+
+static uint32_t path_hash(const char *path) {
+	uint32_t h = 0x811C9DC5;
+	while (*path) {
+		h ^= (uint8_t)*path++;
+		h *= 0x01000193;
+	}
+	return h ? h : 1;
+}
+
+static void load_index(void) {
+	index_loaded = 1;
+	FILE *f = fopen(DXT_CACHE_PATH "/index.txt", "r");
+	if (!f)
+		return;
+
+	index_table = (index_entry *)calloc(INDEX_SIZE, sizeof(index_entry));
+	char key[41], path[256];
+	unsigned int size;
+	int num = 0;
+	while (fscanf(f, "%40s %u %255[^\n]", key, &size, path) == 3) {
+		uint32_t h = path_hash(path);
+		for (int i = 0; i < INDEX_SIZE; i++) {
+			index_entry *e = &index_table[(h + i) & (INDEX_SIZE - 1)];
+			if (!e->path_hash) {
+				e->path_hash = h;
+				e->size = size;
+				e->path = strdup(path);
+				strcpy(e->key, key);
+				num++;
+				break;
+			}
+		}
+	}
+	fclose(f);
+	printf("[DXT] %d transcoded textures indexed\n", num);
+}
+
+static index_entry *find_entry(const char *rel) {
+	uint32_t h = path_hash(rel);
+	for (int i = 0; i < INDEX_SIZE; i++) {
+		index_entry *e = &index_table[(h + i) & (INDEX_SIZE - 1)];
+		if (!e->path_hash)
+			return NULL;
+		if (e->path_hash == h && !strcmp(e->path, rel))
+			return e;
+	}
+	return NULL;
+}
+
+void dxt_cache_tag(SDL_Surface *surface, const char *rel, const char *path) {
+	if (!surface)
+		return;
+	if (!index_loaded)
+		load_index();
+	if (!index_table)
+		return;
+
+	while (rel[0] == '.' && rel[1] == '/')
+		rel += 2;
+	index_entry *e = find_entry(rel);
+	struct stat st;
+	if (!e || stat(path, &st) < 0 || st.st_size != e->size)
+		return;
+
+	// Oldest tags are dropped if the game holds too many surfaces, their upload just won't be compressed
+	pending_upload *p = &pending[pending_next];
+	pending_next = (pending_next + 1) % MAX_PENDING_UPLOADS;
+	p->surface = surface;
+	p->pixels = surface->pixels;
+	p->width = surface->w;
+	p->height = surface->h;
+	strcpy(p->key, e->key);
+}
+
+// Uploads the transcoded version of the image, 0 if it can't be used
+static int upload_blocks(GLenum target, const pending_upload *p) {
+	char fname[256];
+	snprintf(fname, sizeof(fname), "%s/%s.dxt", DXT_CACHE_PATH, p->key);
+	FILE *f = fopen(fname, "rb");
+	if (!f)
+		return 0;
+	dxt_header hdr;
+	// The transcoder never emits partial blocks, a file with some is broken
+	if (fread(&hdr, 1, sizeof(hdr), f) != sizeof(hdr) || hdr.magic != DXT_MAGIC || hdr.width != p->width || hdr.height != p->height ||
+		hdr.width % 4 || hdr.height % 4 || hdr.size != dxt_size(hdr.format, hdr.width, hdr.height)) {
+		fclose(f);
+		return 0;
+	}
+	uint8_t *blocks = (uint8_t *)malloc(hdr.size);
+	int res = blocks && fread(blocks, 1, hdr.size, f) == hdr.size;
+	fclose(f);
+	if (res)
+		glCompressedTexImage2D(target, 0, hdr.format, hdr.width, hdr.height, 0, hdr.size, blocks);
+	free(blocks);
+	return res;
+}
+
+void SDL_FreeSurface_hook(SDL_Surface *surface) {
+	for (int i = 0; i < MAX_PENDING_UPLOADS; i++) {
+		if (surface && pending[i].surface == surface)
+			memset(&pending[i], 0, sizeof(pending_upload));
+	}
+	tex_format_untag(surface);
+	glyph_atlas_free_surface(surface);
+	SDL_FreeSurface(surface);
+}
+
+void glTexImage2D_hook(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels) {
+	batch2d_flush();
+	if (render_target_tex_image(target, level, format, width, height, type, pixels))
+		return;
+	// Before the async path, the blocks don't need the pixels to be decoded yet
+	if (pixels && level == 0 && type == GL_UNSIGNED_BYTE) {
+		for (int i = 0; i < MAX_PENDING_UPLOADS; i++) {
+			pending_upload *p = &pending[i];
+			if (p->pixels == pixels && p->width == width && p->height == height && upload_blocks(target, p))
+				return;
+		}
+	}
+	if (async_load_tex_image(target, level, internalformat, width, height, format, type, pixels))
+		return;
+	glyph_atlas_rasterize(NULL, pixels);
+	if (tex_format_tex_image(target, level, width, height, format, type, pixels))
+		return;
+	glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+}
@@ -0,0 +1,12 @@
+#ifndef __DXT_CACHE_H__
+#define __DXT_CACHE_H__
+
+#include <vitaGL.h>
+#include <SDL2/SDL.h>
+
+void dxt_cache_tag(SDL_Surface *surface, const char *rel, const char *path); // Remembers the transcoded version of a loaded image, if any
+
+void SDL_FreeSurface_hook(SDL_Surface *surface);
+void glTexImage2D_hook(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels);
+
+#endif
@@ -0,0 +1,197 @@
+/* dynres.c -- dynamic resolution for the 3D pass
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * The time spent building a frame (from the end of a swap to the next one,
+ * so vblank waits don't count) is averaged over DYNRES_WINDOW frames. Above
+ * the DYNRES_TARGET_FPS budget the next smaller size of levels[] is picked,
+ * well below it the next bigger one, and every change is followed by a
+ * cooldown so the scale doesn't bounce between two neighbours.
+ * Below native size, framebuffer 0 is redirected to a scaled target (see
+ * render_target.c) until the first 2D draw of the frame, which is where the
+ * target gets upscaled to the screen with a single linear filtered quad.
+ */
+
+#include <vitaGL.h>
+#include <psp2/kernel/processmgr.h>
+
+#include <stdio.h>
+
+#include "batch2d.h"
+#include "config.h"
+#include "dynres.h"
+#include "gl_state.h"
+
+#define DYNRES_WINDOW 30 // Frames averaged for every decision
+#define DYNRES_COOLDOWN 2 // Windows skipped after a change
+#define DYNRES_DOWN_PERCENT 105 // Frame time, in percent of the budget, above which the scale goes down
+#define DYNRES_UP_PERCENT 75 // ...and below which it goes up
+
+static const struct {
+	GLsizei w, h;
+} levels[] = {
+	{SCREEN_W, SCREEN_H},
+	{864, 490},
+	{768, 436},
+	{672, 382},
+	{576, 326},
+};
+#define NUM_LEVELS (sizeof(levels) / sizeof(*levels))
+
+static const char *blit_vs =
+	"attribute vec2 a_Pos;\n"
+	"varying vec2 v_TexCoords;\n"
+	"void main() {\n"
+	"\tv_TexCoords = a_Pos * 0.5 + 0.5;\n"
+	"\tgl_Position = vec4(a_Pos, 0.0, 1.0);\n"
+	"}\n";
+
+static const char *blit_fs =
+	"precision mediump float;\n"
+	"varying vec2 v_TexCoords;\n"
+	"uniform sampler2D u_Tex;\n"
+	"void main() {\n"
+	"\tgl_FragColor = texture2D(u_Tex, v_TexCoords);\n"
+	"}\n";
+
+static const GLfloat blit_quad[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+
+static int level = 0;
+static int resolved = 0;
+static GLuint target_fb = 0, target_tex = 0, target_depth = 0;
+static GLuint blit_prog = 0;
+
+static uint64_t frame_start = 0;
+static uint64_t window_us = 0;
+static int window_frames = 0;
+static int cooldown = 0;
+
+static void destroy_target(void) {
+	if (!target_fb)
+		return;
+	glDeleteFramebuffers(1, &target_fb);
+	glDeleteRenderbuffers(1, &target_depth);
+	glDeleteTextures(1, &target_tex);
+	target_fb = target_tex = target_depth = 0;
+
+	// The names can be handed out to the game again
+	gl_state_invalidate();
+}
+
+static void create_target(void) {
+	GLsizei w = levels[level].w, h = levels[level].h;
+
+	glGenTextures(1, &target_tex);
+	gl_state_bind_texture(GL_TEXTURE_2D, target_tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenRenderbuffers(1, &target_depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, target_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8_OES, w, h);
+
+	glGenFramebuffers(1, &target_fb);
+	gl_state_bind_framebuffer(GL_FRAMEBUFFER, target_fb);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target_tex, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target_depth);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target_depth);
+}
+
+static GLuint compile_shader(GLenum type, const char *src) {
+	GLuint s = glCreateShader(type);
+	glShaderSource(s, 1, &src, NULL);
+	glCompileShader(s);
+	return s;
+}
+
+static void create_blit_program(void) {
+	GLuint vs = compile_shader(GL_VERTEX_SHADER, blit_vs);
+	GLuint fs = compile_shader(GL_FRAGMENT_SHADER, blit_fs);
+	blit_prog = glCreateProgram();
+	glAttachShader(blit_prog, vs);
+	glAttachShader(blit_prog, fs);
+	glBindAttribLocation(blit_prog, 0, "a_Pos");
+	glLinkProgram(blit_prog);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+}
+
+GLuint dynres_framebuffer(void) {
+	return resolved ? 0 : target_fb;
+}
+
+void dynres_size(GLsizei *w, GLsizei *h) {
+	*w = levels[level].w;
+	*h = levels[level].h;
+}
+
+int dynres_blit(void) {
+	if (!target_fb || resolved)
+		return 0;
+	resolved = 1;
+	if (!blit_prog)
+		create_blit_program();
+
+	gl_state_push();
+	gl_state_bind_framebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, SCREEN_W, SCREEN_H);
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glUseProgram(blit_prog);
+	glBindTexture(GL_TEXTURE_2D, target_tex);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, blit_quad);
+	glEnableVertexAttribArray(0);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	batch2d_restore_attribs(1 << 0);
+	gl_state_pop();
+	return 1;
+}
+
+void dynres_frame_end(void) {
+	if (frame_start) {
+		window_us += sceKernelGetProcessTimeWide() - frame_start;
+		window_frames++;
+	}
+}
+
+void dynres_frame_begin(void) {
+	frame_start = sceKernelGetProcessTimeWide();
+	resolved = 0;
+	if (!DYNRES_TARGET_FPS || window_frames < DYNRES_WINDOW)
+		return;
+
+	uint32_t avg = window_us / window_frames;
+	window_us = 0;
+	window_frames = 0;
+	if (cooldown) {
+		cooldown--;
+		return;
+	}
+
+	uint32_t budget = 1000000 / DYNRES_TARGET_FPS;
+	int next = level;
+	if (avg > budget * DYNRES_DOWN_PERCENT / 100 && level < NUM_LEVELS - 1)
+		next++;
+	else if (avg < budget * DYNRES_UP_PERCENT / 100 && level > 0)
+		next--;
+	if (next == level)
+		return;
+
+	destroy_target();
+	level = next;
+	if (level)
+		create_target();
+	cooldown = DYNRES_COOLDOWN;
+	printf("[DynRes] 3D pass at %dx%d (%d%%), average frame time %u us\n",
+		levels[level].w, levels[level].h, levels[level].w * 100 / SCREEN_W, avg);
+}
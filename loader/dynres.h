@@ -0,0 +1,12 @@
+#ifndef __DYNRES_H__
+#define __DYNRES_H__
+
+#include <vitaGL.h>
+
+GLuint dynres_framebuffer(void); // Scaled target standing for framebuffer 0, 0 if native size or already upscaled
+void dynres_size(GLsizei *w, GLsizei *h);
+int dynres_blit(void); // Upscales the 3D pass to framebuffer 0, 1 if done
+void dynres_frame_end(void);
+void dynres_frame_begin(void);
+
+#endif
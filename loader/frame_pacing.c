@@ -0,0 +1,83 @@
+/* frame_pacing.c -- frame limiter and frame time histogram
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * vitaGL flips on vblank, so capping to 60/framecap vblanks per frame only
+ * needs the swap to be held back until the vblank before the one the frame
+ * is due on has passed. The wait is a sceKernelDelayThread up to SPIN_US
+ * before the deadline, then a busy loop for the rest, since thread wakeups
+ * are too coarse to land right after a vblank. A late frame re-anchors the
+ * deadlines instead of trying to catch up.
+ */
+
+#include <psp2/kernel/processmgr.h>
+#include <psp2/kernel/threadmgr.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "frame_pacing.h"
+#include "settings.h"
+
+#define VBLANK_US 16683 // 59.94 Hz
+#define VBLANK_GUARD_US 1000 // Past the vblank before the due one, the flip can't catch it anymore
+#define SPIN_US 2000
+#define HISTOGRAM_BUCKETS 100 // 1 ms each, the last one also counts longer frames
+
+static uint64_t anchor = 0; // End of the last swap
+static uint32_t histogram[HISTOGRAM_BUCKETS];
+static uint32_t histogram_frames = 0;
+
+static int interval(void) {
+	if (framecap <= 0 || framecap >= 60)
+		return 1;
+	return framecap >= 30 ? 2 : 3;
+}
+
+void frame_pacing_wait(void) {
+	if (!anchor || framecap <= 0)
+		return;
+	uint64_t deadline = anchor + (interval() - 1) * VBLANK_US + VBLANK_GUARD_US;
+	uint64_t now = sceKernelGetProcessTimeWide();
+	if (now >= deadline)
+		return;
+	if (deadline - now > SPIN_US)
+		sceKernelDelayThread(deadline - now - SPIN_US);
+	while (sceKernelGetProcessTimeWide() < deadline) {
+	}
+}
+
+#if STATS_LOG_INTERVAL > 0
+static int percentile(int p) {
+	uint32_t target = (histogram_frames * p + 99) / 100, sum = 0;
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		sum += histogram[i];
+		if (sum >= target)
+			return i + 1;
+	}
+	return HISTOGRAM_BUCKETS;
+}
+#endif
+
+void frame_pacing_present(void) {
+	uint64_t now = sceKernelGetProcessTimeWide();
+	if (anchor) {
+		uint32_t ms = (now - anchor) / 1000;
+		histogram[ms < HISTOGRAM_BUCKETS ? ms : HISTOGRAM_BUCKETS - 1]++;
+		histogram_frames++;
+	}
+	anchor = now;
+
+#if STATS_LOG_INTERVAL > 0
+	if (histogram_frames == STATS_LOG_INTERVAL) {
+		printf("[FramePacing] Frame time over %d frames (cap %d fps): p50 %d ms, p95 %d ms, p99 %d ms\n",
+			STATS_LOG_INTERVAL, framecap, percentile(50), percentile(95), percentile(99));
+		memset(histogram, 0, sizeof(histogram));
+		histogram_frames = 0;
+	}
+#endif
+}
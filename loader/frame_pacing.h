@@ -0,0 +1,7 @@
+#ifndef __FRAME_PACING_H__
+#define __FRAME_PACING_H__
+
+void frame_pacing_wait(void); // Holds the frame back until it's due according to framecap
+void frame_pacing_present(void);
+
+#endif
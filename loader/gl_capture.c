@@ -0,0 +1,648 @@
+/* gl_capture.c -- recording of the GL command stream at libmain.so's imports
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Enabled by creating CAPTURE_TRIGGER with the number of frames to record in
+ * it. Every GL import of CAPTURE_OPS, from default_dynlib or handed out by
+ * SDL_GL_GetProcAddress, is then replaced by a wrapper writing the call to
+ * CAPTURE_PATH before forwarding it to what it was mapped to, from the first
+ * call up to the last frame. Buffer uploads, shader sources and client side
+ * vertex/index arrays are stored as is, texture uploads only as a hash.
+ * SDL renderer traffic doesn't go through the imports and isn't recorded.
+ * See tools/gl_replay for the host side.
+ */
+
+#include <vitasdk.h>
+#include <vitaGL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "gl_capture.h"
+#include "gl_capture_format.h"
+
+#define MAX_CAPTURE_ATTRIBS 16
+#define MAX_INDEX_BUFFERS 256
+
+typedef struct {
+	GLint size;
+	GLenum type;
+	GLsizei stride;
+	const void *ptr;
+	GLuint buffer;
+} capture_attrib;
+
+typedef struct {
+	GLuint id;
+	uint8_t *data;
+	GLsizeiptr size;
+} index_buffer;
+
+static FILE *out = NULL;
+static int frames_left = 0;
+
+static capture_attrib attribs[MAX_CAPTURE_ATTRIBS];
+static uint32_t enabled_mask = 0;
+static GLuint array_buffer = 0, element_buffer = 0;
+static index_buffer index_buffers[MAX_INDEX_BUFFERS];
+
+static const uint8_t padding[4] = {0};
+
+static uint32_t f2w(GLfloat f) {
+	uint32_t w;
+	memcpy(&w, &f, 4);
+	return w;
+}
+
+static uint32_t i2w(uint32_t i) {
+	return i;
+}
+
+#define WORD(x) _Generic((x), GLfloat: f2w, default: i2w)(x)
+
+static void record_begin(int op, const uint32_t *words, int num_words, uint32_t payload_size) {
+	capture_record r;
+	r.op = op;
+	r.num_words = num_words;
+	r.payload_size = payload_size;
+	fwrite(&r, 1, sizeof(r), out);
+	fwrite(words, 4, num_words, out);
+}
+
+static void record_data(const void *data, uint32_t size) {
+	fwrite(data, 1, size, out);
+	fwrite(padding, 1, (4 - (size & 3)) & 3, out);
+}
+
+static uint32_t padded(uint32_t size) {
+	return (size + 3) & ~3;
+}
+
+static void record(int op, const uint32_t *words, int num_words, const void *payload, uint32_t payload_size) {
+	if (!out)
+		return;
+	record_begin(op, words, num_words, padded(payload_size));
+	if (payload_size)
+		record_data(payload, payload_size);
+}
+
+static uint32_t fnv1a(const void *data, uint32_t size) {
+	const uint8_t *p = (const uint8_t *)data;
+	uint32_t h = 0x811C9DC5;
+	for (uint32_t i = 0; i < size; i++) {
+		h ^= p[i];
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+// Calls with scalar arguments only
+
+#define CAPTURE_0(name) \
+	static void (*real_##name)(void); \
+	static void cap_##name(void) { \
+		record(OP_##name, NULL, 0, NULL, 0); \
+		real_##name(); \
+	}
+
+#define CAPTURE_1(name, t0) \
+	static void (*real_##name)(t0); \
+	static void cap_##name(t0 a0) { \
+		uint32_t w[] = {WORD(a0)}; \
+		record(OP_##name, w, 1, NULL, 0); \
+		real_##name(a0); \
+	}
+
+#define CAPTURE_2(name, t0, t1) \
+	static void (*real_##name)(t0, t1); \
+	static void cap_##name(t0 a0, t1 a1) { \
+		uint32_t w[] = {WORD(a0), WORD(a1)}; \
+		record(OP_##name, w, 2, NULL, 0); \
+		real_##name(a0, a1); \
+	}
+
+#define CAPTURE_3(name, t0, t1, t2) \
+	static void (*real_##name)(t0, t1, t2); \
+	static void cap_##name(t0 a0, t1 a1, t2 a2) { \
+		uint32_t w[] = {WORD(a0), WORD(a1), WORD(a2)}; \
+		record(OP_##name, w, 3, NULL, 0); \
+		real_##name(a0, a1, a2); \
+	}
+
+#define CAPTURE_4(name, t0, t1, t2, t3) \
+	static void (*real_##name)(t0, t1, t2, t3); \
+	static void cap_##name(t0 a0, t1 a1, t2 a2, t3 a3) { \
+		uint32_t w[] = {WORD(a0), WORD(a1), WORD(a2), WORD(a3)}; \
+		record(OP_##name, w, 4, NULL, 0); \
+		real_##name(a0, a1, a2, a3); \
+	}
+
+#define CAPTURE_5(name, t0, t1, t2, t3, t4) \
+	static void (*real_##name)(t0, t1, t2, t3, t4); \
+	static void cap_##name(t0 a0, t1 a1, t2 a2, t3 a3, t4 a4) { \
+		uint32_t w[] = {WORD(a0), WORD(a1), WORD(a2), WORD(a3), WORD(a4)}; \
+		record(OP_##name, w, 5, NULL, 0); \
+		real_##name(a0, a1, a2, a3, a4); \
+	}
+
+CAPTURE_1(glActiveTexture, GLenum)
+CAPTURE_2(glBindTexture, GLenum, GLuint)
+CAPTURE_1(glEnable, GLenum)
+CAPTURE_1(glDisable, GLenum)
+CAPTURE_2(glBlendFunc, GLenum, GLenum)
+CAPTURE_4(glBlendFuncSeparate, GLenum, GLenum, GLenum, GLenum)
+CAPTURE_1(glBlendEquation, GLenum)
+CAPTURE_2(glBlendEquationSeparate, GLenum, GLenum)
+CAPTURE_4(glBlendColor, GLfloat, GLfloat, GLfloat, GLfloat)
+CAPTURE_4(glViewport, GLint, GLint, GLsizei, GLsizei)
+CAPTURE_4(glScissor, GLint, GLint, GLsizei, GLsizei)
+CAPTURE_1(glDepthMask, GLboolean)
+CAPTURE_4(glColorMask, GLboolean, GLboolean, GLboolean, GLboolean)
+CAPTURE_1(glDepthFunc, GLenum)
+CAPTURE_1(glCullFace, GLenum)
+CAPTURE_1(glFrontFace, GLenum)
+CAPTURE_1(glClear, GLbitfield)
+CAPTURE_4(glClearColor, GLfloat, GLfloat, GLfloat, GLfloat)
+CAPTURE_1(glClearDepthf, GLfloat)
+CAPTURE_3(glStencilFunc, GLenum, GLint, GLuint)
+CAPTURE_3(glStencilOp, GLenum, GLenum, GLenum)
+CAPTURE_1(glStencilMask, GLuint)
+CAPTURE_2(glPolygonOffset, GLfloat, GLfloat)
+CAPTURE_1(glLineWidth, GLfloat)
+CAPTURE_3(glTexParameteri, GLenum, GLenum, GLint)
+CAPTURE_3(glTexParameterf, GLenum, GLenum, GLfloat)
+CAPTURE_1(glGenerateMipmap, GLenum)
+CAPTURE_0(glFinish)
+CAPTURE_0(glFlush)
+CAPTURE_2(glBindFramebuffer, GLenum, GLuint)
+CAPTURE_5(glFramebufferTexture2D, GLenum, GLenum, GLenum, GLuint, GLint)
+CAPTURE_2(glBindRenderbuffer, GLenum, GLuint)
+CAPTURE_4(glRenderbufferStorage, GLenum, GLenum, GLsizei, GLsizei)
+CAPTURE_4(glFramebufferRenderbuffer, GLenum, GLenum, GLenum, GLuint)
+CAPTURE_1(glDeleteShader, GLuint)
+CAPTURE_1(glDeleteProgram, GLuint)
+CAPTURE_2(glAttachShader, GLuint, GLuint)
+CAPTURE_1(glLinkProgram, GLuint)
+CAPTURE_1(glUseProgram, GLuint)
+CAPTURE_1(glDisableVertexAttribArray, GLuint)
+CAPTURE_2(glUniform1i, GLint, GLint)
+CAPTURE_2(glUniform1f, GLint, GLfloat)
+CAPTURE_3(glUniform2f, GLint, GLfloat, GLfloat)
+CAPTURE_4(glUniform3f, GLint, GLfloat, GLfloat, GLfloat)
+CAPTURE_5(glUniform4f, GLint, GLfloat, GLfloat, GLfloat, GLfloat)
+
+// Object names, recorded once known
+
+static void record_names(int op, GLsizei n, const GLuint *names) {
+	if (!out)
+		return;
+	uint32_t count = n;
+	record_begin(op, &count, 1, n * 4);
+	fwrite(names, 4, n, out);
+}
+
+#define CAPTURE_GEN(name) \
+	static void (*real_##name)(GLsizei, GLuint *); \
+	static void cap_##name(GLsizei n, GLuint *names) { \
+		real_##name(n, names); \
+		record_names(OP_##name, n, names); \
+	}
+
+#define CAPTURE_DELETE(name) \
+	static void (*real_##name)(GLsizei, const GLuint *); \
+	static void cap_##name(GLsizei n, const GLuint *names) { \
+		record_names(OP_##name, n, names); \
+		real_##name(n, names); \
+	}
+
+CAPTURE_GEN(glGenTextures)
+CAPTURE_GEN(glGenBuffers)
+CAPTURE_GEN(glGenFramebuffers)
+CAPTURE_GEN(glGenRenderbuffers)
+CAPTURE_DELETE(glDeleteTextures)
+CAPTURE_DELETE(glDeleteBuffers)
+CAPTURE_DELETE(glDeleteFramebuffers)
+CAPTURE_DELETE(glDeleteRenderbuffers)
+
+static GLuint (*real_glCreateShader)(GLenum);
+static GLuint cap_glCreateShader(GLenum type) {
+	GLuint r = real_glCreateShader(type);
+	uint32_t w[] = {type, r};
+	record(OP_glCreateShader, w, 2, NULL, 0);
+	return r;
+}
+
+static GLuint (*real_glCreateProgram)(void);
+static GLuint cap_glCreateProgram(void) {
+	GLuint r = real_glCreateProgram();
+	uint32_t w[] = {r};
+	record(OP_glCreateProgram, w, 1, NULL, 0);
+	return r;
+}
+
+// Shader sources are stored concatenated
+static void (*real_glShaderSource)(GLuint, GLsizei, const GLchar **, const GLint *);
+static void cap_glShaderSource(GLuint shader, GLsizei count, const GLchar **string, const GLint *length) {
+	if (out) {
+		uint32_t size = 1;
+		for (int i = 0; i < count; i++)
+			size += (length && length[i] >= 0) ? length[i] : strlen(string[i]);
+		uint32_t w[] = {shader};
+		record_begin(OP_glShaderSource, w, 1, padded(size));
+		for (int i = 0; i < count; i++)
+			fwrite(string[i], 1, (length && length[i] >= 0) ? length[i] : strlen(string[i]), out);
+		record_data(padding, 1);
+	}
+	real_glShaderSource(shader, count, string, length);
+}
+
+static void (*real_glBindAttribLocation)(GLuint, GLuint, const GLchar *);
+static void cap_glBindAttribLocation(GLuint program, GLuint index, const GLchar *name) {
+	uint32_t w[] = {program, index};
+	record(OP_glBindAttribLocation, w, 2, name, strlen(name) + 1);
+	real_glBindAttribLocation(program, index, name);
+}
+
+#define CAPTURE_LOCATION(name) \
+	static GLint (*real_##name)(GLuint, const GLchar *); \
+	static GLint cap_##name(GLuint program, const GLchar *name) { \
+		GLint r = real_##name(program, name); \
+		uint32_t w[] = {program, r}; \
+		record(OP_##name, w, 2, name, strlen(name) + 1); \
+		return r; \
+	}
+
+CAPTURE_LOCATION(glGetUniformLocation)
+CAPTURE_LOCATION(glGetAttribLocation)
+
+// Buffers, copies of index buffers are kept to know the vertex range of indexed draws on client arrays
+
+static index_buffer *find_index_buffer(GLuint id, int create) {
+	index_buffer *free_slot = NULL;
+	for (int i = 0; i < MAX_INDEX_BUFFERS; i++) {
+		if (index_buffers[i].id == id)
+			return &index_buffers[i];
+		if (!index_buffers[i].id && !free_slot)
+			free_slot = &index_buffers[i];
+	}
+	if (create && free_slot)
+		free_slot->id = id;
+	return create ? free_slot : NULL;
+}
+
+static void (*real_glBindBuffer)(GLenum, GLuint);
+static void cap_glBindBuffer(GLenum target, GLuint buffer) {
+	if (target == GL_ARRAY_BUFFER)
+		array_buffer = buffer;
+	else if (target == GL_ELEMENT_ARRAY_BUFFER)
+		element_buffer = buffer;
+	uint32_t w[] = {target, buffer};
+	record(OP_glBindBuffer, w, 2, NULL, 0);
+	real_glBindBuffer(target, buffer);
+}
+
+static void (*real_glBufferData)(GLenum, GLsizeiptr, const void *, GLenum);
+static void cap_glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) {
+	if (target == GL_ELEMENT_ARRAY_BUFFER && element_buffer) {
+		index_buffer *b = find_index_buffer(element_buffer, 1);
+		if (b) {
+			b->data = realloc(b->data, size);
+			b->size = size;
+			if (data)
+				memcpy(b->data, data, size);
+		}
+	}
+	uint32_t w[] = {target, size, usage, data != NULL};
+	record(OP_glBufferData, w, 4, data, data ? size : 0);
+	real_glBufferData(target, size, data, usage);
+}
+
+static void (*real_glBufferSubData)(GLenum, GLintptr, GLsizeiptr, const void *);
+static void cap_glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) {
+	if (target == GL_ELEMENT_ARRAY_BUFFER) {
+		index_buffer *b = find_index_buffer(element_buffer, 0);
+		if (b && offset + size <= b->size)
+			memcpy(b->data + offset, data, size);
+	}
+	uint32_t w[] = {target, offset, size};
+	record(OP_glBufferSubData, w, 3, data, size);
+	real_glBufferSubData(target, offset, size, data);
+}
+
+static void (*real_glVertexAttribPointer)(GLuint, GLint, GLenum, GLboolean, GLsizei, const void *);
+static void cap_glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer) {
+	if (index < MAX_CAPTURE_ATTRIBS) {
+		capture_attrib *a = &attribs[index];
+		a->size = size;
+		a->type = type;
+		a->stride = stride;
+		a->ptr = pointer;
+		a->buffer = array_buffer;
+	}
+	uint32_t w[] = {index, size, type, normalized, stride, (uint32_t)(uintptr_t)pointer};
+	record(OP_glVertexAttribPointer, w, 6, NULL, 0);
+	real_glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+}
+
+static void (*real_glEnableVertexAttribArray)(GLuint);
+static void cap_glEnableVertexAttribArray(GLuint index) {
+	if (index < MAX_CAPTURE_ATTRIBS)
+		enabled_mask |= (1 << index);
+	uint32_t w[] = {index};
+	record(OP_glEnableVertexAttribArray, w, 1, NULL, 0);
+	real_glEnableVertexAttribArray(index);
+}
+
+// Uniform arrays
+
+#define CAPTURE_UNIFORM_V(name, type, n) \
+	static void (*real_##name)(GLint, GLsizei, const type *); \
+	static void cap_##name(GLint location, GLsizei count, const type *value) { \
+		uint32_t w[] = {location, count}; \
+		record(OP_##name, w, 2, value, count * n * 4); \
+		real_##name(location, count, value); \
+	}
+
+#define CAPTURE_UNIFORM_MATRIX(name, n) \
+	static void (*real_##name)(GLint, GLsizei, GLboolean, const GLfloat *); \
+	static void cap_##name(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) { \
+		uint32_t w[] = {location, count, transpose}; \
+		record(OP_##name, w, 3, value, count * n * 4); \
+		real_##name(location, count, transpose, value); \
+	}
+
+CAPTURE_UNIFORM_V(glUniform1iv, GLint, 1)
+CAPTURE_UNIFORM_V(glUniform1fv, GLfloat, 1)
+CAPTURE_UNIFORM_V(glUniform2fv, GLfloat, 2)
+CAPTURE_UNIFORM_V(glUniform3fv, GLfloat, 3)
+CAPTURE_UNIFORM_V(glUniform4fv, GLfloat, 4)
+CAPTURE_UNIFORM_MATRIX(glUniformMatrix3fv, 9)
+CAPTURE_UNIFORM_MATRIX(glUniformMatrix4fv, 16)
+
+// Textures, pixels are hashed
+
+static void (*real_glTexImage2D)(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void *);
+static void cap_glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels) {
+	uint32_t hash = (out && pixels) ? fnv1a(pixels, capture_image_size(width, height, format, type)) : 0;
+	uint32_t w[] = {target, level, internalformat, width, height, border, format, type, pixels != NULL, hash};
+	record(OP_glTexImage2D, w, 10, NULL, 0);
+	real_glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+}
+
+static void (*real_glTexSubImage2D)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void *);
+static void cap_glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels) {
+	uint32_t hash = out ? fnv1a(pixels, capture_image_size(width, height, format, type)) : 0;
+	uint32_t w[] = {target, level, xoffset, yoffset, width, height, format, type, hash};
+	record(OP_glTexSubImage2D, w, 9, NULL, 0);
+	real_glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+}
+
+static void (*real_glCompressedTexImage2D)(GLenum, GLint, GLenum, GLsizei, GLsizei, GLint, GLsizei, const void *);
+static void cap_glCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei size, const void *data) {
+	uint32_t hash = out ? fnv1a(data, size) : 0;
+	uint32_t w[] = {target, level, internalformat, width, height, border, size, hash};
+	record(OP_glCompressedTexImage2D, w, 8, NULL, 0);
+	real_glCompressedTexImage2D(target, level, internalformat, width, height, border, size, data);
+}
+
+static void (*real_glReadPixels)(GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void *);
+static void cap_glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *pixels) {
+	uint32_t w[] = {x, y, width, height, format, type};
+	record(OP_glReadPixels, w, 6, NULL, 0);
+	real_glReadPixels(x, y, width, height, format, type, pixels);
+}
+
+// Draws, client arrays are attached up to the highest vertex used
+
+static int type_size(GLenum type) {
+	switch (type) {
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+static uint32_t client_array_size(int i, uint32_t num_verts) {
+	capture_attrib *a = &attribs[i];
+	uint32_t elem = a->size * type_size(a->type);
+	return num_verts ? (num_verts - 1) * (a->stride ? a->stride : elem) + elem : 0;
+}
+
+static uint32_t client_arrays_payload(uint32_t num_verts, int *num_arrays) {
+	uint32_t size = 0;
+	*num_arrays = 0;
+	for (int i = 0; i < MAX_CAPTURE_ATTRIBS; i++) {
+		if ((enabled_mask & (1 << i)) && !attribs[i].buffer) {
+			size += sizeof(capture_client_array) + padded(client_array_size(i, num_verts));
+			(*num_arrays)++;
+		}
+	}
+	return size;
+}
+
+static void record_client_arrays(uint32_t num_verts) {
+	for (int i = 0; i < MAX_CAPTURE_ATTRIBS; i++) {
+		if ((enabled_mask & (1 << i)) && !attribs[i].buffer) {
+			capture_client_array c;
+			c.index = i;
+			c.size = client_array_size(i, num_verts);
+			fwrite(&c, 1, sizeof(c), out);
+			record_data(attribs[i].ptr, c.size);
+		}
+	}
+}
+
+static void (*real_glDrawArrays)(GLenum, GLint, GLsizei);
+static void cap_glDrawArrays(GLenum mode, GLint first, GLsizei count) {
+	if (out) {
+		int num_arrays;
+		uint32_t payload = client_arrays_payload(first + count, &num_arrays);
+		uint32_t w[] = {mode, first, count, num_arrays};
+		record_begin(OP_glDrawArrays, w, 4, payload);
+		record_client_arrays(first + count);
+	}
+	real_glDrawArrays(mode, first, count);
+}
+
+static void (*real_glDrawElements)(GLenum, GLsizei, GLenum, const void *);
+static void cap_glDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices) {
+	if (out) {
+		const uint8_t *idx = (const uint8_t *)indices;
+		if (element_buffer) {
+			index_buffer *b = find_index_buffer(element_buffer, 0);
+			idx = (b && b->data) ? b->data + (uintptr_t)indices : NULL;
+		}
+		uint32_t max_index = 0;
+		for (int i = 0; idx && i < count; i++) {
+			uint32_t v = type == GL_UNSIGNED_BYTE ? idx[i] : (type == GL_UNSIGNED_SHORT ? ((const uint16_t *)idx)[i] : ((const uint32_t *)idx)[i]);
+			if (v > max_index)
+				max_index = v;
+		}
+
+		int num_arrays;
+		uint32_t index_size = element_buffer ? 0 : count * type_size(type);
+		uint32_t payload = padded(index_size) + client_arrays_payload(idx ? max_index + 1 : 0, &num_arrays);
+		uint32_t w[] = {mode, count, type, element_buffer ? (uint32_t)(uintptr_t)indices : 0xFFFFFFFF, num_arrays};
+		record_begin(OP_glDrawElements, w, 5, payload);
+		if (index_size)
+			record_data(indices, index_size);
+		record_client_arrays(idx ? max_index + 1 : 0);
+	}
+	real_glDrawElements(mode, count, type, indices);
+}
+
+#define WRAPPED(name) {#name, (uintptr_t)&cap_##name, (uintptr_t *)&real_##name}
+
+static const struct {
+	const char *symbol;
+	uintptr_t wrapper;
+	uintptr_t *real;
+} wrapped[] = {
+	WRAPPED(glActiveTexture),
+	WRAPPED(glBindTexture),
+	WRAPPED(glEnable),
+	WRAPPED(glDisable),
+	WRAPPED(glBlendFunc),
+	WRAPPED(glBlendFuncSeparate),
+	WRAPPED(glBlendEquation),
+	WRAPPED(glBlendEquationSeparate),
+	WRAPPED(glBlendColor),
+	WRAPPED(glViewport),
+	WRAPPED(glScissor),
+	WRAPPED(glDepthMask),
+	WRAPPED(glColorMask),
+	WRAPPED(glDepthFunc),
+	WRAPPED(glCullFace),
+	WRAPPED(glFrontFace),
+	WRAPPED(glClear),
+	WRAPPED(glClearColor),
+	WRAPPED(glClearDepthf),
+	WRAPPED(glStencilFunc),
+	WRAPPED(glStencilOp),
+	WRAPPED(glStencilMask),
+	WRAPPED(glPolygonOffset),
+	WRAPPED(glLineWidth),
+	WRAPPED(glTexParameteri),
+	WRAPPED(glTexParameterf),
+	WRAPPED(glGenerateMipmap),
+	WRAPPED(glFinish),
+	WRAPPED(glFlush),
+	WRAPPED(glBindFramebuffer),
+	WRAPPED(glFramebufferTexture2D),
+	WRAPPED(glBindRenderbuffer),
+	WRAPPED(glRenderbufferStorage),
+	WRAPPED(glFramebufferRenderbuffer),
+	WRAPPED(glGenTextures),
+	WRAPPED(glGenBuffers),
+	WRAPPED(glGenFramebuffers),
+	WRAPPED(glGenRenderbuffers),
+	WRAPPED(glDeleteTextures),
+	WRAPPED(glDeleteBuffers),
+	WRAPPED(glDeleteFramebuffers),
+	WRAPPED(glDeleteRenderbuffers),
+	WRAPPED(glCreateShader),
+	WRAPPED(glCreateProgram),
+	WRAPPED(glDeleteShader),
+	WRAPPED(glDeleteProgram),
+	WRAPPED(glShaderSource),
+	WRAPPED(glAttachShader),
+	WRAPPED(glBindAttribLocation),
+	WRAPPED(glLinkProgram),
+	WRAPPED(glUseProgram),
+	WRAPPED(glGetUniformLocation),
+	WRAPPED(glGetAttribLocation),
+	WRAPPED(glBindBuffer),
+	WRAPPED(glBufferData),
+	WRAPPED(glBufferSubData),
+	WRAPPED(glVertexAttribPointer),
+	WRAPPED(glEnableVertexAttribArray),
+	WRAPPED(glDisableVertexAttribArray),
+	WRAPPED(glUniform1i),
+	WRAPPED(glUniform1f),
+	WRAPPED(glUniform2f),
+	WRAPPED(glUniform3f),
+	WRAPPED(glUniform4f),
+	WRAPPED(glUniform1iv),
+	WRAPPED(glUniform1fv),
+	WRAPPED(glUniform2fv),
+	WRAPPED(glUniform3fv),
+	WRAPPED(glUniform4fv),
+	WRAPPED(glUniformMatrix3fv),
+	WRAPPED(glUniformMatrix4fv),
+	WRAPPED(glTexImage2D),
+	WRAPPED(glTexSubImage2D),
+	WRAPPED(glCompressedTexImage2D),
+	WRAPPED(glReadPixels),
+	WRAPPED(glDrawArrays),
+	WRAPPED(glDrawElements),
+};
+
+static int find_wrapped(const char *symbol) {
+	for (int i = 0; i < sizeof(wrapped) / sizeof(*wrapped); i++) {
+		if (!strcmp(symbol, wrapped[i].symbol))
+			return i;
+	}
+	return -1;
+}
+
+void gl_capture_install(so_default_dynlib *funcs, size_t num) {
+	FILE *f = fopen(CAPTURE_TRIGGER, "r");
+	if (!f)
+		return;
+	if (fscanf(f, "%d", &frames_left) != 1 || frames_left <= 0)
+		frames_left = 0;
+	fclose(f);
+	if (!frames_left)
+		return;
+
+	out = fopen(CAPTURE_PATH, "wb");
+	if (!out) {
+		printf("[Capture] Could not create %s\n", CAPTURE_PATH);
+		return;
+	}
+	setvbuf(out, NULL, _IOFBF, 1024 * 1024);
+	capture_header hdr;
+	hdr.magic = CAPTURE_MAGIC;
+	hdr.version = CAPTURE_VERSION;
+	fwrite(&hdr, 1, sizeof(hdr), out);
+
+	// The first entry of a symbol is the one so_resolve uses
+	for (size_t i = 0; i < num; i++) {
+		int w = find_wrapped(funcs[i].symbol);
+		if (w >= 0 && !*wrapped[w].real) {
+			*wrapped[w].real = funcs[i].func;
+			funcs[i].func = wrapped[w].wrapper;
+		}
+	}
+	printf("[Capture] Recording %d frames to %s\n", frames_left, CAPTURE_PATH);
+}
+
+void *gl_capture_proc_address(const char *symbol, void *func) {
+	int w = find_wrapped(symbol);
+	if (w < 0 || !func || (!out && !frames_left))
+		return func;
+	if (!*wrapped[w].real)
+		*wrapped[w].real = (uintptr_t)func;
+	return *wrapped[w].real == (uintptr_t)func ? (void *)wrapped[w].wrapper : func;
+}
+
+void gl_capture_frame(void) {
+	if (!out)
+		return;
+	record(OP_FRAME, NULL, 0, NULL, 0);
+	if (--frames_left == 0) {
+		fclose(out);
+		out = NULL;
+		printf("[Capture] Done, %s can be replayed with tools/gl_replay\n", CAPTURE_PATH);
+	}
+}
@@ -0,0 +1,10 @@
+#ifndef __GL_CAPTURE_H__
+#define __GL_CAPTURE_H__
+
+#include "so_util.h"
+
+void gl_capture_install(so_default_dynlib *funcs, size_t num); // Wraps the captured imports if CAPTURE_TRIGGER exists
+void *gl_capture_proc_address(const char *symbol, void *func);
+void gl_capture_frame(void);
+
+#endif
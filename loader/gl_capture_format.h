@@ -0,0 +1,149 @@
+#ifndef __GL_CAPTURE_FORMAT_H__
+#define __GL_CAPTURE_FORMAT_H__
+
+// Shared by gl_capture.c and tools/gl_replay, no platform dependencies
+
+#include <stdint.h>
+
+#define CAPTURE_MAGIC 0x50414352 // "RCAP"
+#define CAPTURE_VERSION 1
+
+#define CAPTURE_OPS(X) \
+	X(glActiveTexture) \
+	X(glBindTexture) \
+	X(glEnable) \
+	X(glDisable) \
+	X(glBlendFunc) \
+	X(glBlendFuncSeparate) \
+	X(glBlendEquation) \
+	X(glBlendEquationSeparate) \
+	X(glBlendColor) \
+	X(glViewport) \
+	X(glScissor) \
+	X(glDepthMask) \
+	X(glColorMask) \
+	X(glDepthFunc) \
+	X(glCullFace) \
+	X(glFrontFace) \
+	X(glClear) \
+	X(glClearColor) \
+	X(glClearDepthf) \
+	X(glStencilFunc) \
+	X(glStencilOp) \
+	X(glStencilMask) \
+	X(glPolygonOffset) \
+	X(glLineWidth) \
+	X(glTexParameteri) \
+	X(glTexParameterf) \
+	X(glGenerateMipmap) \
+	X(glFinish) \
+	X(glFlush) \
+	X(glBindFramebuffer) \
+	X(glFramebufferTexture2D) \
+	X(glBindRenderbuffer) \
+	X(glRenderbufferStorage) \
+	X(glFramebufferRenderbuffer) \
+	X(glGenTextures) \
+	X(glGenBuffers) \
+	X(glGenFramebuffers) \
+	X(glGenRenderbuffers) \
+	X(glDeleteTextures) \
+	X(glDeleteBuffers) \
+	X(glDeleteFramebuffers) \
+	X(glDeleteRenderbuffers) \
+	X(glCreateShader) \
+	X(glCreateProgram) \
+	X(glDeleteShader) \
+	X(glDeleteProgram) \
+	X(glShaderSource) \
+	X(glAttachShader) \
+	X(glBindAttribLocation) \
+	X(glLinkProgram) \
+	X(glUseProgram) \
+	X(glGetUniformLocation) \
+	X(glGetAttribLocation) \
+	X(glBindBuffer) \
+	X(glBufferData) \
+	X(glBufferSubData) \
+	X(glVertexAttribPointer) \
+	X(glEnableVertexAttribArray) \
+	X(glDisableVertexAttribArray) \
+	X(glUniform1i) \
+	X(glUniform1f) \
+	X(glUniform2f) \
+	X(glUniform3f) \
+	X(glUniform4f) \
+	X(glUniform1iv) \
+	X(glUniform1fv) \
+	X(glUniform2fv) \
+	X(glUniform3fv) \
+	X(glUniform4fv) \
+	X(glUniformMatrix3fv) \
+	X(glUniformMatrix4fv) \
+	X(glTexImage2D) \
+	X(glTexSubImage2D) \
+	X(glCompressedTexImage2D) \
+	X(glReadPixels) \
+	X(glDrawArrays) \
+	X(glDrawElements)
+
+enum {
+#define CAPTURE_OP_ENUM(name) OP_##name,
+	CAPTURE_OPS(CAPTURE_OP_ENUM)
+#undef CAPTURE_OP_ENUM
+	OP_FRAME, // SDL_GL_SwapWindow
+	OP_NUM
+};
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+} capture_header;
+
+// Followed by num_words 32 bit arguments (floats stored as their bits) and
+// payload_size bytes of data, padded to 4 bytes
+typedef struct {
+	uint16_t op;
+	uint16_t num_words;
+	uint32_t payload_size;
+} capture_record;
+
+// Client side vertex arrays are attached to draws as a capture_client_array
+// followed by size bytes (padded to 4) holding vertices 0 to the highest used
+typedef struct {
+	uint32_t index;
+	uint32_t size;
+} capture_client_array;
+
+// Bytes read by glTexImage2D/glTexSubImage2D with the default unpack alignment
+static inline uint32_t capture_image_size(uint32_t w, uint32_t h, uint32_t format, uint32_t type) {
+	uint32_t bpp;
+	switch (type) {
+	case 0x8363: // GL_UNSIGNED_SHORT_5_6_5
+	case 0x8033: // GL_UNSIGNED_SHORT_4_4_4_4
+	case 0x8034: // GL_UNSIGNED_SHORT_5_5_5_1
+		bpp = 2;
+		break;
+	default:
+		switch (format) {
+		case 0x1907: // GL_RGB
+			bpp = 3;
+			break;
+		case 0x1908: // GL_RGBA
+			bpp = 4;
+			break;
+		case 0x190A: // GL_LUMINANCE_ALPHA
+			bpp = 2;
+			break;
+		default:
+			bpp = 1;
+			break;
+		}
+		if (type == 0x1406) // GL_FLOAT
+			bpp *= 4;
+		break;
+	}
+	return ((w * bpp + 3) & ~3) * h;
+}
+
+#endif
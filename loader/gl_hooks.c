@@ -0,0 +1,114 @@
+/* gl_hooks.c -- GL imports of libmain.so glueing the rendering modules together
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Kept apart from main.c so that tools/gl_replay can run them on a host.
+ */
+
+#include <vitaGL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch2d.h"
+#include "gl_hooks.h"
+#include "glsl_translate.h"
+#include "mvp_fold.h"
+#include "program_cache.h"
+#include "render_target.h"
+#include "sha1.h"
+#include "stats.h"
+
+void glShaderSource_hook(GLuint shader, GLsizei count, const GLchar **string, const GLint *length) {
+	uint32_t sha1[5];
+	SHA1_CTX ctx;
+	
+	// GLSL ES 3.00 sources are downgraded so that they can go through the GLSL ES 1.00 path
+	const glsl_translation *t = glsl_translate(count, string, length, program_cache_get_shader_type(shader) == GL_VERTEX_SHADER);
+	if (t) {
+		if (t->unsupported)
+			printf("Shader translation left %d GLSL ES 3.00 constructs untouched\n", t->unsupported);
+		string = (const GLchar **)&t->src;
+		count = 1;
+		length = NULL;
+		program_cache_set_shader_layout(shader, t);
+	}
+	
+	sha1_init(&ctx);
+	for (int i = 0; i < count; i++) {
+		sha1_update(&ctx, string[i], (length && length[i] >= 0) ? length[i] : strlen(string[i]));
+	}
+	sha1_final(&ctx, (uint8_t *)sha1);
+	program_cache_set_shader_hash(shader, sha1);
+
+	char sha_name[64];
+	snprintf(sha_name, sizeof(sha_name), "%08x%08x%08x%08x%08x", sha1[0], sha1[1], sha1[2], sha1[3], sha1[4]);
+
+	char cg_path[128];
+	snprintf(cg_path, sizeof(cg_path), "app0:/shaders/%s_glsl.gxp", sha_name);
+
+	FILE *file = fopen(cg_path, "rb");
+	
+	printf("Shader: %s\n", sha_name);
+	if (!file) {
+		stats_cur.shader_misses++;
+		glShaderSource(shader, count, string, length);
+		glCompileShader(shader);
+		/*void *bin = vglMalloc(32 * 1024);
+        GLsizei len;
+		vglGetShaderBinary(shader, 32 * 1024, &len, bin);
+        file = fopen(cg_path, "wb");
+        fwrite(bin, 1, len, file);
+        fclose(file);
+        vglFree(bin);*/
+	} else {
+		stats_cur.shader_hits++;
+		fseek(file, 0, SEEK_END);
+		uint32_t size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		char *buf = (char *)malloc(size + 1);
+		fread(buf, 1, size, file);
+		fclose(file);
+		buf[size] = 0;
+		glShaderBinary(1, &shader, 0, buf, size);
+		free(buf);
+	}
+}
+
+void glFramebufferTexture2D_hook(GLenum target, GLenum attachment, GLenum textarget, GLuint tex_id, GLint level) {
+	render_target_attach(target, attachment, textarget, tex_id, level);
+}
+
+void glBindFramebuffer_hook(GLenum target, GLuint framebuffer) {
+	//printf("glBindFramebuffer %x %x\n", target, framebuffer);
+	render_target_bind_framebuffer(target, framebuffer);
+}
+
+void glViewport_hook(GLint x, GLint y, GLsizei width, GLsizei height) {
+	//printf("glViewport %d %d %u %u\n", x, y, width, height);
+	render_target_viewport();
+}
+
+void glDrawArrays_hook(GLenum mode, GLint first, GLsizei count) {
+	stats_cur.draws++;
+	if (render_target_skip_pass())
+		return;
+	if (batch2d_is_2d())
+		render_target_end_3d();
+	mvp_fold_flush();
+	batch2d_draw_arrays(mode, first, count);
+}
+
+void glDrawElements_hook(GLenum mode, GLsizei count, GLenum type, const void *indices) {
+	stats_cur.draws++;
+	if (render_target_skip_pass())
+		return;
+	if (batch2d_is_2d())
+		render_target_end_3d();
+	mvp_fold_flush();
+	batch2d_draw_elements(mode, count, type, indices);
+}
@@ -0,0 +1,13 @@
+#ifndef __GL_HOOKS_H__
+#define __GL_HOOKS_H__
+
+#include <vitaGL.h>
+
+void glShaderSource_hook(GLuint shader, GLsizei count, const GLchar **string, const GLint *length);
+void glFramebufferTexture2D_hook(GLenum target, GLenum attachment, GLenum textarget, GLuint tex_id, GLint level);
+void glBindFramebuffer_hook(GLenum target, GLuint framebuffer);
+void glViewport_hook(GLint x, GLint y, GLsizei width, GLsizei height);
+void glDrawArrays_hook(GLenum mode, GLint first, GLsizei count);
+void glDrawElements_hook(GLenum mode, GLsizei count, GLenum type, const void *indices);
+
+#endif
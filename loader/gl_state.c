@@ -0,0 +1,304 @@
+/* gl_state.c -- shadow state cache filtering redundant GL state changes
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Every value starts as unknown and the first call always reaches vitaGL.
+ * SDL's renderer talks to vitaGL directly, so its entrypoints invalidate
+ * the whole shadow state (see gl_state_invalidate callers in main.c).
+ */
+
+#include <vitaGL.h>
+
+#include <string.h>
+
+#include "async_load.h"
+#include "batch2d.h"
+#include "gl_state.h"
+#include "render_target.h"
+#include "stats.h"
+
+#define MAX_TEXTURE_UNITS 16
+#define UNKNOWN GL_STATE_UNKNOWN
+
+static const GLenum shadowed_caps[] = {
+	GL_BLEND,
+	GL_CULL_FACE,
+	GL_DEPTH_TEST,
+	GL_DITHER,
+	GL_POLYGON_OFFSET_FILL,
+	GL_SAMPLE_ALPHA_TO_COVERAGE,
+	GL_SAMPLE_COVERAGE,
+	GL_SCISSOR_TEST,
+	GL_STENCIL_TEST,
+};
+#define NUM_CAPS (sizeof(shadowed_caps) / sizeof(*shadowed_caps))
+
+static struct {
+	GLenum active_texture;
+	GLuint tex_2d[MAX_TEXTURE_UNITS];
+	GLuint tex_cube[MAX_TEXTURE_UNITS];
+	GLuint program;
+	GLuint framebuffer;
+	GLint viewport[4];
+	uint32_t caps[NUM_CAPS];
+	GLenum blend_func[4];
+	GLenum blend_eq[2];
+	GLfloat blend_color[4];
+	uint8_t viewport_valid;
+	uint8_t blend_color_valid;
+} state;
+
+static int state_changed(void) {
+	// Pending 2D draws must hit the GPU with the state they were recorded with
+	batch2d_flush();
+	stats_cur.state_calls++;
+	return 1;
+}
+
+static int state_elided(void) {
+	stats_cur.state_calls++;
+	stats_cur.state_elided++;
+	return 0;
+}
+
+void gl_state_invalidate(void) {
+	memset(&state, 0xFF, sizeof(state));
+	state.viewport_valid = 0;
+	state.blend_color_valid = 0;
+}
+
+static GLuint *bound_texture(GLenum target) {
+	GLuint unit = state.active_texture - GL_TEXTURE0;
+	if (unit >= MAX_TEXTURE_UNITS)
+		return NULL;
+	if (target == GL_TEXTURE_2D)
+		return &state.tex_2d[unit];
+	if (target == GL_TEXTURE_CUBE_MAP)
+		return &state.tex_cube[unit];
+	return NULL;
+}
+
+int gl_state_bind_texture(GLenum target, GLuint texture) {
+	GLuint *bound = bound_texture(target);
+	if (bound) {
+		if (*bound == texture)
+			return state_elided();
+		*bound = texture;
+	}
+	state_changed();
+	glBindTexture(target, texture);
+	return 1;
+}
+
+GLuint gl_state_get_texture(GLenum target) {
+	GLuint *bound = bound_texture(target);
+	return bound ? *bound : UNKNOWN;
+}
+
+void gl_state_use_program(GLuint program) {
+	if (state.program == program) {
+		state_elided();
+		return;
+	}
+	state.program = program;
+	state_changed();
+	glUseProgram(program);
+}
+
+void gl_state_forget_program(GLuint program) {
+	if (state.program == program)
+		state.program = UNKNOWN;
+}
+
+void gl_state_bind_framebuffer(GLenum target, GLuint framebuffer) {
+	if (target == GL_FRAMEBUFFER && state.framebuffer == framebuffer) {
+		state_elided();
+		return;
+	}
+	state.framebuffer = target == GL_FRAMEBUFFER ? framebuffer : UNKNOWN;
+	state_changed();
+	glBindFramebuffer(target, framebuffer);
+}
+
+void gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	if (state.viewport_valid && state.viewport[0] == x && state.viewport[1] == y &&
+		state.viewport[2] == width && state.viewport[3] == height) {
+		state_elided();
+		return;
+	}
+	state.viewport[0] = x;
+	state.viewport[1] = y;
+	state.viewport[2] = width;
+	state.viewport[3] = height;
+	state.viewport_valid = 1;
+	state_changed();
+	glViewport(x, y, width, height);
+}
+
+static struct {
+	GLboolean caps[NUM_CAPS];
+	GLint active_texture;
+	GLint tex_2d;
+	GLint program;
+	GLint viewport[4];
+	GLint blend_func[4];
+	GLint blend_eq[2];
+} saved;
+
+void gl_state_push(void) {
+	batch2d_flush();
+	for (int i = 0; i < NUM_CAPS; i++)
+		saved.caps[i] = glIsEnabled(shadowed_caps[i]);
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &saved.active_texture);
+	glActiveTexture(GL_TEXTURE0);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &saved.tex_2d);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &saved.program);
+	glGetIntegerv(GL_VIEWPORT, saved.viewport);
+	glGetIntegerv(GL_BLEND_SRC_RGB, &saved.blend_func[0]);
+	glGetIntegerv(GL_BLEND_DST_RGB, &saved.blend_func[1]);
+	glGetIntegerv(GL_BLEND_SRC_ALPHA, &saved.blend_func[2]);
+	glGetIntegerv(GL_BLEND_DST_ALPHA, &saved.blend_func[3]);
+	glGetIntegerv(GL_BLEND_EQUATION_RGB, &saved.blend_eq[0]);
+	glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &saved.blend_eq[1]);
+}
+
+void gl_state_pop(void) {
+	for (int i = 0; i < NUM_CAPS; i++) {
+		if (saved.caps[i])
+			glEnable(shadowed_caps[i]);
+		else
+			glDisable(shadowed_caps[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, saved.tex_2d);
+	glActiveTexture(saved.active_texture);
+	glUseProgram(saved.program);
+	glViewport(saved.viewport[0], saved.viewport[1], saved.viewport[2], saved.viewport[3]);
+	glBlendFuncSeparate(saved.blend_func[0], saved.blend_func[1], saved.blend_func[2], saved.blend_func[3]);
+	glBlendEquationSeparate(saved.blend_eq[0], saved.blend_eq[1]);
+
+	// Whatever else the caller changed went straight to vitaGL
+	gl_state_invalidate();
+}
+
+void glActiveTexture_hook(GLenum texture) {
+	if (state.active_texture == texture) {
+		state_elided();
+		return;
+	}
+	state.active_texture = texture;
+	state_changed();
+	glActiveTexture(texture);
+}
+
+void glBindTexture_hook(GLenum target, GLuint texture) {
+	if (target == GL_TEXTURE_2D)
+		batch2d_clear_uv_remap();
+	gl_state_bind_texture(target, render_target_resolve(texture));
+}
+
+void glDeleteTextures_hook(GLsizei n, const GLuint *textures) {
+	for (int i = 0; i < n; i++) {
+		// Deleting a bound texture reverts the binding to 0, unless the render target pool keeps it alive
+		GLuint real = render_target_resolve(textures[i]);
+		int kept = render_target_delete_texture(textures[i]);
+		for (int j = 0; j < MAX_TEXTURE_UNITS; j++) {
+			if (state.tex_2d[j] == real)
+				state.tex_2d[j] = kept ? UNKNOWN : 0;
+			if (state.tex_cube[j] == real)
+				state.tex_cube[j] = kept ? UNKNOWN : 0;
+		}
+		if (!kept) {
+			async_load_forget_gl_texture(textures[i]);
+			glDeleteTextures(1, &textures[i]);
+		}
+	}
+}
+
+void glDeleteFramebuffers_hook(GLsizei n, const GLuint *framebuffers) {
+	render_target_delete_framebuffers(n, framebuffers);
+	for (int i = 0; i < n; i++) {
+		if (state.framebuffer == framebuffers[i])
+			state.framebuffer = 0;
+	}
+	glDeleteFramebuffers(n, framebuffers);
+}
+
+static int set_cap(GLenum cap, uint32_t enabled) {
+	for (int i = 0; i < NUM_CAPS; i++) {
+		if (shadowed_caps[i] == cap) {
+			if (state.caps[i] == enabled)
+				return state_elided();
+			state.caps[i] = enabled;
+			break;
+		}
+	}
+	return state_changed();
+}
+
+void glEnable_hook(GLenum cap) {
+	if (set_cap(cap, GL_TRUE))
+		glEnable(cap);
+}
+
+void glDisable_hook(GLenum cap) {
+	if (set_cap(cap, GL_FALSE))
+		glDisable(cap);
+}
+
+static int set_blend_func(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha) {
+	if (state.blend_func[0] == src_rgb && state.blend_func[1] == dst_rgb &&
+		state.blend_func[2] == src_alpha && state.blend_func[3] == dst_alpha)
+		return state_elided();
+	state.blend_func[0] = src_rgb;
+	state.blend_func[1] = dst_rgb;
+	state.blend_func[2] = src_alpha;
+	state.blend_func[3] = dst_alpha;
+	return state_changed();
+}
+
+void glBlendFunc_hook(GLenum sfactor, GLenum dfactor) {
+	if (set_blend_func(sfactor, dfactor, sfactor, dfactor))
+		glBlendFunc(sfactor, dfactor);
+}
+
+void glBlendFuncSeparate_hook(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha) {
+	if (set_blend_func(src_rgb, dst_rgb, src_alpha, dst_alpha))
+		glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha);
+}
+
+static int set_blend_equation(GLenum mode_rgb, GLenum mode_alpha) {
+	if (state.blend_eq[0] == mode_rgb && state.blend_eq[1] == mode_alpha)
+		return state_elided();
+	state.blend_eq[0] = mode_rgb;
+	state.blend_eq[1] = mode_alpha;
+	return state_changed();
+}
+
+void glBlendEquation_hook(GLenum mode) {
+	if (set_blend_equation(mode, mode))
+		glBlendEquation(mode);
+}
+
+void glBlendEquationSeparate_hook(GLenum mode_rgb, GLenum mode_alpha) {
+	if (set_blend_equation(mode_rgb, mode_alpha))
+		glBlendEquationSeparate(mode_rgb, mode_alpha);
+}
+
+void glBlendColor_hook(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+	if (state.blend_color_valid && state.blend_color[0] == red && state.blend_color[1] == green &&
+		state.blend_color[2] == blue && state.blend_color[3] == alpha) {
+		state_elided();
+		return;
+	}
+	state.blend_color[0] = red;
+	state.blend_color[1] = green;
+	state.blend_color[2] = blue;
+	state.blend_color[3] = alpha;
+	state.blend_color_valid = 1;
+	state_changed();
+	glBlendColor(red, green, blue, alpha);
+}
@@ -0,0 +1,32 @@
+#ifndef __GL_STATE_H__
+#define __GL_STATE_H__
+
+#include <vitaGL.h>
+
+#define GL_STATE_UNKNOWN 0xFFFFFFFF
+
+void gl_state_invalidate(void);
+GLuint gl_state_get_texture(GLenum target); // GL_STATE_UNKNOWN if not tracked
+int gl_state_bind_texture(GLenum target, GLuint texture); // Returns 0 if elided
+void gl_state_use_program(GLuint program);
+void gl_state_forget_program(GLuint program);
+void gl_state_bind_framebuffer(GLenum target, GLuint framebuffer);
+void gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+// Saves/restores caps, blending, program, unit 0 texture and viewport around direct vitaGL calls
+void gl_state_push(void);
+void gl_state_pop(void);
+
+void glActiveTexture_hook(GLenum texture);
+void glBindTexture_hook(GLenum target, GLuint texture);
+void glDeleteTextures_hook(GLsizei n, const GLuint *textures);
+void glDeleteFramebuffers_hook(GLsizei n, const GLuint *framebuffers);
+void glEnable_hook(GLenum cap);
+void glDisable_hook(GLenum cap);
+void glBlendFunc_hook(GLenum sfactor, GLenum dfactor);
+void glBlendFuncSeparate_hook(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha);
+void glBlendEquation_hook(GLenum mode);
+void glBlendEquationSeparate_hook(GLenum mode_rgb, GLenum mode_alpha);
+void glBlendColor_hook(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+
+#endif
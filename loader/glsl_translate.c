@@ -0,0 +1,526 @@
+/* glsl_translate.c -- GLSL ES 3.00 to GLSL ES 1.00 source translator
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * No platform dependencies on purpose, tools/shader_manifest.c links it
+ * to check translations of the game's shaders on a host.
+ *
+ * GLSL ES 1.00 varyings can only be floats, so flat int varyings are carried
+ * as highp floats: the vertex shader writes a private int copy, stored to the
+ * varying by a main() wrapping the shader's own, and the fragment shader reads
+ * the varying rounded back to an int.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sha1.h"
+#include "glsl_translate.h"
+
+#define MAX_CUBE_SAMPLERS 16
+#define MAX_INT_VARYINGS 16
+
+typedef struct {
+	char *buf;
+	size_t len;
+	size_t size;
+} strbuf;
+
+typedef struct {
+	char name[32];
+	int location;
+} frag_output;
+
+typedef struct {
+	char name[32];
+	int comps; // 1 for int, 2-4 for ivecN
+} int_varying;
+
+typedef struct {
+	const char *p;
+	int vertex;
+	int brace_depth;
+	int paren_depth;
+	int line_start;
+	int pending_location; // Location from a layout qualifier for the next declaration (-1 = none)
+	int pending_attrib; // Current declaration is a vertex input with a layout location
+	char last_ident[32]; // Last identifier in the current global declaration
+	int num_outputs;
+	frag_output outputs[GLSL_MAX_OUTPUTS];
+	int num_cubes;
+	char cubes[MAX_CUBE_SAMPLERS][32];
+	int cube_next; // Next identifier is the name of a samplerCube
+	int varying_decl; // Current declaration is a varying
+	int decl_precision; // Current declaration has a precision qualifier
+	int decl_int_comps; // Int type of the current varying declaration, 0 if not an int
+	int decl_first_int; // First int varying of the current declaration
+	int num_ints;
+	int_varying ints[MAX_INT_VARYINGS];
+	strbuf out;
+	glsl_translation *res;
+} translator;
+
+static glsl_translation **memo = NULL;
+static int memo_num = 0, memo_size = 0;
+
+static void sb_append(strbuf *sb, const char *s, size_t n) {
+	if (sb->len + n + 1 > sb->size) {
+		sb->size = (sb->len + n + 1) * 2;
+		sb->buf = (char *)realloc(sb->buf, sb->size);
+	}
+	memcpy(sb->buf + sb->len, s, n);
+	sb->len += n;
+	sb->buf[sb->len] = 0;
+}
+
+static void sb_puts(strbuf *sb, const char *s) {
+	sb_append(sb, s, strlen(s));
+}
+
+static void copy_name(char *dst, const char *src, size_t n) {
+	if (n > 31)
+		n = 31;
+	memcpy(dst, src, n);
+	dst[n] = 0;
+}
+
+static const char *skip_spaces(const char *p) {
+	while (*p && isspace((unsigned char)*p))
+		p++;
+	return p;
+}
+
+static int is_ident(const char *s, size_t n, const char *word) {
+	return strlen(word) == n && !strncmp(s, word, n);
+}
+
+static int is_cube_sampler(translator *t, const char *s, size_t n) {
+	for (int i = 0; i < t->num_cubes; i++) {
+		if (is_ident(s, n, t->cubes[i]))
+			return 1;
+	}
+	return 0;
+}
+
+static int_varying *find_int_varying(translator *t, const char *s, size_t n) {
+	for (int i = 0; i < t->num_ints; i++) {
+		if (is_ident(s, n, t->ints[i].name))
+			return &t->ints[i];
+	}
+	return NULL;
+}
+
+// Components of an int or ivecN type name, 0 for anything else
+static int int_type_comps(const char *s, size_t n) {
+	if (is_ident(s, n, "int"))
+		return 1;
+	if (n == 5 && !strncmp(s, "ivec", 4) && s[4] >= '2' && s[4] <= '4')
+		return s[4] - '0';
+	return 0;
+}
+
+static void put_vec_type(strbuf *sb, const char *base, int comps) {
+	char type[8];
+	if (comps == 1)
+		snprintf(type, sizeof(type), "%s", base[0] == 'i' ? "int" : "float");
+	else
+		snprintf(type, sizeof(type), "%s%d", base, comps);
+	sb_puts(sb, type);
+}
+
+// Member accesses (a.name) don't refer to a global name
+static int after_dot(translator *t) {
+	size_t i = t->out.len;
+	while (i && isspace((unsigned char)t->out.buf[i - 1]))
+		i--;
+	return i && t->out.buf[i - 1] == '.';
+}
+
+static frag_output *find_output(translator *t, const char *s, size_t n) {
+	for (int i = 0; i < t->num_outputs; i++) {
+		if (is_ident(s, n, t->outputs[i].name))
+			return &t->outputs[i];
+	}
+	return NULL;
+}
+
+// Sampler passed as first argument of a texture lookup starting at p (pointing to '(')
+static int lookup_is_cube(translator *t, const char *p) {
+	p = skip_spaces(p + 1);
+	const char *s = p;
+	while (isalnum((unsigned char)*p) || *p == '_')
+		p++;
+	return is_cube_sampler(t, s, p - s);
+}
+
+static void parse_layout(translator *t) {
+	const char *p = skip_spaces(t->p);
+	if (*p != '(')
+		return;
+	const char *end = strchr(p, ')');
+	if (!end)
+		return;
+	const char *loc = strstr(p, "location");
+	if (loc && loc < end) {
+		loc = skip_spaces(loc + 8);
+		if (*loc == '=')
+			t->pending_location = atoi(skip_spaces(loc + 1));
+	}
+	t->p = end + 1;
+}
+
+// Drops a fragment output declaration, remembering its name to remap it to gl_FragColor/gl_FragData
+static void parse_frag_output(translator *t) {
+	const char *p = t->p;
+	const char *name = NULL;
+	size_t name_len = 0;
+	while (*p && *p != ';') {
+		if (isalpha((unsigned char)*p) || *p == '_') {
+			name = p;
+			while (isalnum((unsigned char)*p) || *p == '_')
+				p++;
+			name_len = p - name;
+		} else {
+			p++;
+		}
+	}
+	if (*p == ';')
+		p++;
+	t->p = p;
+
+	if (name && t->num_outputs < GLSL_MAX_OUTPUTS) {
+		frag_output *o = &t->outputs[t->num_outputs++];
+		copy_name(o->name, name, name_len);
+		o->location = t->pending_location < 0 ? 0 : t->pending_location;
+	}
+	t->pending_location = -1;
+}
+
+static void end_declaration(translator *t) {
+	if (t->vertex) {
+		// Private copies the shader writes in place of its int varyings
+		for (int i = t->decl_first_int; i < t->num_ints; i++) {
+			sb_puts(&t->out, " ");
+			put_vec_type(&t->out, "ivec", t->ints[i].comps);
+			sb_puts(&t->out, " flat_");
+			sb_puts(&t->out, t->ints[i].name);
+			sb_puts(&t->out, ";");
+		}
+	}
+	t->varying_decl = 0;
+	t->decl_precision = 0;
+	t->decl_int_comps = 0;
+	t->decl_first_int = t->num_ints;
+	if (t->pending_attrib && t->last_ident[0] && t->res->num_attribs < GLSL_MAX_ATTRIBS) {
+		glsl_attrib_location *a = &t->res->attribs[t->res->num_attribs++];
+		strcpy(a->name, t->last_ident);
+		a->location = t->pending_location;
+	}
+	t->pending_attrib = 0;
+	t->pending_location = -1;
+	t->last_ident[0] = 0;
+}
+
+static void handle_ident(translator *t, const char *s, size_t n) {
+	int global = t->brace_depth == 0 && t->paren_depth == 0;
+
+	if (global) {
+		if (is_ident(s, n, "layout")) {
+			parse_layout(t);
+			return;
+		}
+		if (is_ident(s, n, "in")) {
+			if (t->vertex) {
+				sb_puts(&t->out, "attribute");
+				t->pending_attrib = t->pending_location >= 0;
+			} else {
+				sb_puts(&t->out, "varying");
+				t->varying_decl = 1;
+			}
+			return;
+		}
+		if (is_ident(s, n, "out")) {
+			if (t->vertex) {
+				sb_puts(&t->out, "varying");
+				t->varying_decl = 1;
+			} else {
+				parse_frag_output(t);
+			}
+			return;
+		}
+		if (t->varying_decl) {
+			if (is_ident(s, n, "lowp") || is_ident(s, n, "mediump") || is_ident(s, n, "highp"))
+				t->decl_precision = 1;
+			int comps = int_type_comps(s, n);
+			if (comps) {
+				// Integers above 1024 don't survive mediump
+				if (!t->decl_precision)
+					sb_puts(&t->out, "highp ");
+				put_vec_type(&t->out, "vec", comps);
+				t->decl_int_comps = comps;
+				return;
+			}
+			if (t->decl_int_comps) {
+				if (*skip_spaces(t->p) == '[' || t->num_ints == MAX_INT_VARYINGS) {
+					t->res->unsupported++;
+				} else {
+					int_varying *v = &t->ints[t->num_ints++];
+					copy_name(v->name, s, n);
+					v->comps = t->decl_int_comps;
+				}
+			}
+		}
+		if (t->vertex && t->num_ints && is_ident(s, n, "main")) {
+			sb_puts(&t->out, "flat_main");
+			return;
+		}
+		if (is_ident(s, n, "flat") || is_ident(s, n, "smooth") || is_ident(s, n, "centroid")) {
+			t->p = skip_spaces(t->p);
+			return;
+		}
+		if (is_ident(s, n, "samplerCube")) {
+			t->cube_next = 1;
+		} else if (t->cube_next) {
+			if (t->num_cubes < MAX_CUBE_SAMPLERS)
+				copy_name(t->cubes[t->num_cubes++], s, n);
+			t->cube_next = 0;
+		}
+		if (is_ident(s, n, "uniform")) {
+			// Uniform blocks are GLSL ES 3.00 only
+			const char *p = skip_spaces(t->p);
+			while (isalnum((unsigned char)*p) || *p == '_')
+				p++;
+			if (*skip_spaces(p) == '{')
+				t->res->unsupported++;
+		}
+		copy_name(t->last_ident, s, n);
+	}
+
+	if (!global && !after_dot(t)) {
+		int_varying *v = find_int_varying(t, s, n);
+		if (v) {
+			if (t->vertex) {
+				sb_puts(&t->out, "flat_");
+				sb_append(&t->out, s, n);
+			} else {
+				put_vec_type(&t->out, "ivec", v->comps);
+				sb_puts(&t->out, "(floor(");
+				sb_append(&t->out, s, n);
+				sb_puts(&t->out, " + 0.5))");
+			}
+			return;
+		}
+	}
+
+	if (*skip_spaces(t->p) == '(') {
+		int cube = lookup_is_cube(t, skip_spaces(t->p));
+		if (is_ident(s, n, "texture")) {
+			sb_puts(&t->out, cube ? "textureCube" : "texture2D");
+			return;
+		}
+		if (is_ident(s, n, "textureLod")) {
+			sb_puts(&t->out, cube ? "textureCubeLod" : "texture2DLod");
+			return;
+		}
+		if (is_ident(s, n, "textureProj")) {
+			sb_puts(&t->out, "texture2DProj");
+			return;
+		}
+		if (is_ident(s, n, "texelFetch") || is_ident(s, n, "textureSize") || is_ident(s, n, "textureGrad"))
+			t->res->unsupported++;
+	}
+
+	if (!t->vertex) {
+		frag_output *o = find_output(t, s, n);
+		if (o) {
+			if (t->num_outputs == 1 && o->location == 0) {
+				sb_puts(&t->out, "gl_FragColor");
+			} else {
+				char data[32];
+				snprintf(data, sizeof(data), "gl_FragData[%d]", o->location);
+				sb_puts(&t->out, data);
+			}
+			return;
+		}
+	}
+
+	if (is_ident(s, n, "uint") || (n == 5 && !strncmp(s, "uvec", 4)))
+		t->res->unsupported++;
+
+	sb_append(&t->out, s, n);
+}
+
+static void translate(translator *t) {
+	while (*t->p) {
+		const char *p = t->p;
+
+		if (*p == '#' && t->line_start) {
+			const char *end = strchr(p, '\n');
+			if (!end)
+				end = p + strlen(p);
+			const char *d = skip_spaces(p + 1);
+			if (!strncmp(d, "version", 7)) {
+				// Keep line numbers in compiler errors matching the original source
+			} else {
+				sb_append(&t->out, p, end - p);
+			}
+			t->p = end;
+			continue;
+		}
+
+		if (p[0] == '/' && p[1] == '/') {
+			const char *end = strchr(p, '\n');
+			if (!end)
+				end = p + strlen(p);
+			sb_append(&t->out, p, end - p);
+			t->p = end;
+			continue;
+		}
+
+		if (p[0] == '/' && p[1] == '*') {
+			const char *end = strstr(p + 2, "*/");
+			end = end ? end + 2 : p + strlen(p);
+			sb_append(&t->out, p, end - p);
+			t->p = end;
+			continue;
+		}
+
+		if (isalpha((unsigned char)*p) || *p == '_') {
+			const char *s = p;
+			while (isalnum((unsigned char)*p) || *p == '_')
+				p++;
+			t->p = p;
+			t->line_start = 0;
+			handle_ident(t, s, p - s);
+			continue;
+		}
+
+		switch (*p) {
+		case '\n':
+			t->line_start = 1;
+			break;
+		case '{':
+			t->brace_depth++;
+			break;
+		case '}':
+			t->brace_depth--;
+			break;
+		case '(':
+			t->paren_depth++;
+			break;
+		case ')':
+			t->paren_depth--;
+			break;
+		case ';':
+			if (t->brace_depth == 0 && t->paren_depth == 0) {
+				sb_append(&t->out, p, 1);
+				t->p = p + 1;
+				end_declaration(t);
+				continue;
+			}
+			break;
+		default:
+			break;
+		}
+		if (!isspace((unsigned char)*p))
+			t->line_start = 0;
+		sb_append(&t->out, p, 1);
+		t->p = p + 1;
+	}
+}
+
+static int is_glsl_300(const char *src) {
+	const char *p = skip_spaces(src);
+	while (*p == '/' && (p[1] == '/' || p[1] == '*')) {
+		p = p[1] == '/' ? strchr(p, '\n') : strstr(p + 2, "*/");
+		if (!p)
+			return 0;
+		p = skip_spaces(p + (*p == '*' ? 2 : 1));
+	}
+	if (*p != '#')
+		return 0;
+	p = skip_spaces(p + 1);
+	if (strncmp(p, "version", 7))
+		return 0;
+	return atoi(skip_spaces(p + 7)) == 300;
+}
+
+const glsl_translation *glsl_translate(int count, const char **string, const int *length, int vertex) {
+	// As glShaderSource, a negative length means a NUL terminated string
+	int copied = count != 1 || (length && length[0] >= 0);
+	char *src;
+	if (!copied) {
+		src = (char *)string[0];
+	} else {
+		strbuf sb = {0};
+		for (int i = 0; i < count; i++) {
+			if (length && length[i] >= 0)
+				sb_append(&sb, string[i], length[i]);
+			else
+				sb_puts(&sb, string[i]);
+		}
+		src = sb.buf;
+	}
+
+	if (!src || !is_glsl_300(src)) {
+		if (copied)
+			free(src);
+		return NULL;
+	}
+
+	unsigned int hash[5];
+	SHA1_CTX ctx;
+	sha1_init(&ctx);
+	sha1_update(&ctx, (const BYTE *)src, strlen(src));
+	sha1_final(&ctx, (BYTE *)hash);
+
+	for (int i = 0; i < memo_num; i++) {
+		if (memo[i]->vertex == vertex && !memcmp(memo[i]->hash, hash, sizeof(hash))) {
+			if (copied)
+				free(src);
+			return memo[i];
+		}
+	}
+
+	glsl_translation *res = (glsl_translation *)calloc(1, sizeof(glsl_translation));
+	memcpy(res->hash, hash, sizeof(hash));
+	res->vertex = vertex;
+
+	translator t;
+	memset(&t, 0, sizeof(t));
+	t.p = src;
+	t.vertex = vertex;
+	t.line_start = 1;
+	t.pending_location = -1;
+	t.res = res;
+	translate(&t);
+	if (t.vertex && t.num_ints) {
+		sb_puts(&t.out, "\nvoid main() {\n\tflat_main();\n");
+		for (int i = 0; i < t.num_ints; i++) {
+			sb_puts(&t.out, "\t");
+			sb_puts(&t.out, t.ints[i].name);
+			sb_puts(&t.out, " = ");
+			put_vec_type(&t.out, "vec", t.ints[i].comps);
+			sb_puts(&t.out, "(flat_");
+			sb_puts(&t.out, t.ints[i].name);
+			sb_puts(&t.out, ");\n");
+		}
+		sb_puts(&t.out, "}\n");
+	}
+	res->src = t.out.buf ? t.out.buf : strdup("");
+
+	if (copied)
+		free(src);
+
+	if (memo_num == memo_size) {
+		memo_size = memo_size ? memo_size * 2 : 32;
+		memo = (glsl_translation **)realloc(memo, memo_size * sizeof(*memo));
+	}
+	memo[memo_num++] = res;
+	return res;
+}
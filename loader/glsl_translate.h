@@ -0,0 +1,24 @@
+#ifndef __GLSL_TRANSLATE_H__
+#define __GLSL_TRANSLATE_H__
+
+#define GLSL_MAX_ATTRIBS 16
+#define GLSL_MAX_OUTPUTS 4
+
+typedef struct {
+	char name[32];
+	int location;
+} glsl_attrib_location;
+
+typedef struct {
+	unsigned int hash[5]; // SHA1 of the GLSL ES 3.00 input
+	int vertex;
+	char *src; // GLSL ES 1.00 output
+	int num_attribs; // Attribute locations declared through layout qualifiers
+	glsl_attrib_location attribs[GLSL_MAX_ATTRIBS];
+	int unsupported; // Number of constructs with no GLSL ES 1.00 equivalent left as is
+} glsl_translation;
+
+// Returns NULL if the source is not GLSL ES 3.00, else a memoized translation
+const glsl_translation *glsl_translate(int count, const char **string, const int *length, int vertex);
+
+#endif
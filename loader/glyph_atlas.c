@@ -0,0 +1,494 @@
+/* glyph_atlas.c -- SDL_ttf strings drawn as runs of atlased glyphs
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * TTF_RenderUTF8_Blended gives back a blank surface of the right size for
+ * unstyled, non outlined fonts, and remembers the string instead of having
+ * FreeType rasterize it. SDL_CreateTextureFromSurface then makes a glyph run
+ * handle out of it: each (font, hinting, glyph) is rasterized once, packed in
+ * the atlas.c pages, and SDL_RenderCopy of the run draws one quad per glyph,
+ * laid out by glyph_layout.c, colored through the sprite color mod. Any other
+ * use of the surface pixels (locks, blits, conversions, glTexImage2D) has the
+ * string rasterized into it first, and a run bound or updated as a texture
+ * turns into a real one. textatlas=off in settings.txt disables it.
+ */
+
+#include <vitasdk.h>
+#include <vitaGL.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atlas.h"
+#include "batch2d.h"
+#include "gl_state.h"
+#include "glyph_atlas.h"
+#include "glyph_layout.h"
+#include "settings.h"
+#include "ttf_cache.h"
+
+#define MAX_DEFERRED 512
+#define MAX_GLYPHS 2048
+#define MAX_RUNS 1024
+#define MAX_RUN_GLYPHS 256
+#define HASH_BITS 9
+
+typedef struct {
+	SDL_Surface *surface;
+	TTF_Font *font;
+	int hinting;
+	SDL_Color fg;
+	char *text;
+	int glyphs_num;
+	glyph_pos *glyphs;
+} deferred_text;
+
+typedef struct {
+	TTF_Font *font; // NULL once closed, the entry is free when refs drops to 0 too
+	int hinting;
+	uint16_t ch;
+	int16_t next; // In the same bucket, -1 terminated
+	SDL_Texture *sprite; // NULL for blank glyphs
+	int w, h;
+	int refs; // Runs drawing it
+} glyph_entry;
+
+typedef struct {
+	glyph_entry *glyph;
+	int x;
+} run_quad;
+
+typedef struct {
+	uint8_t in_use;
+	uint8_t color_mod[3];
+	SDL_BlendMode blend_mode;
+	int w, h;
+	SDL_Color fg;
+	int quads_num;
+	run_quad *quads;
+	SDL_Renderer *renderer;
+	TTF_Font *font; // NULL once closed
+	char *text;
+	SDL_Texture *real; // Made once the game needs it as a texture of its own
+} glyph_run;
+
+static glyph_funcs funcs;
+static int (*size_utf8)(TTF_Font *font, const char *text, int *w, int *h);
+
+static deferred_text deferred[MAX_DEFERRED];
+static int deferred_num = 0;
+static glyph_entry glyphs[MAX_GLYPHS];
+static int16_t buckets[1 << HASH_BITS];
+static glyph_run runs[MAX_RUNS];
+
+static glyph_run *get_run(SDL_Texture *texture) {
+	glyph_run *r = (glyph_run *)texture;
+	if (r < runs || r >= runs + MAX_RUNS)
+		return NULL;
+	return r;
+}
+
+static deferred_text *find_deferred(SDL_Surface *surface, const void *pixels) {
+	for (int i = 0; i < MAX_DEFERRED && deferred_num; i++) {
+		deferred_text *d = &deferred[i];
+		if (d->surface && (d->surface == surface || (pixels && d->surface->pixels == pixels)))
+			return d;
+	}
+	return NULL;
+}
+
+static void drop_deferred(deferred_text *d) {
+	free(d->text);
+	free(d->glyphs);
+	memset(d, 0, sizeof(deferred_text));
+	deferred_num--;
+}
+
+static void rasterize(deferred_text *d) {
+	SDL_Surface *s = ttf_cache_render_uncached(d->font, d->text, d->fg);
+	if (s) {
+		SDL_Surface *dst = d->surface;
+		int w = s->w < dst->w ? s->w : dst->w;
+		int h = s->h < dst->h ? s->h : dst->h;
+		for (int y = 0; y < h; y++)
+			memcpy((uint8_t *)dst->pixels + y * dst->pitch, (uint8_t *)s->pixels + y * s->pitch, w * 4);
+		SDL_FreeSurface(s);
+	}
+	drop_deferred(d);
+}
+
+void glyph_atlas_patch(struct so_module *mod) {
+	memset(buckets, 0xFF, sizeof(buckets));
+	funcs.glyph_metrics = (void *)so_symbol(mod, "TTF_GlyphMetrics");
+	funcs.get_font_kerning = (void *)so_symbol(mod, "TTF_GetFontKerning");
+	funcs.kerning_size_glyphs = (void *)so_symbol(mod, "TTF_GetFontKerningSizeGlyphs");
+	size_utf8 = (void *)so_symbol(mod, "TTF_SizeUTF8"); // Hooked, so served by ttf_cache.c
+	if (text_atlas && !(funcs.glyph_metrics && funcs.get_font_kerning && funcs.kerning_size_glyphs && size_utf8)) {
+		printf("[GlyphAtlas] SDL_ttf entry points missing, strings are rasterized whole\n");
+		text_atlas = 0;
+	}
+}
+
+SDL_Surface *glyph_atlas_render(TTF_Font *font, int style, int outline, int hinting, const char *text, SDL_Color fg) {
+	if (!text_atlas || style != TTF_STYLE_NORMAL || outline || deferred_num == MAX_DEFERRED)
+		return NULL;
+
+	glyph_pos pos[MAX_RUN_GLYPHS];
+	int n = glyph_layout(&funcs, font, text, pos, MAX_RUN_GLYPHS);
+	int w, h; // Height can exceed the font's own when a glyph reaches above its ascent
+	if (n <= 0 || size_utf8(font, text, &w, &h) < 0 || w <= 0 || h <= 0)
+		return NULL;
+
+	deferred_text *d = NULL;
+	for (int i = 0; i < MAX_DEFERRED; i++) {
+		if (!deferred[i].surface) {
+			d = &deferred[i];
+			break;
+		}
+	}
+	// Same format SDL_ttf picks, pixels start out zeroed
+	SDL_Surface *s = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+	d->text = strdup(text);
+	d->glyphs = (glyph_pos *)malloc(n * sizeof(glyph_pos));
+	if (!s || !d->text || !d->glyphs) {
+		free(d->text);
+		free(d->glyphs);
+		d->text = NULL;
+		d->glyphs = NULL;
+		SDL_FreeSurface(s);
+		return NULL;
+	}
+	memcpy(d->glyphs, pos, n * sizeof(glyph_pos));
+	d->glyphs_num = n;
+	d->surface = s;
+	d->font = font;
+	d->hinting = hinting;
+	d->fg = fg;
+	deferred_num++;
+	return s;
+}
+
+static uint32_t glyph_hash(TTF_Font *font, int hinting, uint16_t ch) {
+	return (((uintptr_t)font >> 4) * 31 + hinting * 7 + ch * 0x9E3779B1) & ((1 << HASH_BITS) - 1);
+}
+
+static void unlink_glyph(glyph_entry *g) {
+	int16_t *link = &buckets[glyph_hash(g->font, g->hinting, g->ch)];
+	while (*link != g - glyphs)
+		link = &glyphs[*link].next;
+	*link = g->next;
+}
+
+static void free_glyph(glyph_entry *g) {
+	if (g->sprite)
+		atlas_destroy_texture(g->sprite);
+	memset(g, 0, sizeof(glyph_entry));
+}
+
+static glyph_entry *get_glyph(SDL_Renderer *renderer, TTF_Font *font, int hinting, uint16_t ch) {
+	uint32_t hash = glyph_hash(font, hinting, ch);
+	for (int i = buckets[hash]; i >= 0; i = glyphs[i].next) {
+		glyph_entry *g = &glyphs[i];
+		if (g->font == font && g->hinting == hinting && g->ch == ch)
+			return g;
+	}
+
+	glyph_entry *g = NULL;
+	for (int i = 0; i < MAX_GLYPHS; i++) {
+		if (!glyphs[i].font && !glyphs[i].refs) {
+			g = &glyphs[i];
+			break;
+		}
+	}
+	if (!g)
+		return NULL;
+
+	// The glyph alone, in white, so that the sprite color mod gives it the string color
+	char utf8[4];
+	SDL_Color white = {255, 255, 255, 255};
+	glyph_utf8(ch, utf8);
+	SDL_Surface *s = ttf_cache_render_uncached(font, utf8, white);
+	if (!s)
+		return NULL;
+
+	SDL_Texture *sprite = NULL;
+	int blank = 1;
+	for (int y = 0; y < s->h && blank; y++) {
+		const uint32_t *p = (const uint32_t *)((uint8_t *)s->pixels + y * s->pitch);
+		for (int x = 0; x < s->w; x++) {
+			if (p[x] >> 24) {
+				blank = 0;
+				break;
+			}
+		}
+	}
+	if (!blank) {
+		sprite = atlas_create_texture(renderer, s);
+		if (!sprite) {
+			SDL_FreeSurface(s);
+			return NULL;
+		}
+	}
+
+	g->font = font;
+	g->hinting = hinting;
+	g->ch = ch;
+	g->sprite = sprite;
+	g->w = s->w;
+	g->h = s->h;
+	g->refs = 0;
+	g->next = buckets[hash];
+	buckets[hash] = g - glyphs;
+	SDL_FreeSurface(s);
+	return g;
+}
+
+static void release_run(glyph_run *r) {
+	for (int i = 0; i < r->quads_num; i++) {
+		glyph_entry *g = r->quads[i].glyph;
+		// Glyphs of a closed font only live as long as the runs drawing them
+		if (--g->refs == 0 && !g->font)
+			free_glyph(g);
+	}
+	free(r->quads);
+	free(r->text);
+	memset(r, 0, sizeof(glyph_run));
+}
+
+SDL_Texture *glyph_atlas_create_texture(SDL_Renderer *renderer, SDL_Surface *surface) {
+	deferred_text *d = find_deferred(surface, NULL);
+	if (!d)
+		return NULL;
+
+	glyph_run *r = NULL;
+	for (int i = 0; i < MAX_RUNS; i++) {
+		if (!runs[i].in_use) {
+			r = &runs[i];
+			break;
+		}
+	}
+	Uint8 alpha;
+	SDL_GetSurfaceAlphaMod(surface, &alpha);
+	if (!r || alpha != 255) {
+		rasterize(d);
+		return NULL;
+	}
+
+	memset(r, 0, sizeof(glyph_run));
+	r->in_use = 1;
+	r->quads = (run_quad *)malloc(d->glyphs_num * sizeof(run_quad));
+	r->text = strdup(d->text);
+	for (int i = 0; r->quads && i < d->glyphs_num; i++) {
+		glyph_entry *g = get_glyph(renderer, d->font, d->hinting, d->glyphs[i].ch);
+		if (!g)
+			break;
+		g->refs++;
+		r->quads[r->quads_num].glyph = g;
+		r->quads[r->quads_num].x = d->glyphs[i].x;
+		r->quads_num++;
+	}
+	if (!r->text || r->quads_num != d->glyphs_num) {
+		// Glyph too big for the atlas, or no room left
+		release_run(r);
+		rasterize(d);
+		return NULL;
+	}
+
+	r->w = surface->w;
+	r->h = surface->h;
+	r->fg = d->fg;
+	r->renderer = renderer;
+	r->font = d->font;
+	SDL_GetSurfaceColorMod(surface, &r->color_mod[0], &r->color_mod[1], &r->color_mod[2]);
+	SDL_GetSurfaceBlendMode(surface, &r->blend_mode);
+	return (SDL_Texture *)r;
+}
+
+int glyph_atlas_is_run(SDL_Texture *texture) {
+	return get_run(texture) != NULL;
+}
+
+SDL_Texture *glyph_atlas_real_texture(SDL_Texture *texture) {
+	glyph_run *r = get_run(texture);
+	if (!r->real) {
+		if (!r->font) {
+			SDL_SetError("Font of the text texture was closed");
+			return NULL;
+		}
+		SDL_Surface *s = ttf_cache_render_uncached(r->font, r->text, r->fg);
+		if (!s)
+			return NULL;
+		batch2d_flush();
+		r->real = SDL_CreateTextureFromSurface(r->renderer, s);
+		if (r->real) {
+			SDL_SetTextureColorMod(r->real, r->color_mod[0], r->color_mod[1], r->color_mod[2]);
+			SDL_SetTextureBlendMode(r->real, r->blend_mode);
+		}
+		gl_state_invalidate();
+		SDL_FreeSurface(s);
+	}
+	return r->real;
+}
+
+void glyph_atlas_destroy_texture(SDL_Texture *texture) {
+	glyph_run *r = get_run(texture);
+	if (r->real) {
+		batch2d_flush();
+		SDL_DestroyTexture(r->real);
+		gl_state_invalidate();
+	}
+	release_run(r);
+}
+
+int glyph_atlas_render_copy(SDL_Renderer *renderer, SDL_Texture *texture, const SDL_Rect *srcrect, const SDL_Rect *dstrect) {
+	glyph_run *r = get_run(texture);
+	if (r->real)
+		return atlas_render_copy(renderer, r->real, srcrect, dstrect);
+
+	SDL_Rect src = {0, 0, r->w, r->h}, dst;
+	if (srcrect && !SDL_IntersectRect(srcrect, &src, &src))
+		return 0;
+	if (dstrect) {
+		dst = *dstrect;
+	} else {
+		SDL_RenderGetViewport(renderer, &dst);
+		dst.x = dst.y = 0;
+	}
+	float sx = (float)dst.w / src.w, sy = (float)dst.h / src.h;
+	Uint8 c[3];
+	for (int i = 0; i < 3; i++)
+		c[i] = (&r->fg.r)[i] * r->color_mod[i] / 255;
+
+	int res = 0;
+	for (int i = 0; i < r->quads_num && !res; i++) {
+		glyph_entry *g = r->quads[i].glyph;
+		SDL_Rect gr = {r->quads[i].x, 0, g->w, g->h}, in;
+		if (!g->sprite || !SDL_IntersectRect(&gr, &src, &in))
+			continue;
+		// Both edges rounded on their own, so that neighbouring glyphs never leave a gap
+		SDL_Rect gsrc = {in.x - gr.x, in.y, in.w, in.h};
+		int x0 = lroundf((in.x - src.x) * sx), x1 = lroundf((in.x + in.w - src.x) * sx);
+		int y0 = lroundf((in.y - src.y) * sy), y1 = lroundf((in.y + in.h - src.y) * sy);
+		SDL_Rect gdst = {dst.x + x0, dst.y + y0, x1 - x0, y1 - y0};
+		SDL_SetTextureColorMod_hook(g->sprite, c[0], c[1], c[2]);
+		SDL_SetTextureBlendMode_hook(g->sprite, r->blend_mode);
+		res = atlas_render_copy(renderer, g->sprite, &gsrc, &gdst);
+	}
+	return res;
+}
+
+int glyph_atlas_query_texture(SDL_Texture *texture, Uint32 *format, int *access, int *w, int *h) {
+	glyph_run *r = get_run(texture);
+	if (format)
+		*format = SDL_PIXELFORMAT_ARGB8888;
+	if (access)
+		*access = SDL_TEXTUREACCESS_STATIC;
+	if (w)
+		*w = r->w;
+	if (h)
+		*h = r->h;
+	return 0;
+}
+
+int glyph_atlas_color_mod(SDL_Texture *texture, int set, Uint8 *rgb) {
+	glyph_run *r = get_run(texture);
+	for (int i = 0; i < 3; i++) {
+		if (set)
+			r->color_mod[i] = rgb[i];
+		else
+			rgb[i] = r->color_mod[i];
+	}
+	if (set && r->real)
+		SDL_SetTextureColorMod(r->real, rgb[0], rgb[1], rgb[2]);
+	return 0;
+}
+
+int glyph_atlas_blend_mode(SDL_Texture *texture, int set, SDL_BlendMode *mode) {
+	glyph_run *r = get_run(texture);
+	if (set)
+		r->blend_mode = *mode;
+	else
+		*mode = r->blend_mode;
+	if (set && r->real)
+		SDL_SetTextureBlendMode(r->real, *mode);
+	return 0;
+}
+
+void glyph_atlas_forget_font(TTF_Font *font) {
+	for (int i = 0; i < MAX_DEFERRED && deferred_num; i++) {
+		if (deferred[i].surface && deferred[i].font == font)
+			rasterize(&deferred[i]);
+	}
+	for (int i = 0; i < MAX_RUNS; i++) {
+		if (runs[i].in_use && runs[i].font == font)
+			runs[i].font = NULL;
+	}
+	for (int i = 0; i < MAX_GLYPHS; i++) {
+		glyph_entry *g = &glyphs[i];
+		if (g->font != font)
+			continue;
+		// Out of the lookup right away, a new font may get the same address
+		unlink_glyph(g);
+		if (g->refs)
+			g->font = NULL;
+		else
+			free_glyph(g);
+	}
+}
+
+void glyph_atlas_rasterize(SDL_Surface *surface, const void *pixels) {
+	if (!deferred_num)
+		return;
+	deferred_text *d = find_deferred(surface, pixels);
+	if (d)
+		rasterize(d);
+}
+
+void glyph_atlas_free_surface(SDL_Surface *surface) {
+	if (!deferred_num || !surface || surface->refcount > 1)
+		return;
+	deferred_text *d = find_deferred(surface, NULL);
+	if (d)
+		drop_deferred(d);
+}
+
+// The game reaching the pixels of a text surface some other way than through a texture
+
+SDL_Surface *SDL_ConvertSurface_hook(SDL_Surface *src, const SDL_PixelFormat *fmt, Uint32 flags) {
+	glyph_atlas_rasterize(src, NULL);
+	return SDL_ConvertSurface(src, fmt, flags);
+}
+
+SDL_Surface *SDL_ConvertSurfaceFormat_hook(SDL_Surface *src, Uint32 pixel_format, Uint32 flags) {
+	glyph_atlas_rasterize(src, NULL);
+	return SDL_ConvertSurfaceFormat(src, pixel_format, flags);
+}
+
+int SDL_LockSurface_hook(SDL_Surface *surface) {
+	glyph_atlas_rasterize(surface, NULL);
+	return SDL_LockSurface(surface);
+}
+
+int SDL_UpperBlit_hook(SDL_Surface *src, const SDL_Rect *srcrect, SDL_Surface *dst, SDL_Rect *dstrect) {
+	glyph_atlas_rasterize(src, NULL);
+	glyph_atlas_rasterize(dst, NULL);
+	return SDL_UpperBlit(src, srcrect, dst, dstrect);
+}
+
+int SDL_UpperBlitScaled_hook(SDL_Surface *src, const SDL_Rect *srcrect, SDL_Surface *dst, SDL_Rect *dstrect) {
+	glyph_atlas_rasterize(src, NULL);
+	glyph_atlas_rasterize(dst, NULL);
+	return SDL_UpperBlitScaled(src, srcrect, dst, dstrect);
+}
+
+int SDL_FillRect_hook(SDL_Surface *dst, const SDL_Rect *rect, Uint32 color) {
+	glyph_atlas_rasterize(dst, NULL);
+	return SDL_FillRect(dst, rect, color);
+}
@@ -0,0 +1,32 @@
+#ifndef __GLYPH_ATLAS_H__
+#define __GLYPH_ATLAS_H__
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+struct so_module;
+
+void glyph_atlas_patch(struct so_module *mod); // After ttf_cache_patch
+// Blank surface standing for text until its pixels are needed, NULL if it has to be rasterized right away
+SDL_Surface *glyph_atlas_render(TTF_Font *font, int style, int outline, int hinting, const char *text, SDL_Color fg);
+void glyph_atlas_forget_font(TTF_Font *font);
+void glyph_atlas_rasterize(SDL_Surface *surface, const void *pixels); // Either one may be NULL
+void glyph_atlas_free_surface(SDL_Surface *surface); // Right before SDL_FreeSurface
+
+SDL_Texture *glyph_atlas_create_texture(SDL_Renderer *renderer, SDL_Surface *surface); // NULL if surface isn't a text one
+int glyph_atlas_is_run(SDL_Texture *texture);
+SDL_Texture *glyph_atlas_real_texture(SDL_Texture *texture); // For SDL_GL_BindTexture and SDL_UpdateTexture
+void glyph_atlas_destroy_texture(SDL_Texture *texture);
+int glyph_atlas_render_copy(SDL_Renderer *renderer, SDL_Texture *texture, const SDL_Rect *srcrect, const SDL_Rect *dstrect);
+int glyph_atlas_query_texture(SDL_Texture *texture, Uint32 *format, int *access, int *w, int *h);
+int glyph_atlas_color_mod(SDL_Texture *texture, int set, Uint8 *rgb);
+int glyph_atlas_blend_mode(SDL_Texture *texture, int set, SDL_BlendMode *mode);
+
+SDL_Surface *SDL_ConvertSurface_hook(SDL_Surface *src, const SDL_PixelFormat *fmt, Uint32 flags);
+SDL_Surface *SDL_ConvertSurfaceFormat_hook(SDL_Surface *src, Uint32 pixel_format, Uint32 flags);
+int SDL_LockSurface_hook(SDL_Surface *surface);
+int SDL_UpperBlit_hook(SDL_Surface *src, const SDL_Rect *srcrect, SDL_Surface *dst, SDL_Rect *dstrect);
+int SDL_UpperBlitScaled_hook(SDL_Surface *src, const SDL_Rect *srcrect, SDL_Surface *dst, SDL_Rect *dstrect);
+int SDL_FillRect_hook(SDL_Surface *dst, const SDL_Rect *rect, Uint32 color);
+
+#endif
@@ -0,0 +1,90 @@
+/* glyph_layout.c -- SDL_ttf string layout as a run of single glyphs
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Mirrors the pen movement of SDL_ttf 2.0.15 TTF_RenderUTF8_Blended for
+ * unstyled, non outlined fonts: kerning between glyphs, advances, and the
+ * first glyph shifted right by its negative minx. Each glyph is placed as the
+ * surface TTF_RenderUTF8_Blended gives for that glyph alone, whose pen sits
+ * at max(-minx, 0). Shared with tools/glyph_compare.c.
+ */
+
+#include "glyph_layout.h"
+
+#define UNICODE_BOM_NATIVE 0xFEFF
+#define UNICODE_BOM_SWAPPED 0xFFFE
+
+static int utf8_getch(const char **text) {
+	const uint8_t *p = (const uint8_t *)*text;
+	int ch, len;
+	if (p[0] < 0x80) {
+		ch = p[0];
+		len = 1;
+	} else if ((p[0] & 0xE0) == 0xC0) {
+		ch = p[0] & 0x1F;
+		len = 2;
+	} else if ((p[0] & 0xF0) == 0xE0) {
+		ch = p[0] & 0x0F;
+		len = 3;
+	} else {
+		return -1; // Invalid, or outside the BMP TTF_GlyphMetrics is limited to
+	}
+	for (int i = 1; i < len; i++) {
+		if ((p[i] & 0xC0) != 0x80)
+			return -1;
+		ch = (ch << 6) | (p[i] & 0x3F);
+	}
+	*text += len;
+	return ch;
+}
+
+int glyph_layout(const glyph_funcs *f, TTF_Font *font, const char *text, glyph_pos *out, int max) {
+	int kerning = f->get_font_kerning(font);
+	int xstart = 0, n = 0;
+	uint16_t prev = 0;
+
+	while (*text) {
+		int ch = utf8_getch(&text);
+		if (ch < 0)
+			return -1;
+		if (ch == UNICODE_BOM_NATIVE || ch == UNICODE_BOM_SWAPPED)
+			continue;
+
+		int minx, maxx, miny, maxy, advance;
+		if (n == max || f->glyph_metrics(font, ch, &minx, &maxx, &miny, &maxy, &advance) < 0)
+			return -1;
+		if (kerning && prev)
+			xstart += f->kerning_size_glyphs(font, prev, ch);
+		if (n == 0 && minx < 0)
+			xstart -= minx;
+
+		out[n].ch = ch;
+		out[n].x = xstart - (minx < 0 ? -minx : 0);
+		n++;
+		xstart += advance;
+		prev = ch;
+	}
+	return n;
+}
+
+int glyph_utf8(uint16_t ch, char *out) {
+	int len;
+	if (ch < 0x80) {
+		out[0] = ch;
+		len = 1;
+	} else if (ch < 0x800) {
+		out[0] = 0xC0 | (ch >> 6);
+		out[1] = 0x80 | (ch & 0x3F);
+		len = 2;
+	} else {
+		out[0] = 0xE0 | (ch >> 12);
+		out[1] = 0x80 | ((ch >> 6) & 0x3F);
+		out[2] = 0x80 | (ch & 0x3F);
+		len = 3;
+	}
+	out[len] = 0;
+	return len;
+}
@@ -0,0 +1,24 @@
+#ifndef __GLYPH_LAYOUT_H__
+#define __GLYPH_LAYOUT_H__
+
+#include <SDL2/SDL_ttf.h>
+
+#include <stdint.h>
+
+// SDL_ttf entry points the layout needs, the game's own ones on the Vita
+typedef struct {
+	int (*glyph_metrics)(TTF_Font *font, Uint16 ch, int *minx, int *maxx, int *miny, int *maxy, int *advance);
+	int (*get_font_kerning)(const TTF_Font *font);
+	int (*kerning_size_glyphs)(TTF_Font *font, Uint16 previous_ch, Uint16 ch);
+} glyph_funcs;
+
+typedef struct {
+	uint16_t ch;
+	int x; // Where TTF_RenderUTF8_Blended of ch alone lands in the string's surface
+} glyph_pos;
+
+// Number of glyphs of text, -1 if it can't be laid out (invalid UTF-8, outside the BMP or longer than max)
+int glyph_layout(const glyph_funcs *f, TTF_Font *font, const char *text, glyph_pos *out, int max);
+int glyph_utf8(uint16_t ch, char *out); // Encodes ch followed by a terminator, returns its length
+
+#endif
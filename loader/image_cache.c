@@ -0,0 +1,309 @@
+/* image_cache.c -- two level cache of decoded IMG_Load surfaces
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Level one keeps copies of recently decoded surfaces in memory (LRU, bounded
+ * by IMAGE_CACHE_BUDGET_MB), level two stores raw pixels in IMAGE_CACHE_PATH
+ * (bounded by IMAGE_CACHE_L2_BUDGET_MB, oldest files deleted first).
+ * Both are keyed by path, size and mtime of the source, so an edited file is
+ * decoded again. Cache files are named after a hash of the path and store
+ * the path itself, which is checked on lookup. The game always gets its own copy of the surface.
+ * async_load.c loads from its worker thread too, so the memory level, the
+ * disk usage and the counters are guarded by a lock, which is not held while
+ * decoding.
+ */
+
+#include <psp2/kernel/processmgr.h>
+#include <psp2/kernel/threadmgr.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "image_cache.h"
+
+#define MAX_L1_ENTRIES 256
+#define MAX_L2_FILES 4096
+#define RAW_MAGIC 0x32575249 // "IRW2", the full source path was added
+
+typedef struct {
+	uint32_t magic;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;
+	uint32_t pitch;
+	uint32_t has_colorkey;
+	uint32_t colorkey;
+	char path[256]; // Source, two paths may share a hash
+} raw_header;
+
+typedef struct {
+	char path[256];
+	uint32_t size;
+	uint32_t mtime;
+	SDL_Surface *surface;
+	uint32_t bytes;
+	uint32_t last_use;
+} l1_entry;
+
+typedef struct {
+	char name[32];
+	uint32_t bytes;
+	uint32_t mtime;
+} l2_file;
+
+static l1_entry l1[MAX_L1_ENTRIES];
+static uint32_t l1_bytes = 0;
+static uint32_t use_tick = 0;
+static int dir_created = 0;
+static int64_t l2_bytes = -1; // Unknown until IMAGE_CACHE_PATH is scanned
+static SceKernelLwMutexWork lock;
+
+static int frame_loads = 0, frame_l1_hits = 0, frame_l2_hits = 0;
+static uint64_t frame_us = 0;
+
+static uint32_t path_hash(const char *path) {
+	uint32_t h = 0x811C9DC5;
+	while (*path) {
+		h ^= (uint8_t)*path++;
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+static void l1_evict(l1_entry *e) {
+	SDL_FreeSurface(e->surface);
+	l1_bytes -= e->bytes;
+	memset(e, 0, sizeof(l1_entry));
+}
+
+static void l1_insert(const char *path, struct stat *st, SDL_Surface *s) {
+	uint32_t bytes = s->pitch * s->h;
+	if (bytes > IMAGE_CACHE_BUDGET_MB * 1024 * 1024 / 4)
+		return;
+
+	SDL_Surface *copy = SDL_DuplicateSurface(s);
+	if (!copy)
+		return;
+
+	// Least recently used entries go first until the new one fits
+	l1_entry *slot = NULL;
+	for (;;) {
+		l1_entry *lru = NULL;
+		slot = NULL;
+		for (int i = 0; i < MAX_L1_ENTRIES; i++) {
+			if (!l1[i].surface) {
+				if (!slot)
+					slot = &l1[i];
+			} else if (!lru || l1[i].last_use < lru->last_use) {
+				lru = &l1[i];
+			}
+		}
+		if (slot && l1_bytes + bytes <= IMAGE_CACHE_BUDGET_MB * 1024 * 1024)
+			break;
+		l1_evict(lru);
+	}
+
+	strncpy(slot->path, path, sizeof(slot->path) - 1);
+	slot->size = st->st_size;
+	slot->mtime = st->st_mtime;
+	slot->surface = copy;
+	slot->bytes = bytes;
+	slot->last_use = ++use_tick;
+	l1_bytes += bytes;
+}
+
+static SDL_Surface *l1_lookup(const char *path, struct stat *st) {
+	for (int i = 0; i < MAX_L1_ENTRIES; i++) {
+		l1_entry *e = &l1[i];
+		if (e->surface && e->size == st->st_size && e->mtime == st->st_mtime && !strcmp(e->path, path)) {
+			e->last_use = ++use_tick;
+			return SDL_DuplicateSurface(e->surface);
+		}
+	}
+	return NULL;
+}
+
+static void l2_name(char *out, const char *path, struct stat *st) {
+	sprintf(out, "%s/%08X_%08X_%08X.raw", IMAGE_CACHE_PATH, path_hash(path), (uint32_t)st->st_size, (uint32_t)st->st_mtime);
+}
+
+static SDL_Surface *l2_lookup(const char *path, struct stat *st) {
+	char fname[256];
+	l2_name(fname, path, st);
+	FILE *f = fopen(fname, "rb");
+	if (!f)
+		return NULL;
+
+	raw_header hdr;
+	SDL_Surface *s = NULL;
+	if (fread(&hdr, 1, sizeof(hdr), f) == sizeof(hdr) && hdr.magic == RAW_MAGIC && !strncmp(hdr.path, path, sizeof(hdr.path))) {
+		s = SDL_CreateRGBSurfaceWithFormat(0, hdr.width, hdr.height, SDL_BITSPERPIXEL(hdr.format), hdr.format);
+		if (s && s->pitch == hdr.pitch && fread(s->pixels, 1, hdr.pitch * hdr.height, f) == hdr.pitch * hdr.height) {
+			if (hdr.has_colorkey)
+				SDL_SetColorKey(s, SDL_TRUE, hdr.colorkey);
+		} else if (s) {
+			SDL_FreeSurface(s);
+			s = NULL;
+		}
+	}
+	fclose(f);
+	return s;
+}
+
+static int cmp_l2_file(const void *a, const void *b) {
+	uint32_t ma = ((const l2_file *)a)->mtime, mb = ((const l2_file *)b)->mtime;
+	return ma < mb ? -1 : (ma > mb ? 1 : 0);
+}
+
+// Makes room for incoming bytes, the folder is only scanned when over budget (or on first store)
+static void l2_trim(uint32_t incoming) {
+	const int64_t budget = (int64_t)IMAGE_CACHE_L2_BUDGET_MB * 1024 * 1024;
+	if (l2_bytes >= 0 && l2_bytes + incoming <= budget)
+		return;
+
+	l2_file *files = (l2_file *)malloc(MAX_L2_FILES * sizeof(l2_file));
+	int num = 0;
+	int64_t total = 0;
+	DIR *d = opendir(IMAGE_CACHE_PATH);
+	if (d) {
+		struct dirent *e;
+		while ((e = readdir(d))) {
+			char fname[256];
+			struct stat st;
+			snprintf(fname, sizeof(fname), "%s/%s", IMAGE_CACHE_PATH, e->d_name);
+			if (stat(fname, &st) < 0 || !S_ISREG(st.st_mode))
+				continue;
+			total += st.st_size;
+			if (num < MAX_L2_FILES && strlen(e->d_name) < sizeof(files[num].name)) {
+				strcpy(files[num].name, e->d_name);
+				files[num].bytes = st.st_size;
+				files[num].mtime = st.st_mtime;
+				num++;
+			}
+		}
+		closedir(d);
+	}
+
+	// Down to 3/4 of the budget so that the next stores don't scan again right away
+	if (total + incoming > budget) {
+		qsort(files, num, sizeof(l2_file), cmp_l2_file);
+		int evicted = 0;
+		for (int i = 0; i < num && total + incoming > budget / 4 * 3; i++) {
+			char fname[256];
+			snprintf(fname, sizeof(fname), "%s/%s", IMAGE_CACHE_PATH, files[i].name);
+			if (remove(fname) == 0) {
+				total -= files[i].bytes;
+				evicted++;
+			}
+		}
+		printf("[ImageCache] %d files evicted from %s, %llu KB left\n", evicted, IMAGE_CACHE_PATH, total / 1024);
+	}
+	l2_bytes = total;
+	free(files);
+}
+
+static void l2_store(const char *path, struct stat *st, SDL_Surface *s) {
+	// Palettized surfaces would need their palette too, they're cheap to decode anyway
+	if (SDL_ISPIXELFORMAT_INDEXED(s->format->format) || strlen(path) >= sizeof(((raw_header *)0)->path))
+		return;
+	uint32_t bytes = sizeof(raw_header) + s->pitch * s->h;
+	if (bytes > IMAGE_CACHE_L2_BUDGET_MB * 1024 * 1024 / 4)
+		return;
+
+	// Bytes are accounted for before writing, the worker of async_load.c may be storing too
+	sceKernelLockLwMutex(&lock, 1, NULL);
+	if (!dir_created) {
+		mkdir(IMAGE_CACHE_PATH, 0777);
+		dir_created = 1;
+	}
+	l2_trim(bytes);
+	l2_bytes += bytes;
+	sceKernelUnlockLwMutex(&lock, 1);
+
+	char fname[256];
+	l2_name(fname, path, st);
+	FILE *f = fopen(fname, "wb");
+	if (!f) {
+		sceKernelLockLwMutex(&lock, 1, NULL);
+		l2_bytes -= bytes;
+		sceKernelUnlockLwMutex(&lock, 1);
+		return;
+	}
+
+	raw_header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = RAW_MAGIC;
+	strncpy(hdr.path, path, sizeof(hdr.path) - 1);
+	hdr.width = s->w;
+	hdr.height = s->h;
+	hdr.format = s->format->format;
+	hdr.pitch = s->pitch;
+	hdr.has_colorkey = SDL_GetColorKey(s, &hdr.colorkey) == 0;
+	if (!hdr.has_colorkey)
+		hdr.colorkey = 0;
+	fwrite(&hdr, 1, sizeof(hdr), f);
+	SDL_LockSurface(s);
+	fwrite(s->pixels, 1, s->pitch * s->h, f);
+	SDL_UnlockSurface(s);
+	fclose(f);
+}
+
+void image_cache_init(void) {
+	sceKernelCreateLwMutex(&lock, "image_cache", 0, 0, NULL);
+}
+
+SDL_Surface *image_cache_load(const char *path) {
+	struct stat st;
+	if (stat(path, &st) < 0)
+		return IMG_Load(path);
+
+	uint64_t t = sceKernelGetProcessTimeWide();
+	sceKernelLockLwMutex(&lock, 1, NULL);
+	frame_loads++;
+	SDL_Surface *s = l1_lookup(path, &st);
+	if (s)
+		frame_l1_hits++;
+	sceKernelUnlockLwMutex(&lock, 1);
+
+	if (!s) {
+		int l2_hit = 0;
+		s = l2_lookup(path, &st);
+		if (s) {
+			l2_hit = 1;
+		} else {
+			s = IMG_Load(path);
+			if (s)
+				l2_store(path, &st, s);
+		}
+		sceKernelLockLwMutex(&lock, 1, NULL);
+		frame_l2_hits += l2_hit;
+		if (s)
+			l1_insert(path, &st, s);
+		sceKernelUnlockLwMutex(&lock, 1);
+	}
+
+	sceKernelLockLwMutex(&lock, 1, NULL);
+	frame_us += sceKernelGetProcessTimeWide() - t;
+	sceKernelUnlockLwMutex(&lock, 1);
+	return s;
+}
+
+void image_cache_frame(void) {
+	sceKernelLockLwMutex(&lock, 1, NULL);
+	if (frame_loads) {
+		printf("[ImageCache] %d images loaded in %llu us: %d from memory, %d from %s, %u KB cached in memory\n",
+			frame_loads, frame_us, frame_l1_hits, frame_l2_hits, IMAGE_CACHE_PATH, l1_bytes / 1024);
+		frame_loads = frame_l1_hits = frame_l2_hits = 0;
+		frame_us = 0;
+	}
+	sceKernelUnlockLwMutex(&lock, 1);
+}
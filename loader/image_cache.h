@@ -0,0 +1,10 @@
+#ifndef __IMAGE_CACHE_H__
+#define __IMAGE_CACHE_H__
+
+#include <SDL2/SDL.h>
+
+void image_cache_init(void);
+SDL_Surface *image_cache_load(const char *path); // Safe from any thread
+void image_cache_frame(void);
+
+#endif
@@ -0,0 +1,397 @@
+/* index_reorder.c -- post-transform vertex cache friendly triangle order for static meshes
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * GL_STATIC_DRAW element buffers are kept on the CPU, and every range of them
+ * drawn as GL_TRIANGLES gets its triangles reordered with Tom Forsyth's
+ * linear-speed vertex cache optimisation on its first draw. Results are
+ * stored in INDEX_CACHE_PATH by sha1 of the original indices, so the
+ * optimisation only runs once per mesh. Ranges it doesn't improve are
+ * remembered as they are and not stored. A draw overlapping a reordered range
+ * without matching it, or a partial update, puts the original order back.
+ */
+
+#include <vitaGL.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "buffer_table.h"
+#include "config.h"
+#include "index_reorder.h"
+#include "sha1.h"
+
+#define MAX_BUFFERS 512 // Power of two
+#define MAX_RANGES 32
+#define MIN_TRIANGLES 64
+#define COPY_BUDGET (8 * 1024 * 1024)
+
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_MAX_VALENCE 32
+#define ACMR_CACHE_SIZE 16 // FIFO, as used for the logged ratios
+
+enum {
+	BUFFER_NONE,
+	BUFFER_ACTIVE,
+	BUFFER_REJECTED
+};
+
+typedef struct {
+	uint32_t offset;
+	uint32_t bytes;
+	int isize;
+	int reordered; // 0 if checked and left in the original order
+} index_range;
+
+typedef struct {
+	GLuint id;
+	uint8_t state;
+	uint8_t *data;
+	GLsizeiptr size;
+	int num_ranges;
+	index_range ranges[MAX_RANGES];
+} index_buffer;
+
+static index_buffer buffers[MAX_BUFFERS];
+static uint32_t copies_size = 0;
+static int dir_created = 0;
+
+static float cache_scores[FORSYTH_CACHE_SIZE];
+static float valence_scores[FORSYTH_MAX_VALENCE];
+static int scores_ready = 0;
+
+static uint64_t total_indices = 0, total_misses_before = 0, total_misses_after = 0;
+
+static index_buffer *find_buffer(GLuint id, int create) {
+	return (index_buffer *)buffer_table_find(buffers, MAX_BUFFERS, sizeof(index_buffer), id, create);
+}
+
+static void free_copy(index_buffer *b) {
+	if (b->data) {
+		copies_size -= b->size;
+		free(b->data);
+		b->data = NULL;
+	}
+	b->num_ranges = 0;
+}
+
+static int index_size(GLenum type) {
+	return type == GL_UNSIGNED_SHORT ? 2 : (type == GL_UNSIGNED_INT ? 4 : 0);
+}
+
+static int has_reordered(index_buffer *b) {
+	for (int i = 0; i < b->num_ranges; i++) {
+		if (b->ranges[i].reordered)
+			return 1;
+	}
+	return 0;
+}
+
+// Puts the original order back, with b bound to GL_ELEMENT_ARRAY_BUFFER
+static void revert(index_buffer *b) {
+	if (has_reordered(b)) {
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, b->size, b->data);
+		printf("[IndexReorder] Buffer %u restored to its original order\n", b->id);
+	}
+	b->state = BUFFER_REJECTED;
+	free_copy(b);
+}
+
+static void init_scores(void) {
+	for (int i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+		// The last triangle's vertices get a fixed score, so that it isn't just reused right away
+		cache_scores[i] = i < 3 ? 0.75f : powf(1.0f - (float)(i - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+	}
+	for (int i = 0; i < FORSYTH_MAX_VALENCE; i++)
+		valence_scores[i] = i ? 2.0f / sqrtf(i) : 0.0f;
+	scores_ready = 1;
+}
+
+static float vertex_score(int cache_pos, int valence) {
+	if (!valence)
+		return -1.0f;
+	float s = cache_pos >= 0 ? cache_scores[cache_pos] : 0.0f;
+	return s + valence_scores[valence < FORSYTH_MAX_VALENCE ? valence : FORSYTH_MAX_VALENCE - 1];
+}
+
+static int forsyth(const uint32_t *in, uint32_t *out, int num_tris, uint32_t num_verts) {
+	int *valence = (int *)calloc(num_verts, sizeof(int));
+	int *adj_start = (int *)malloc((num_verts + 1) * sizeof(int));
+	int *adj = (int *)malloc(num_tris * 3 * sizeof(int));
+	int *cache_pos = (int *)malloc(num_verts * sizeof(int));
+	float *vscore = (float *)malloc(num_verts * sizeof(float));
+	float *tscore = (float *)malloc(num_tris * sizeof(float));
+	uint8_t *emitted = (uint8_t *)calloc(num_tris, 1);
+	int ok = valence && adj_start && adj && cache_pos && vscore && tscore && emitted;
+	if (!ok)
+		goto out;
+
+	// Triangles using every vertex
+	for (int i = 0; i < num_tris * 3; i++)
+		valence[in[i]]++;
+	adj_start[0] = 0;
+	for (uint32_t v = 0; v < num_verts; v++) {
+		adj_start[v + 1] = adj_start[v] + valence[v];
+		cache_pos[v] = adj_start[v];
+	}
+	for (int i = 0; i < num_tris * 3; i++)
+		adj[cache_pos[in[i]]++] = i / 3;
+
+	for (uint32_t v = 0; v < num_verts; v++) {
+		cache_pos[v] = -1;
+		vscore[v] = vertex_score(-1, valence[v]);
+	}
+	int best = 0;
+	for (int t = 0; t < num_tris; t++) {
+		tscore[t] = vscore[in[t * 3]] + vscore[in[t * 3 + 1]] + vscore[in[t * 3 + 2]];
+		if (tscore[t] > tscore[best])
+			best = t;
+	}
+
+	uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+	int cache_num = 0, cursor = 0;
+	for (int n = 0; n < num_tris; n++) {
+		if (best < 0) {
+			// Nothing left around the cache, carry on with the first triangle not emitted yet
+			while (emitted[cursor])
+				cursor++;
+			best = cursor;
+		}
+		int t = best;
+		emitted[t] = 1;
+		memcpy(&out[n * 3], &in[t * 3], 3 * sizeof(uint32_t));
+
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = in[t * 3 + k];
+			int *a = &adj[adj_start[v]];
+			for (int j = 0; j < valence[v]; j++) {
+				if (a[j] == t) {
+					a[j] = a[--valence[v]];
+					break;
+				}
+			}
+		}
+
+		// LRU: the triangle's vertices go in front, what's pushed past the end falls out
+		uint32_t new_cache[FORSYTH_CACHE_SIZE + 3];
+		int new_num = 0;
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = in[t * 3 + k];
+			if (cache_pos[v] != -2) {
+				new_cache[new_num++] = v;
+				cache_pos[v] = -2;
+			}
+		}
+		for (int i = 0; i < cache_num; i++) {
+			if (cache_pos[cache[i]] != -2)
+				new_cache[new_num++] = cache[i];
+		}
+
+		float best_score = 0.0f;
+		best = -1;
+		for (int i = 0; i < new_num; i++) {
+			uint32_t v = new_cache[i];
+			cache_pos[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+			vscore[v] = vertex_score(cache_pos[v], valence[v]);
+		}
+		for (int i = 0; i < new_num; i++) {
+			const int *a = &adj[adj_start[new_cache[i]]];
+			for (int j = 0; j < valence[new_cache[i]]; j++) {
+				int tt = a[j];
+				tscore[tt] = vscore[in[tt * 3]] + vscore[in[tt * 3 + 1]] + vscore[in[tt * 3 + 2]];
+				if (tscore[tt] > best_score) {
+					best_score = tscore[tt];
+					best = tt;
+				}
+			}
+		}
+		cache_num = new_num < FORSYTH_CACHE_SIZE ? new_num : FORSYTH_CACHE_SIZE;
+		memcpy(cache, new_cache, cache_num * sizeof(uint32_t));
+	}
+
+out:
+	free(valence);
+	free(adj_start);
+	free(adj);
+	free(cache_pos);
+	free(vscore);
+	free(tscore);
+	free(emitted);
+	return ok;
+}
+
+static int cache_misses(const uint32_t *idx, int count) {
+	uint32_t fifo[ACMR_CACHE_SIZE];
+	int fill = 0, head = 0, misses = 0;
+	for (int i = 0; i < count; i++) {
+		int hit = 0;
+		for (int j = 0; j < fill && !hit; j++)
+			hit = fifo[j] == idx[i];
+		if (!hit) {
+			misses++;
+			fifo[head] = idx[i];
+			head = (head + 1) % ACMR_CACHE_SIZE;
+			if (fill < ACMR_CACHE_SIZE)
+				fill++;
+		}
+	}
+	return misses;
+}
+
+static void cache_name(char *out, const uint8_t *src, uint32_t bytes, int isize) {
+	uint32_t sha1[5];
+	SHA1_CTX ctx;
+	sha1_init(&ctx);
+	sha1_update(&ctx, src, bytes);
+	sha1_final(&ctx, (uint8_t *)sha1);
+	sprintf(out, "%s/%08x%08x%08x%08x%08x_%d.idx", INDEX_CACHE_PATH, sha1[0], sha1[1], sha1[2], sha1[3], sha1[4], isize);
+}
+
+static void reorder_range(index_buffer *b, uint32_t offset, GLsizei count, int isize) {
+	const uint8_t *src = b->data + offset;
+	uint32_t bytes = count * isize;
+	int reordered = 0;
+	uint32_t *in = (uint32_t *)malloc(count * sizeof(uint32_t));
+	uint32_t *out = (uint32_t *)calloc(count, sizeof(uint32_t));
+	uint8_t *packed = (uint8_t *)malloc(bytes);
+	if (!in || !out || !packed)
+		goto out;
+
+	uint32_t num_verts = 0;
+	for (int i = 0; i < count; i++) {
+		in[i] = isize == 2 ? ((const uint16_t *)src)[i] : ((const uint32_t *)src)[i];
+		if (in[i] >= num_verts)
+			num_verts = in[i] + 1;
+	}
+
+	char fname[256];
+	cache_name(fname, src, bytes, isize);
+	int cached = 0;
+	FILE *f = fopen(fname, "rb");
+	if (f) {
+		cached = fread(packed, 1, bytes, f) == bytes;
+		fclose(f);
+	}
+	if (cached) {
+		for (int i = 0; i < count; i++)
+			out[i] = isize == 2 ? ((const uint16_t *)packed)[i] : ((const uint32_t *)packed)[i];
+	} else {
+		if (!scores_ready)
+			init_scores();
+		if (!forsyth(in, out, count / 3, num_verts))
+			goto out;
+		for (int i = 0; i < count; i++) {
+			if (isize == 2)
+				((uint16_t *)packed)[i] = out[i];
+			else
+				((uint32_t *)packed)[i] = out[i];
+		}
+	}
+
+	int before = cache_misses(in, count), after = cache_misses(out, count);
+	if (after >= before)
+		goto out; // Already in a good order, leave it as it is
+	if (!cached) {
+		if (!dir_created) {
+			mkdir(INDEX_CACHE_PATH, 0777);
+			dir_created = 1;
+		}
+		f = fopen(fname, "wb");
+		if (f) {
+			fwrite(packed, 1, bytes, f);
+			fclose(f);
+		}
+	}
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, bytes, packed);
+	reordered = 1;
+
+	total_indices += count;
+	total_misses_before += before;
+	total_misses_after += after;
+	printf("[IndexReorder] Buffer %u: %d triangles, ACMR %.3f -> %.3f%s\n",
+		b->id, count / 3, before * 3.0f / count, after * 3.0f / count, cached ? " (cached)" : "");
+
+out:
+	// Recorded either way, so that the range isn't checked again on every draw
+	b->ranges[b->num_ranges].offset = offset;
+	b->ranges[b->num_ranges].bytes = bytes;
+	b->ranges[b->num_ranges].isize = isize;
+	b->ranges[b->num_ranges].reordered = reordered;
+	b->num_ranges++;
+	free(in);
+	free(out);
+	free(packed);
+}
+
+void index_reorder_buffer_data(GLuint buffer, GLsizeiptr size, const void *data, GLenum usage) {
+	int candidate = data && usage == GL_STATIC_DRAW && size >= MIN_TRIANGLES * 3 * 2 && copies_size + size <= COPY_BUDGET;
+	index_buffer *b = find_buffer(buffer, candidate);
+	if (!b)
+		return;
+
+	// Whatever was reordered gets overwritten by the upload
+	free_copy(b);
+	b->state = BUFFER_NONE;
+	if (!candidate)
+		return;
+
+	b->data = (uint8_t *)malloc(size);
+	if (!b->data)
+		return;
+	memcpy(b->data, data, size);
+	copies_size += size;
+	b->size = size;
+	b->state = BUFFER_ACTIVE;
+}
+
+void index_reorder_buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data) {
+	index_buffer *b = find_buffer(buffer, 0);
+	if (!b || !b->data)
+		return;
+	if (offset + size <= b->size)
+		memcpy(b->data + offset, data, size);
+	revert(b);
+}
+
+void index_reorder_delete(GLuint buffer) {
+	index_buffer *b = find_buffer(buffer, 0);
+	if (b) {
+		free_copy(b);
+		b->state = BUFFER_NONE;
+	}
+}
+
+void index_reorder_draw(GLuint buffer, GLenum mode, GLsizei count, GLenum type, const void *indices) {
+	index_buffer *b = find_buffer(buffer, 0);
+	if (!b || b->state != BUFFER_ACTIVE)
+		return;
+
+	int isize = index_size(type);
+	uint32_t offset = (uintptr_t)indices, end = offset + count * (isize ? isize : 1);
+	for (int i = 0; i < b->num_ranges; i++) {
+		index_range *r = &b->ranges[i];
+		if (r->offset == offset && r->offset + r->bytes == end && r->isize == isize && mode == GL_TRIANGLES)
+			return;
+		if (offset < r->offset + r->bytes && r->offset < end) {
+			// Reordering across a range left alone would change what that range draws
+			if (r->reordered)
+				revert(b);
+			return;
+		}
+	}
+
+	if (mode != GL_TRIANGLES || !isize || count < MIN_TRIANGLES * 3 || count % 3 || offset % isize || end > (uint32_t)b->size || b->num_ranges == MAX_RANGES)
+		return;
+	reorder_range(b, offset, count, isize);
+}
+
+void index_reorder_acmr(float *before, float *after) {
+	*before = total_indices ? total_misses_before * 3.0f / total_indices : 0.0f;
+	*after = total_indices ? total_misses_after * 3.0f / total_indices : 0.0f;
+}
@@ -0,0 +1,12 @@
+#ifndef __INDEX_REORDER_H__
+#define __INDEX_REORDER_H__
+
+#include <vitaGL.h>
+
+void index_reorder_buffer_data(GLuint buffer, GLsizeiptr size, const void *data, GLenum usage);
+void index_reorder_buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data);
+void index_reorder_delete(GLuint buffer);
+void index_reorder_draw(GLuint buffer, GLenum mode, GLsizei count, GLenum type, const void *indices); // Right before a non batched draw, buffer bound
+void index_reorder_acmr(float *before, float *after); // Average cache miss ratio over all reordered ranges
+
+#endif
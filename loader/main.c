@@ -45,7 +45,27 @@
 #include "config.h"
 #include "dialog.h"
 #include "so_util.h"
-#include "sha1.h"
+#include "async_load.h"
+#include "atlas.h"
+#include "batch2d.h"
+#include "dxt_cache.h"
+#include "frame_pacing.h"
+#include "gl_capture.h"
+#include "gl_state.h"
+#include "glyph_atlas.h"
+#include "image_cache.h"
+#include "gl_hooks.h"
+#include "mvp_fold.h"
+#include "overlay.h"
+#include "program_cache.h"
+#include "render_batch.h"
+#include "render_target.h"
+#include "settings.h"
+#include "shader_patches.h"
+#include "stats.h"
+#include "stream_ring.h"
+#include "tex_format.h"
+#include "ttf_cache.h"
 
 #define ENABLE_DEBUG
 
@@ -64,8 +84,6 @@ static char data_path[256];
 static char fake_vm[0x1000];
 static char fake_env[0x1000];
 
-int framecap = 0;
-
 void *__wrap_calloc(uint32_t nmember, uint32_t size) { return vglCalloc(nmember, size); }
 void __wrap_free(void *addr) { vglFree(addr); };
 void *__wrap_malloc(uint32_t size) { return vglMalloc(size); };
@@ -315,21 +333,37 @@ int pthread_cond_broadcast_soloader(pthread_cond_t **cond)
     return pthread_cond_broadcast(*cond);
 }
 
+typedef struct {
+	void *(*start)(void *);
+	void *param;
+} thread_start;
+
+// Game threads show up in the performance overlay
+static void *thread_entry(void *arg) {
+	thread_start s = *(thread_start *)arg;
+	free(arg);
+	overlay_register_thread();
+	return s.start(s.param);
+}
+
 int pthread_create_soloader(pthread_t **thread,
 			    const pthread_attr_t **attr,
 			    void *(*start)(void *),
 			    void *param)
 {
     *thread = calloc(1, sizeof(pthread_t));
+    thread_start *s = malloc(sizeof(thread_start));
+    s->start = start;
+    s->param = param;
 
     if (attr != NULL) {
 		pthread_attr_setstacksize(*attr, 512 * 1024);
-		return pthread_create(*thread, *attr, start, param);
+		return pthread_create(*thread, *attr, thread_entry, s);
     } else {
 		pthread_attr_t attrr;
 		pthread_attr_init(&attrr);
 		pthread_attr_setstacksize(&attrr, 512 * 1024);
-		return pthread_create(*thread, &attrr, start, param);
+		return pthread_create(*thread, &attrr, thread_entry, s);
     }
 
 }
@@ -655,7 +689,7 @@ void glGetProgramiv_fake(GLuint program, GLenum pname, GLint *params) {
 	if (pname == GL_ACTIVE_UNIFORM_BLOCKS)
 		*params = 0;
 	else
-		glGetProgramiv(program, pname, params);
+		glGetProgramiv(program_cache_resolve(program), pname, params);
 }
 
 void glFramebufferTextureLayer(GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer) {
@@ -712,7 +746,7 @@ void *SDL_GL_GetProcAddress_fake(const char *symbol) {
 	dlog("looking for symbol %s\n", symbol);
 	for (size_t i = 0; i < gl_numhook; ++i) {
 		if (!strcmp(symbol, gl_hook[i].symbol)) {
-			return (void *)gl_hook[i].func;
+			return gl_capture_proc_address(symbol, (void *)gl_hook[i].func);
 		}
 	}
 	void *r = vglGetProcAddress(symbol);
@@ -720,7 +754,7 @@ void *SDL_GL_GetProcAddress_fake(const char *symbol) {
 		dlog("Cannot find symbol %s\n", symbol);
 	}
 	
-	return r;
+	return gl_capture_proc_address(symbol, r);
 }
 
 #define SCE_ERRNO_MASK 0xFF
@@ -824,12 +858,22 @@ struct android_dirent *readdir_fake(android_DIR *dirp) {
 
 SDL_Surface *IMG_Load_hook(const char *file) {
 	char real_fname[256];
+	const char *rel = file;
 	//printf("loading %s\n", file);
 	if (strncmp(file, "ux0:", 4)) {
 		sprintf(real_fname, "%s/%s", data_path, file);
-		return IMG_Load(real_fname);
+	} else {
+		strcpy(real_fname, file);
+		if (!strncmp(file, data_path, strlen(data_path)) && file[strlen(data_path)] == '/')
+			rel = file + strlen(data_path) + 1;
+	}
+	SDL_Surface *s = async_load(rel, real_fname);
+	if (!s) {
+		s = image_cache_load(real_fname);
+		tex_format_tag(s, rel);
 	}
-	return IMG_Load(file);
+	dxt_cache_tag(s, rel, real_fname);
+	return s;
 }
 
 SDL_RWops *SDL_RWFromFile_hook(const char *fname, const char *mode) {
@@ -886,6 +930,140 @@ SDL_Window *SDL_CreateWindow_hook(const char *title, int x, int y, int w, int h,
 	return SDL_CreateWindow("rrm", x, y, w, h, flags | SDL_WINDOW_FULLSCREEN);
 }
 
+// SDL's renderer talks to vitaGL directly, so pending 2D batches are flushed before every call able to reach it
+// and the shadow state cache is invalidated after it. The ones drawing also end a downscaled 3D pass first
+SDL_Renderer *SDL_CreateRenderer_hook(SDL_Window *window, int index, Uint32 flags) {
+	batch2d_flush();
+	SDL_Renderer *r = SDL_CreateRenderer(window, index, flags);
+	gl_state_invalidate();
+	return r;
+}
+
+SDL_Texture *SDL_CreateTexture_hook(SDL_Renderer *renderer, Uint32 format, int access, int w, int h) {
+	batch2d_flush();
+	SDL_Texture *t = SDL_CreateTexture(renderer, format, access, w, h);
+	gl_state_invalidate();
+	return t;
+}
+
+SDL_Texture *SDL_CreateTextureFromSurface_hook(SDL_Renderer *renderer, SDL_Surface *surface) {
+	batch2d_flush();
+	SDL_Texture *s = async_load_create_texture(renderer, surface);
+	if (s) {
+		gl_state_invalidate();
+		return s;
+	}
+	s = glyph_atlas_create_texture(renderer, surface);
+	if (s)
+		return s;
+	s = atlas_create_texture(renderer, surface);
+	if (s)
+		return s;
+	batch2d_flush();
+	SDL_Texture *t = SDL_CreateTextureFromSurface(renderer, surface);
+	tex_format_sdl_texture(t, surface);
+	gl_state_invalidate();
+	return t;
+}
+
+int SDL_UpdateTexture_hook(SDL_Texture *texture, const SDL_Rect *rect, const void *pixels, int pitch) {
+	if (glyph_atlas_is_run(texture) && !(texture = glyph_atlas_real_texture(texture)))
+		return -1;
+	if (atlas_is_sprite(texture))
+		return atlas_update_texture(texture, rect, pixels, pitch);
+	batch2d_flush();
+	int r = tex_format_is_converted(texture) ? tex_format_update_texture(texture, rect, pixels, pitch) : SDL_UpdateTexture(texture, rect, pixels, pitch);
+	gl_state_invalidate();
+	return r;
+}
+
+void SDL_DestroyTexture_hook(SDL_Texture *texture) {
+	if (glyph_atlas_is_run(texture)) {
+		glyph_atlas_destroy_texture(texture);
+		return;
+	}
+	if (atlas_is_sprite(texture)) {
+		atlas_destroy_texture(texture);
+		return;
+	}
+	batch2d_flush();
+	async_load_forget_texture(texture);
+	tex_format_forget_texture(texture);
+	SDL_DestroyTexture(texture);
+	gl_state_invalidate();
+}
+
+int SDL_GL_BindTexture_hook(SDL_Texture *texture, float *texw, float *texh) {
+	if (glyph_atlas_is_run(texture) && !(texture = glyph_atlas_real_texture(texture)))
+		return -1;
+	if (atlas_is_sprite(texture))
+		return atlas_bind_texture(texture, texw, texh);
+	batch2d_clear_uv_remap();
+	batch2d_flush();
+	int r = SDL_GL_BindTexture(texture, texw, texh);
+	gl_state_invalidate();
+	return r;
+}
+
+int SDL_SetRenderTarget_hook(SDL_Renderer *renderer, SDL_Texture *texture) {
+	batch2d_flush();
+	render_target_end_3d();
+	int r = SDL_SetRenderTarget(renderer, texture);
+	gl_state_invalidate();
+	return r;
+}
+
+int SDL_RenderClear_hook(SDL_Renderer *renderer) {
+	batch2d_flush();
+	render_target_end_3d();
+	int r = SDL_RenderClear(renderer);
+	gl_state_invalidate();
+	return r;
+}
+
+// Queued by render_batch.c, which does the flushing above once the quads are submitted
+int SDL_RenderCopy_hook(SDL_Renderer *renderer, SDL_Texture *texture, const SDL_Rect *srcrect, const SDL_Rect *dstrect) {
+	if (glyph_atlas_is_run(texture))
+		return glyph_atlas_render_copy(renderer, texture, srcrect, dstrect);
+	return atlas_render_copy(renderer, texture, srcrect, dstrect);
+}
+
+int SDL_RenderFillRect_hook(SDL_Renderer *renderer, const SDL_Rect *rect) {
+	return render_batch_fill_rect(renderer, rect);
+}
+
+int SDL_RenderReadPixels_hook(SDL_Renderer *renderer, const SDL_Rect *rect, Uint32 format, void *pixels, int pitch) {
+	batch2d_flush();
+	render_target_end_3d();
+	int r = SDL_RenderReadPixels(renderer, rect, format, pixels, pitch);
+	gl_state_invalidate();
+	return r;
+}
+
+void SDL_RenderPresent_hook(SDL_Renderer *renderer) {
+	batch2d_flush();
+	render_target_end_3d();
+	SDL_RenderPresent(renderer);
+	gl_state_invalidate();
+}
+
+void SDL_GL_SwapWindow_hook(SDL_Window *window) {
+	gl_capture_frame();
+	batch2d_flush();
+	program_cache_frame();
+	atlas_frame();
+	image_cache_frame();
+	async_load_frame();
+	stream_ring_frame();
+	render_target_frame();
+	stats_frame();
+	overlay_frame();
+	frame_pacing_wait();
+	SDL_GL_SwapWindow(window);
+	frame_pacing_present();
+	render_target_begin_frame();
+}
+
 uint64_t lseek64(int fd, uint64_t offset, int whence) {
 	return lseek(fd, offset, whence);
 }
@@ -997,85 +1175,67 @@ void SDL_WaitThread_fake(pthread_t *thread, int *status) {
 void SDL_DetachThread_fake(pthread_t *thread) {
 }
 
-void glShaderSource_hook(GLuint shader, GLsizei count, const GLchar **string, const GLint *length) {
-	uint32_t sha1[5];
-	SHA1_CTX ctx;
-	
-	sha1_init(&ctx);
-	for (int i = 0; i < count; i++) {
-		sha1_update(&ctx, string[i], strlen(string[i]));
-	}
-	sha1_final(&ctx, (uint8_t *)sha1);
-
-	char sha_name[64];
-	snprintf(sha_name, sizeof(sha_name), "%08x%08x%08x%08x%08x", sha1[0], sha1[1], sha1[2], sha1[3], sha1[4]);
-
-	char cg_path[128];
-	snprintf(cg_path, sizeof(cg_path), "app0:/shaders/%s_glsl.gxp", sha_name);
-
-	FILE *file = fopen(cg_path, "rb");
-	
-	printf("Shader: %s\n", sha_name);
-	if (!file) {
-		glShaderSource(shader, count, string, length);
-		glCompileShader(shader);
-		/*void *bin = vglMalloc(32 * 1024);
-        GLsizei len;
-		vglGetShaderBinary(shader, 32 * 1024, &len, bin);
-        file = fopen(cg_path, "wb");
-        fwrite(bin, 1, len, file);
-        fclose(file);
-        vglFree(bin);*/
-	} else {
-		fseek(file, 0, SEEK_END);
-		uint32_t size = ftell(file);
-		fseek(file, 0, SEEK_SET);
-		char *buf = (char *)malloc(size + 1);
-		fread(buf, 1, size, file);
-		fclose(file);
-		buf[size] = 0;
-		glShaderBinary(1, &shader, 0, buf, size);
-		free(buf);
-	}
-}
-
-void glFramebufferTexture2D_hook(GLenum target, GLenum attachment, GLenum textarget, GLuint tex_id, GLint level) {
-    if (attachment == GL_COLOR_ATTACHMENT0) {
-		printf("COLOR_ATTACHMENT %x\n", target);
-        glFramebufferTexture2D(target, attachment, textarget, tex_id, level);
-	} else {
-		printf("DEPTH_ATTACHMENT %x\n", target);
-		GLuint gDepthMap;
-		//glGenTextures(1, &gDepthMap);
-		glBindTexture(GL_TEXTURE_2D, tex_id);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 960, 544, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-		glFramebufferTexture2D(target, GL_COLOR_ATTACHMENT0, textarget, tex_id, level);
-		/*GLuint depthBuffer;
-		glGenRenderbuffers(1, &depthBuffer);
-		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, 960, 544);
-		glFramebufferRenderbuffer(target, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
-		glBindTexture(GL_TEXTURE_2D, tex_id);
-		vglFree(vglGetTexDataPointer(GL_TEXTURE_2D)); // We free then its texture data
-		vglTexImageDepthBuffer(GL_TEXTURE_2D); // Last we replace the texture data with a pointer to the depth buffer*/
-	}
-}
-
-void glBindFramebuffer_hook(GLenum target, GLuint framebuffer) {
-	//printf("glBindFramebuffer %x %x\n", target, framebuffer);
-	glBindFramebuffer(target, framebuffer);
-}
-
-void glViewport_hook(GLint x, GLint y, GLsizei width, GLsizei height) {
-	//printf("glViewport %d %d %u %u\n", x, y, width, height);
-	glViewport(0, 0, 960, 544);
-}
-
 static so_default_dynlib default_dynlib[] = {
 	{ "glViewport", (uintptr_t)&glViewport_hook},
 	{ "glBindFramebuffer", (uintptr_t)&glBindFramebuffer_hook},
 	{ "glFramebufferTexture2D", (uintptr_t)&glFramebufferTexture2D_hook},
 	{ "glCompileShader", (uintptr_t)&ret0},
+	{ "glCreateShader", (uintptr_t)&glCreateShader_hook},
+	{ "glAttachShader", (uintptr_t)&glAttachShader_hook},
+	{ "glBindAttribLocation", (uintptr_t)&glBindAttribLocation_hook},
+	{ "glLinkProgram", (uintptr_t)&glLinkProgram_hook},
+	{ "glDeleteProgram", (uintptr_t)&glDeleteProgram_hook},
+	{ "glUseProgram", (uintptr_t)&glUseProgram_hook},
+	{ "glGetProgramiv", (uintptr_t)&glGetProgramiv_hook},
+	{ "glGetProgramInfoLog", (uintptr_t)&glGetProgramInfoLog_hook},
+	{ "glGetUniformLocation", (uintptr_t)&glGetUniformLocation_hook},
+	{ "glGetAttribLocation", (uintptr_t)&glGetAttribLocation_hook},
+	{ "glGetActiveUniform", (uintptr_t)&glGetActiveUniform_hook},
+	{ "glGetActiveAttrib", (uintptr_t)&glGetActiveAttrib_hook},
+	{ "glValidateProgram", (uintptr_t)&glValidateProgram_hook},
+	{ "glUniformMatrix4fv", (uintptr_t)&glUniformMatrix4fv_hook},
+	{ "glDrawArrays", (uintptr_t)&glDrawArrays_hook},
+	{ "glDrawElements", (uintptr_t)&glDrawElements_hook},
+	{ "glActiveTexture", (uintptr_t)&glActiveTexture_hook},
+	{ "glBindTexture", (uintptr_t)&glBindTexture_hook},
+	{ "glDeleteTextures", (uintptr_t)&glDeleteTextures_hook},
+	{ "glDeleteFramebuffers", (uintptr_t)&glDeleteFramebuffers_hook},
+	{ "glEnable", (uintptr_t)&glEnable_hook},
+	{ "glDisable", (uintptr_t)&glDisable_hook},
+	{ "glBlendFunc", (uintptr_t)&glBlendFunc_hook},
+	{ "glBlendFuncSeparate", (uintptr_t)&glBlendFuncSeparate_hook},
+	{ "glBlendEquation", (uintptr_t)&glBlendEquation_hook},
+	{ "glBlendEquationSeparate", (uintptr_t)&glBlendEquationSeparate_hook},
+	{ "glBlendColor", (uintptr_t)&glBlendColor_hook},
+	{ "glBindBuffer", (uintptr_t)&glBindBuffer_hook},
+	{ "glBufferData", (uintptr_t)&glBufferData_hook},
+	{ "glBufferSubData", (uintptr_t)&glBufferSubData_hook},
+	{ "glDeleteBuffers", (uintptr_t)&glDeleteBuffers_hook},
+	{ "glVertexAttribPointer", (uintptr_t)&glVertexAttribPointer_hook},
+	{ "glEnableVertexAttribArray", (uintptr_t)&glEnableVertexAttribArray_hook},
+	{ "glDisableVertexAttribArray", (uintptr_t)&glDisableVertexAttribArray_hook},
+	{ "glUniform1i", (uintptr_t)&glUniform1i_hook},
+	{ "glUniform1f", (uintptr_t)&glUniform1f_hook},
+	{ "glUniform2f", (uintptr_t)&glUniform2f_hook},
+	{ "glUniform2fv", (uintptr_t)&glUniform2fv_hook},
+	{ "glUniform1fv", (uintptr_t)&glUniform1fv_hook},
+	{ "glUniform1iv", (uintptr_t)&glUniform1iv_hook},
+	{ "glUniform3f", (uintptr_t)&glUniform3f_hook},
+	{ "glUniform3fv", (uintptr_t)&glUniform3fv_hook},
+	{ "glUniform4f", (uintptr_t)&glUniform4f_hook},
+	{ "glUniform4fv", (uintptr_t)&glUniform4fv_hook},
+	{ "glUniformMatrix3fv", (uintptr_t)&glUniformMatrix3fv_hook},
+	{ "glClear", (uintptr_t)&glClear_hook},
+	{ "glScissor", (uintptr_t)&glScissor_hook},
+	{ "glDepthMask", (uintptr_t)&glDepthMask_hook},
+	{ "glColorMask", (uintptr_t)&glColorMask_hook},
+	{ "glDepthFunc", (uintptr_t)&glDepthFunc_hook},
+	{ "glCullFace", (uintptr_t)&glCullFace_hook},
+	{ "glTexImage2D", (uintptr_t)&glTexImage2D_hook},
+	{ "glTexSubImage2D", (uintptr_t)&glTexSubImage2D_hook},
+	{ "glTexParameteri", (uintptr_t)&glTexParameteri_hook},
+	{ "glReadPixels", (uintptr_t)&glReadPixels_hook},
+	{ "glFinish", (uintptr_t)&glFinish_hook},
 	{ "newlocale", (uintptr_t)&newlocale},
 	{ "uselocale", (uintptr_t)&uselocale},
 	{ "freelocale", (uintptr_t)&freelocale},
@@ -1440,22 +1600,22 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_AddTimer", (uintptr_t)&SDL_AddTimer },
 	{ "SDL_CondSignal", (uintptr_t)&SDL_CondSignal },
 	{ "SDL_CondWait", (uintptr_t)&SDL_CondWait },
-	{ "SDL_ConvertSurfaceFormat", (uintptr_t)&SDL_ConvertSurfaceFormat },
+	{ "SDL_ConvertSurfaceFormat", (uintptr_t)&SDL_ConvertSurfaceFormat_hook },
 	{ "SDL_CreateCond", (uintptr_t)&SDL_CreateCond },
 	{ "SDL_CreateMutex", (uintptr_t)&SDL_CreateMutex },
-	{ "SDL_CreateRenderer", (uintptr_t)&SDL_CreateRenderer },
+	{ "SDL_CreateRenderer", (uintptr_t)&SDL_CreateRenderer_hook },
 	{ "SDL_CreateRGBSurface", (uintptr_t)&SDL_CreateRGBSurface },
-	{ "SDL_CreateTexture", (uintptr_t)&SDL_CreateTexture },
-	{ "SDL_CreateTextureFromSurface", (uintptr_t)&SDL_CreateTextureFromSurface },
+	{ "SDL_CreateTexture", (uintptr_t)&SDL_CreateTexture_hook },
+	{ "SDL_CreateTextureFromSurface", (uintptr_t)&SDL_CreateTextureFromSurface_hook },
 	{ "SDL_CreateThread", (uintptr_t)&SDL_CreateThread_fake },
 	{ "SDL_CreateWindow", (uintptr_t)&SDL_CreateWindow_hook },
 	{ "SDL_Delay", (uintptr_t)&SDL_Delay },
 	{ "SDL_DestroyMutex", (uintptr_t)&SDL_DestroyMutex },
 	{ "SDL_DestroyRenderer", (uintptr_t)&SDL_DestroyRenderer },
-	{ "SDL_DestroyTexture", (uintptr_t)&SDL_DestroyTexture },
+	{ "SDL_DestroyTexture", (uintptr_t)&SDL_DestroyTexture_hook },
 	{ "SDL_DestroyWindow", (uintptr_t)&SDL_DestroyWindow },
-	{ "SDL_FillRect", (uintptr_t)&SDL_FillRect },
-	{ "SDL_FreeSurface", (uintptr_t)&SDL_FreeSurface },
+	{ "SDL_FillRect", (uintptr_t)&SDL_FillRect_hook },
+	{ "SDL_FreeSurface", (uintptr_t)&SDL_FreeSurface_hook },
 	{ "SDL_GetCurrentDisplayMode", (uintptr_t)&SDL_GetCurrentDisplayMode },
 	{ "SDL_GetDisplayMode", (uintptr_t)&SDL_GetDisplayMode },
 	{ "SDL_GetError", (uintptr_t)&SDL_GetError },
@@ -1465,9 +1625,9 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_GameControllerAddMappingsFromRW", (uintptr_t)&SDL_GameControllerAddMappingsFromRW },
 	{ "SDL_GetNumDisplayModes", (uintptr_t)&SDL_GetNumDisplayModes },
 	{ "SDL_GetRendererInfo", (uintptr_t)&SDL_GetRendererInfo },
-	{ "SDL_GetTextureBlendMode", (uintptr_t)&SDL_GetTextureBlendMode },
+	{ "SDL_GetTextureBlendMode", (uintptr_t)&SDL_GetTextureBlendMode_hook },
 	{ "SDL_GetPrefPath", (uintptr_t)&SDL_GetPrefPath },
-	{ "SDL_GetTextureColorMod", (uintptr_t)&SDL_GetTextureColorMod },
+	{ "SDL_GetTextureColorMod", (uintptr_t)&SDL_GetTextureColorMod_hook },
 	{ "SDL_GetDisplayDPI", (uintptr_t)&SDL_GetDisplayDPI },
 	{ "SDL_GetClipboardText", (uintptr_t)&SDL_GetClipboardText },
 	{ "SDL_SetClipboardText", (uintptr_t)&SDL_SetClipboardText },
@@ -1481,7 +1641,7 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_GetCPUCount", (uintptr_t)&SDL_GetCPUCount },
 	{ "SDL_GetTicks", (uintptr_t)&SDL_GetTicks },
 	{ "SDL_GetVersion", (uintptr_t)&SDL_GetVersion_fake },
-	{ "SDL_GL_BindTexture", (uintptr_t)&SDL_GL_BindTexture },
+	{ "SDL_GL_BindTexture", (uintptr_t)&SDL_GL_BindTexture_hook },
 	{ "SDL_GL_GetCurrentContext", (uintptr_t)&SDL_GL_GetCurrentContext },
 	{ "SDL_GL_MakeCurrent", (uintptr_t)&SDL_GL_MakeCurrent },
 	{ "SDL_GL_SetAttribute", (uintptr_t)&SDL_GL_SetAttribute },
@@ -1489,7 +1649,7 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_InitSubSystem", (uintptr_t)&SDL_InitSubSystem },
 	{ "SDL_IntersectRect", (uintptr_t)&SDL_IntersectRect },
 	{ "SDL_LockMutex", (uintptr_t)&SDL_LockMutex },
-	{ "SDL_LockSurface", (uintptr_t)&SDL_LockSurface },
+	{ "SDL_LockSurface", (uintptr_t)&SDL_LockSurface_hook },
 	{ "SDL_memcpy", (uintptr_t)&SDL_memcpy },
 	{ "SDL_Log", (uintptr_t)&ret0 },
 	{ "SDL_LogError", (uintptr_t)&ret0 },
@@ -1502,13 +1662,13 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_PumpEvents", (uintptr_t)&SDL_PumpEvents },
 	{ "SDL_PushEvent", (uintptr_t)&SDL_PushEvent },
 	{ "SDL_PollEvent", (uintptr_t)&SDL_PollEvent_hook },
-	{ "SDL_QueryTexture", (uintptr_t)&SDL_QueryTexture },
+	{ "SDL_QueryTexture", (uintptr_t)&SDL_QueryTexture_hook },
 	{ "SDL_Quit", (uintptr_t)&SDL_Quit },
 	{ "SDL_RemoveTimer", (uintptr_t)&SDL_RemoveTimer },
-	{ "SDL_RenderClear", (uintptr_t)&SDL_RenderClear },
-	{ "SDL_RenderCopy", (uintptr_t)&SDL_RenderCopy },
-	{ "SDL_RenderFillRect", (uintptr_t)&SDL_RenderFillRect },
-	{ "SDL_RenderPresent", (uintptr_t)&SDL_RenderPresent },
+	{ "SDL_RenderClear", (uintptr_t)&SDL_RenderClear_hook },
+	{ "SDL_RenderCopy", (uintptr_t)&SDL_RenderCopy_hook },
+	{ "SDL_RenderFillRect", (uintptr_t)&SDL_RenderFillRect_hook },
+	{ "SDL_RenderPresent", (uintptr_t)&SDL_RenderPresent_hook },
 	{ "SDL_RWFromFile", (uintptr_t)&SDL_RWFromFile_hook },
 	{ "SDL_RWread", (uintptr_t)&SDL_RWread },
 	{ "SDL_RWwrite", (uintptr_t)&SDL_RWwrite },
@@ -1521,9 +1681,9 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_SetMainReady_REAL", (uintptr_t)&SDL_SetMainReady },
 	{ "SDL_SetRenderDrawBlendMode", (uintptr_t)&SDL_SetRenderDrawBlendMode },
 	{ "SDL_SetRenderDrawColor", (uintptr_t)&SDL_SetRenderDrawColor },
-	{ "SDL_SetRenderTarget", (uintptr_t)&SDL_SetRenderTarget },
-	{ "SDL_SetTextureBlendMode", (uintptr_t)&SDL_SetTextureBlendMode },
-	{ "SDL_SetTextureColorMod", (uintptr_t)&SDL_SetTextureColorMod },
+	{ "SDL_SetRenderTarget", (uintptr_t)&SDL_SetRenderTarget_hook },
+	{ "SDL_SetTextureBlendMode", (uintptr_t)&SDL_SetTextureBlendMode_hook },
+	{ "SDL_SetTextureColorMod", (uintptr_t)&SDL_SetTextureColorMod_hook },
 	{ "SDL_ShowCursor", (uintptr_t)&SDL_ShowCursor },
 	{ "SDL_ShowSimpleMessageBox", (uintptr_t)&SDL_ShowSimpleMessageBox },
 	{ "SDL_StartTextInput", (uintptr_t)&SDL_StartTextInput },
@@ -1531,8 +1691,8 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_strdup", (uintptr_t)&SDL_strdup },
 	{ "SDL_UnlockMutex", (uintptr_t)&SDL_UnlockMutex },
 	{ "SDL_UnlockSurface", (uintptr_t)&SDL_UnlockSurface },
-	{ "SDL_UpdateTexture", (uintptr_t)&SDL_UpdateTexture },
-	{ "SDL_UpperBlit", (uintptr_t)&SDL_UpperBlit },
+	{ "SDL_UpdateTexture", (uintptr_t)&SDL_UpdateTexture_hook },
+	{ "SDL_UpperBlit", (uintptr_t)&SDL_UpperBlit_hook },
 	{ "SDL_WaitThread", (uintptr_t)&SDL_WaitThread_fake },
 	{ "SDL_GetKeyFromScancode", (uintptr_t)&SDL_GetKeyFromScancode },
 	{ "SDL_GetNumVideoDisplays", (uintptr_t)&SDL_GetNumVideoDisplays },
@@ -1573,18 +1733,18 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_JoystickGetDeviceGUID", (uintptr_t)&SDL_JoystickGetDeviceGUID },
 	{ "SDL_GameControllerNameForIndex", (uintptr_t)&SDL_GameControllerNameForIndex },
 	{ "SDL_GetWindowFromID", (uintptr_t)&SDL_GetWindowFromID },
-	{ "SDL_GL_SwapWindow", (uintptr_t)&SDL_GL_SwapWindow },
+	{ "SDL_GL_SwapWindow", (uintptr_t)&SDL_GL_SwapWindow_hook },
 	{ "SDL_SetMainReady", (uintptr_t)&SDL_SetMainReady },
 	{ "SDL_NumAccelerometers", (uintptr_t)&ret0 },
 	{ "SDL_AndroidGetJNIEnv", (uintptr_t)&Android_JNI_GetEnv },
 	{ "Android_JNI_GetEnv", (uintptr_t)&Android_JNI_GetEnv },
 	{ "SDL_RWFromConstMem", (uintptr_t)&SDL_RWFromConstMem },
-	{ "SDL_ConvertSurface", (uintptr_t)&SDL_ConvertSurface },
+	{ "SDL_ConvertSurface", (uintptr_t)&SDL_ConvertSurface_hook },
 	{ "SDL_SetError", (uintptr_t)&SDL_SetError },
 	{ "SDL_MapRGBA", (uintptr_t)&SDL_MapRGBA },
 	{ "SDL_EventState", (uintptr_t)&SDL_EventState },
 	{ "SDL_SetSurfaceBlendMode", (uintptr_t)&SDL_SetSurfaceBlendMode },
-	{ "SDL_UpperBlitScaled", (uintptr_t)&SDL_UpperBlitScaled },
+	{ "SDL_UpperBlitScaled", (uintptr_t)&SDL_UpperBlitScaled_hook },
 	{ "SDL_FreeRW", (uintptr_t)&SDL_FreeRW },
 	{ "SDL_GetKeyboardState", (uintptr_t)&SDL_GetKeyboardState },
 	{ "SDL_JoystickNumAxes", (uintptr_t)&ret4 },
@@ -1704,7 +1864,7 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_GetNumVideoDrivers", (uintptr_t)&SDL_GetNumVideoDrivers },
 	{ "SDL_GetVideoDriver", (uintptr_t)&SDL_GetVideoDriver },
 	{ "SDL_GetBasePath", (uintptr_t)&SDL_GetBasePath_hook },
-	{ "SDL_RenderReadPixels", (uintptr_t)&SDL_RenderReadPixels },
+	{ "SDL_RenderReadPixels", (uintptr_t)&SDL_RenderReadPixels_hook },
 	{ "SDL_CreateRGBSurfaceFrom", (uintptr_t)&SDL_CreateRGBSurfaceFrom },
 	{ "SDL_SetWindowBordered", (uintptr_t)&SDL_SetWindowBordered },
 	{ "SDL_RestoreWindow", (uintptr_t)&SDL_RestoreWindow },
@@ -1938,110 +2098,11 @@ int crasher(unsigned int argc, void *argv) {
 	}
 }
 
-const char *simple_shd_vp = R"(
-	attribute vec4 a_Location;
-	attribute vec4 a_Color;
-	uniform mat4 u_Projection;
-	uniform mat4 u_View;
-	uniform mat4 u_Model;
-	varying vec4 var_color;
-	void main() {
-		gl_Position =  u_Projection * u_View * u_Model * a_Location;
-		var_color = a_Color;
-	}
-)";
-
-const char *depth_fp = R"(
-	void main() {
-		gl_FragDepth =  gl_FragCoord.z;
-	}
-)";
-
-const char *simple_shd_fp = R"(
-	varying vec4 var_color;
-	void main() {
-		gl_FragColor =  var_color;
-	}
-)";
-
-const char *vp_3d = R"(
-	attribute vec4 a_Location;                              
-    attribute vec3 a_Normal;                                
-    attribute vec2 a_TexCoords;                             
-    uniform mat4 u_Projection;                                     
-    uniform mat4 u_View;                                      
-    uniform mat4 u_Model;                                      
-    uniform mat4 u_DepthMVP;                                
-    varying vec3 var_normal;                                
-    varying vec3 var_worldPos;                       
-    varying vec2 var_texCoords;                             
-    varying vec4 var_shadowLoc;                             
-    void main(void)                                         
-	{                                                       
-        var_texCoords = a_TexCoords;         
-        var_worldPos = vec3(u_Model * a_Location);           
-        var_normal = mat3(u_Model) * a_Normal;               
-        gl_Position =  u_Projection * u_View * vec4(var_worldPos, 1.0);         
-        var_shadowLoc = u_DepthMVP * a_Location;      
-})";                                                    
-
-const char *vp_2d = R"(
-	attribute vec2 a_Location;
-	attribute vec2 a_TexCoords;
-	attribute vec4 a_Color;
-	uniform vec2 u_WH;
-	uniform float u_Zoom;
-	uniform vec2 u_CamPos;
-	varying vec4 var_color;
-	varying vec2 var_TexCoords;
-	void main() {
-		gl_Position =  vec4((a_Location - u_CamPos) / (u_WH * 0.5) * u_Zoom, 0.0, 1.0);
-		var_color = a_Color;
-		var_TexCoords = a_TexCoords;
-	}
-)";
-
-const char *fp_2d = R"(
-	varying vec4 var_color;
-	varying vec2 var_TexCoords;
-	uniform int u_UseTexture;
-	uniform sampler2D u_Texture;
-	void main() {
-		vec4 texColor = vec4(1.0, 1.0, 1.0, 1.0);
-		if (u_UseTexture>0)
-			texColor = texture2D( u_Texture, var_TexCoords );
-		gl_FragColor = texColor * var_color;
-	}
-)";
-
 so_hook shd_prog;
 void *ShaderProgram(void *this, const char *vp, const char *fp) {
-	// Game has a brainfart and attempts to use GLSL ES 3.00 shader even if it has a GLSL ES 1.3 variant
-	if (fp == rrm_mod.text_base + 0x000BF5E9) {
-		printf("Patching fp from 0x000BF5E9 (3.00 -> 1.00)\n");
-		fp = rrm_mod.text_base + 0x000C5022;
-	}
-	if (fp == rrm_mod.text_base + 0x000DFD3C) {
-		printf("Patching fp from 0x000DFD3C (3.00 -> 1.00)\n");
-		fp = rrm_mod.text_base + 0x000C5022;
-	}
-	if (vp == rrm_mod.text_base + 0x000D2EC1) {
-		printf("Patching 2D shaders (2D)\n");
-		vp = vp_2d;
-		fp = fp_2d;
-	}
-	if (vp == rrm_mod.text_base + 0x000D3CC2 || fp == rrm_mod.text_base + 0x000D3CC2) {
-		printf("Patching from 0x000D3CC2 (Simple)\n");
-		vp = simple_shd_vp;
-		fp = simple_shd_fp;
-	}
-	if (fp == rrm_mod.text_base + 0x000E4722) {
-		printf("Patching fp from 0x000E4722 (Depth Replace)\n");
-		fp = depth_fp;
-	}
-	if (vp == rrm_mod.text_base + 0x000D264F ) {
-		printf("Patching vp from 0x000D264F (Mesh Vertex)\n");
-		vp = vp_3d;
+	for (int i = 0; i < sizeof(shader_patches) / sizeof(*shader_patches); i++) {
+		if (apply_shader_patch(rrm_mod.text_base, &shader_patches[i], &vp, &fp))
+			printf("Patching shaders: %s\n", shader_patches[i].desc);
 	}
 	return SO_CONTINUE(void *, shd_prog, this, vp, fp);
 }
@@ -2055,12 +2116,19 @@ void patch_game(void) {
 	hook_addr((uintptr_t)so_symbol(&rrm_mod, "__cxa_guard_acquire"), (uintptr_t)&__cxa_guard_acquire);
 	hook_addr((uintptr_t)so_symbol(&rrm_mod, "__cxa_guard_release"), (uintptr_t)&__cxa_guard_release);
 	//hook_addr((uintptr_t)so_symbol(&rrm_mod, "__cxa_guard_abort"), (uintptr_t)&__cxa_guard_abort);
+	
+	ttf_cache_patch(&rrm_mod);
+	glyph_atlas_patch(&rrm_mod);
 }
 
 void *pthread_main(void *arg) {
 	char fname[256];
 	sprintf(data_path, "ux0:data/rrm");
 
+	settings_load();
+	image_cache_init();
+	gl_capture_install(default_dynlib, sizeof(default_dynlib) / sizeof(*default_dynlib));
+
 	printf("Loading libc++_shared\n");
 	sprintf(fname, "%s/libc++_shared.so", data_path);
 	if (so_file_load(&cpp_mod, fname, 0x98000000) < 0)
@@ -2079,6 +2147,7 @@ void *pthread_main(void *arg) {
 	
 	vglSetupRuntimeShaderCompiler(SHARK_OPT_UNSAFE, SHARK_ENABLE, SHARK_ENABLE, SHARK_ENABLE);
 	vglInitExtended(0, SCREEN_W, SCREEN_H, MEMORY_VITAGL_THRESHOLD_MB * 1024 * 1024, SCE_GXM_MULTISAMPLE_NONE);
+	gl_state_invalidate();
 	
 	patch_game();
 	so_flush_caches(&rrm_mod);
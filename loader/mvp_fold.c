@@ -0,0 +1,171 @@
+/* mvp_fold.c -- CPU side MVP pre-multiplication for the replacement 3D shaders
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * vp_3d and simple_shd_vp only expose u_MVP (plus u_Model and u_NormalMatrix
+ * for lighting), while the game keeps setting u_Projection, u_View and u_Model.
+ * Those three are handed out as fake locations, shadowed on the CPU and folded
+ * into a single matrix right before a draw if any of them changed.
+ */
+
+#include <vitaGL.h>
+#include <math_neon.h>
+
+#include <string.h>
+
+#include "batch2d.h"
+#include "mvp_fold.h"
+#include "stats.h"
+#include "uniform_cache.h"
+
+#define MAX_FOLDED_PROGRAMS 16
+
+enum {
+	MATRIX_PROJECTION,
+	MATRIX_VIEW,
+	MATRIX_MODEL,
+	MATRIX_NUM
+};
+
+// Never returned by vitaGL, uniform locations are either -1 or pointers in user memory
+#define FAKE_LOCATION_BASE (-0x100)
+
+static const char *folded_names[MATRIX_NUM] = {
+	"u_Projection",
+	"u_View",
+	"u_Model"
+};
+
+typedef struct {
+	GLuint prog;
+	GLint mvp_loc;
+	GLint model_loc;
+	GLint normal_loc;
+	float m[MATRIX_NUM][16];
+	float pv[16];
+	uint8_t pv_dirty;
+	uint8_t dirty;
+} folded_program;
+
+static folded_program folded[MAX_FOLDED_PROGRAMS];
+static int folded_num = 0;
+static folded_program *cur = NULL;
+
+static const float identity[16] = {
+	1.0f, 0.0f, 0.0f, 0.0f,
+	0.0f, 1.0f, 0.0f, 0.0f,
+	0.0f, 0.0f, 1.0f, 0.0f,
+	0.0f, 0.0f, 0.0f, 1.0f
+};
+
+static folded_program *find_program(GLuint prog) {
+	for (int i = 0; i < folded_num; i++) {
+		if (folded[i].prog == prog)
+			return &folded[i];
+	}
+	return NULL;
+}
+
+void mvp_fold_use_program(GLuint program) {
+	cur = find_program(program);
+}
+
+void mvp_fold_forget_program(GLuint program) {
+	folded_program *p = find_program(program);
+	if (!p)
+		return;
+	// A reused id must not pick up the old locations
+	folded_program *last = &folded[--folded_num];
+	if (cur == p)
+		cur = NULL;
+	else if (cur == last)
+		cur = p;
+	*p = *last;
+}
+
+GLint mvp_fold_get_uniform_location(GLuint program, const GLchar *name) {
+	int idx;
+	for (idx = 0; idx < MATRIX_NUM; idx++) {
+		if (!strcmp(name, folded_names[idx]))
+			break;
+	}
+	if (idx == MATRIX_NUM)
+		return glGetUniformLocation(program, name);
+
+	folded_program *p = find_program(program);
+	if (!p) {
+		GLint mvp_loc = glGetUniformLocation(program, "u_MVP");
+		if (mvp_loc == -1 || folded_num == MAX_FOLDED_PROGRAMS)
+			return glGetUniformLocation(program, name);
+
+		p = &folded[folded_num++];
+		p->prog = program;
+		p->mvp_loc = mvp_loc;
+		p->model_loc = glGetUniformLocation(program, "u_Model");
+		p->normal_loc = glGetUniformLocation(program, "u_NormalMatrix");
+		for (int i = 0; i < MATRIX_NUM; i++)
+			memcpy(p->m[i], identity, sizeof(identity));
+		p->pv_dirty = 1;
+		p->dirty = 1;
+	}
+
+	return FAKE_LOCATION_BASE - idx;
+}
+
+void mvp_fold_flush(void) {
+	if (!cur || !cur->dirty)
+		return;
+
+	if (cur->pv_dirty) {
+		matmul4_neon(cur->m[MATRIX_PROJECTION], cur->m[MATRIX_VIEW], cur->pv);
+		cur->pv_dirty = 0;
+	}
+
+	float mvp[16];
+	matmul4_neon(cur->pv, cur->m[MATRIX_MODEL], mvp);
+	if (!uniform_cache_unchanged(cur->mvp_loc, mvp, sizeof(mvp)))
+		glUniformMatrix4fv(cur->mvp_loc, 1, GL_FALSE, mvp);
+
+	if (cur->model_loc != -1 && !uniform_cache_unchanged(cur->model_loc, cur->m[MATRIX_MODEL], sizeof(cur->m[MATRIX_MODEL])))
+		glUniformMatrix4fv(cur->model_loc, 1, GL_FALSE, cur->m[MATRIX_MODEL]);
+	if (cur->normal_loc != -1) {
+		const float *m = cur->m[MATRIX_MODEL];
+		float normal[9] = {
+			m[0], m[1], m[2],
+			m[4], m[5], m[6],
+			m[8], m[9], m[10]
+		};
+		if (!uniform_cache_unchanged(cur->normal_loc, normal, sizeof(normal)))
+			glUniformMatrix3fv(cur->normal_loc, 1, GL_FALSE, normal);
+	}
+
+	cur->dirty = 0;
+}
+
+void glUniformMatrix4fv_hook(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
+	if (location > FAKE_LOCATION_BASE || location <= FAKE_LOCATION_BASE - MATRIX_NUM) {
+		if (!transpose && uniform_cache_unchanged(location, value, count * sizeof(GLfloat) * 16))
+			return;
+		batch2d_flush();
+		glUniformMatrix4fv(location, count, transpose, value);
+		return;
+	}
+
+	if (!cur)
+		return;
+
+	// Shadowed matrices don't reach vitaGL, but an unchanged one must not mark the fold dirty either
+	int idx = FAKE_LOCATION_BASE - location;
+	stats_cur.uniform_calls++;
+	if (uniform_cache_mat4_equal(cur->m[idx], value)) {
+		stats_cur.uniform_elided++;
+		return;
+	}
+	memcpy(cur->m[idx], value, sizeof(cur->m[idx]));
+	if (idx != MATRIX_MODEL)
+		cur->pv_dirty = 1;
+	cur->dirty = 1;
+}
@@ -0,0 +1,13 @@
+#ifndef __MVP_FOLD_H__
+#define __MVP_FOLD_H__
+
+#include <vitaGL.h>
+
+void mvp_fold_use_program(GLuint program);
+void mvp_fold_forget_program(GLuint program);
+GLint mvp_fold_get_uniform_location(GLuint program, const GLchar *name);
+void mvp_fold_flush(void);
+
+void glUniformMatrix4fv_hook(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+
+#endif
@@ -0,0 +1,182 @@
+/* overlay.cpp -- imgui performance overlay
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Drawn on top of the frame right before it gets swapped, shown and hidden
+ * by holding OVERLAY_COMBO. imgui only draws, the pad and touch stay the
+ * game's. Thread CPU usage is sampled every THREAD_SAMPLE_FRAMES frames for
+ * the threads passed through overlay_register_thread.
+ */
+
+#include <vitaGL.h>
+#include <imgui_vita.h>
+#include <psp2/ctrl.h>
+#include <psp2/kernel/processmgr.h>
+#include <psp2/kernel/threadmgr.h>
+
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+
+extern "C" {
+#include "config.h"
+#include "gl_state.h"
+#include "batch2d.h"
+#include "overlay.h"
+#include "render_target.h"
+#include "stats.h"
+
+extern int _newlib_heap_size_user;
+}
+
+#define OVERLAY_COMBO (SCE_CTRL_LTRIGGER | SCE_CTRL_RTRIGGER | SCE_CTRL_SELECT)
+#define FRAME_GRAPH_LEN 120
+#define MAX_THREADS 32
+#define THREAD_SAMPLE_FRAMES 30
+
+typedef struct {
+	SceUID id;
+	char name[32];
+	uint64_t last_clocks;
+	float usage;
+} thread_entry;
+
+static int visible = 0, initialized = 0;
+static uint32_t last_buttons = 0;
+
+static float frame_ms[FRAME_GRAPH_LEN];
+static int frame_next = 0;
+static uint64_t last_frame = 0;
+
+static thread_entry threads[MAX_THREADS];
+static volatile int threads_num = 0;
+static int main_registered = 0;
+static int sample_frames = 0;
+static uint64_t sample_start = 0;
+
+static frame_stats totals;
+
+void overlay_register_thread(void) {
+	int i = __sync_fetch_and_add(&threads_num, 1);
+	if (i >= MAX_THREADS) {
+		threads_num = MAX_THREADS;
+		return;
+	}
+	threads[i].id = sceKernelGetThreadId();
+}
+
+static void sample_threads(void) {
+	uint64_t now = sceKernelGetProcessTimeWide();
+	uint64_t elapsed = now - sample_start;
+	sample_start = now;
+	for (int i = 0; i < threads_num && i < MAX_THREADS; i++) {
+		thread_entry *t = &threads[i];
+		SceKernelThreadInfo info;
+		info.size = sizeof(info);
+		if (!t->id || sceKernelGetThreadInfo(t->id, &info) < 0) {
+			// Exited
+			t->id = 0;
+			continue;
+		}
+		uint64_t clocks = info.runClocks;
+		if (t->last_clocks && elapsed)
+			t->usage = (clocks - t->last_clocks) * 100.0f / elapsed;
+		t->last_clocks = clocks;
+		strncpy(t->name, info.name, sizeof(t->name) - 1);
+	}
+}
+
+static void draw(void) {
+	ImGui_ImplVitaGL_NewFrame();
+	ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_Always);
+	ImGui::SetNextWindowBgAlpha(0.6f);
+	ImGui::Begin("Performance", NULL, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove |
+		ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize |
+		ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoInputs);
+
+	char label[32];
+	snprintf(label, sizeof(label), "%.1f ms", frame_ms[(frame_next + FRAME_GRAPH_LEN - 1) % FRAME_GRAPH_LEN]);
+	ImGui::PlotLines("##frametime", frame_ms, FRAME_GRAPH_LEN, frame_next, label, 0.0f, 50.0f, ImVec2(300, 60));
+
+	ImGui::Text("Draws: %u (%u after batching)", stats_last.draws, stats_last.draws_issued);
+	ImGui::Text("State changes: %u (%u elided)", stats_last.state_calls - stats_last.state_elided, stats_last.state_elided);
+	ImGui::Text("SDL renderer: %u draws (%u after batching)", stats_last.render_draws, stats_last.render_flushes);
+	ImGui::Text("Uniform uploads: %u (%u elided)", stats_last.uniform_calls - stats_last.uniform_elided, stats_last.uniform_elided);
+	ImGui::Text("Streamed: %.1f KB", stats_last.stream_bytes / 1024.0f);
+	ImGui::Text("Text cache: %u hits, %u misses", stats_last.text_hits, stats_last.text_misses);
+	ImGui::Text("Shader cache: %u hits, %u misses", totals.shader_hits, totals.shader_misses);
+	ImGui::Text("Program cache: %u hits, %u links", totals.program_hits, totals.program_links);
+	ImGui::Separator();
+
+	uint32_t vram_total = vglMemTotal(VGL_MEM_VRAM), ram_total = vglMemTotal(VGL_MEM_RAM);
+	ImGui::Text("VRAM used: %u KB (%u KB render targets), %u atlas pages",
+		(uint32_t)(vram_total - vglMemFree(VGL_MEM_VRAM)) / 1024, render_target_memory() / 1024, stats_last.atlas_pages);
+	struct mallinfo mi = mallinfo();
+	ImGui::Text("newlib heap: %u / %u KB", (uint32_t)mi.uordblks / 1024, (uint32_t)_newlib_heap_size_user / 1024);
+	ImGui::Text("vitaGL heap: %u / %u KB (VRAM %u KB)", (uint32_t)(ram_total - vglMemFree(VGL_MEM_RAM)) / 1024, ram_total / 1024, vram_total / 1024);
+	ImGui::Separator();
+
+	for (int i = 0; i < threads_num && i < MAX_THREADS; i++) {
+		if (threads[i].id)
+			ImGui::Text("%-24s %5.1f%%", threads[i].name, threads[i].usage);
+	}
+	ImGui::End();
+
+	ImGui::Render();
+	ImGui_ImplVitaGL_RenderDrawData(ImGui::GetDrawData());
+}
+
+void overlay_frame(void) {
+	if (!main_registered) {
+		overlay_register_thread();
+		main_registered = 1;
+	}
+
+	uint64_t now = sceKernelGetProcessTimeWide();
+	if (last_frame) {
+		frame_ms[frame_next] = (now - last_frame) / 1000.0f;
+		frame_next = (frame_next + 1) % FRAME_GRAPH_LEN;
+	}
+	last_frame = now;
+
+	totals.shader_hits += stats_last.shader_hits;
+	totals.shader_misses += stats_last.shader_misses;
+	totals.program_hits += stats_last.program_hits;
+	totals.program_links += stats_last.program_links;
+
+	SceCtrlData pad;
+	sceCtrlPeekBufferPositive(0, &pad, 1);
+	uint32_t combo = pad.buttons & OVERLAY_COMBO;
+	if (combo == OVERLAY_COMBO && (last_buttons & OVERLAY_COMBO) != OVERLAY_COMBO) {
+		visible = !visible;
+		printf("[Overlay] %s\n", visible ? "Shown" : "Hidden");
+	}
+	last_buttons = pad.buttons;
+	if (!visible)
+		return;
+
+	if (!initialized) {
+		ImGui::CreateContext();
+		ImGui::GetIO().IniFilename = NULL;
+		ImGui_ImplVitaGL_Init();
+		ImGui_ImplVitaGL_TouchUsage(false);
+		ImGui_ImplVitaGL_GamepadUsage(false);
+		ImGui_ImplVitaGL_MouseStickUsage(false);
+		ImGui::StyleColorsDark();
+		initialized = 1;
+	}
+
+	if (++sample_frames >= THREAD_SAMPLE_FRAMES) {
+		sample_threads();
+		sample_frames = 0;
+	}
+
+	gl_state_push();
+	gl_state_bind_framebuffer(GL_FRAMEBUFFER, 0);
+	draw();
+	batch2d_restore_attribs(0xFFFFFFFF);
+	gl_state_pop();
+}
@@ -0,0 +1,15 @@
+#ifndef __OVERLAY_H__
+#define __OVERLAY_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void overlay_register_thread(void); // Called by every thread whose CPU time is shown
+void overlay_frame(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
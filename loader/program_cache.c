@@ -0,0 +1,364 @@
+/* program_cache.c -- reuse of linked GL programs across ShaderProgram rebuilds
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <psp2/kernel/processmgr.h>
+#include <vitaGL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch2d.h"
+#include "gl_state.h"
+#include "mvp_fold.h"
+#include "program_cache.h"
+#include "stats.h"
+#include "uniform_cache.h"
+#include "vertex_compress.h"
+
+#define MAX_SHADER_IDS 2048
+#define MAX_PROGRAM_IDS 1024
+#define MAX_CACHED_PROGRAMS 128
+
+typedef struct {
+	uint32_t vert[5];
+	uint32_t frag[5];
+	uint32_t attribs;
+} program_key;
+
+typedef struct {
+	program_key key;
+	GLuint prog; // Backing program object, never released once cached
+	GLuint user; // Game id currently standing for it, 0 once that id is deleted
+	uint32_t link_us;
+} cached_program;
+
+typedef struct {
+	GLenum type;
+	uint32_t hash[5];
+	uint8_t hashed;
+	const glsl_translation *layout; // Attribute locations from layout qualifiers
+} shader_slot;
+
+typedef struct {
+	GLuint vert;
+	GLuint frag;
+	uint32_t attribs;
+	uint8_t linked; // The next binding starts a new set
+	GLuint alias; // Cached program this id stands for (0 if it's used as is)
+	uint8_t owner; // This id backs a cache entry
+} program_slot;
+
+static shader_slot shaders[MAX_SHADER_IDS];
+static program_slot programs[MAX_PROGRAM_IDS];
+static cached_program cache[MAX_CACHED_PROGRAMS];
+static int cache_num = 0;
+
+static int scene_links = 0, scene_hits = 0;
+static uint64_t scene_link_us = 0, scene_saved_us = 0;
+
+static uint32_t fnv1a(uint32_t h, const void *data, size_t len) {
+	const uint8_t *p = (const uint8_t *)data;
+	for (size_t i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+static uint32_t hash_attrib(uint32_t h, GLuint index, const GLchar *name) {
+	h = fnv1a(h, &index, sizeof(index));
+	return fnv1a(h, name, strlen(name));
+}
+
+static program_slot *get_program_slot(GLuint program) {
+	return (program && program < MAX_PROGRAM_IDS) ? &programs[program] : NULL;
+}
+
+static shader_slot *get_shader_slot(GLuint shader) {
+	return (shader && shader < MAX_SHADER_IDS) ? &shaders[shader] : NULL;
+}
+
+static cached_program *find_by_key(const program_key *key) {
+	for (int i = 0; i < cache_num; i++) {
+		if (!memcmp(&cache[i].key, key, sizeof(program_key)))
+			return &cache[i];
+	}
+	return NULL;
+}
+
+static cached_program *find_by_prog(GLuint prog) {
+	for (int i = 0; i < cache_num; i++) {
+		if (cache[i].prog == prog)
+			return &cache[i];
+	}
+	return NULL;
+}
+
+static void forget_program(GLuint prog) {
+	gl_state_forget_program(prog);
+	uniform_cache_forget_program(prog);
+	mvp_fold_forget_program(prog);
+	batch2d_forget_program(prog);
+}
+
+// A fresh link starts with every uniform at zero, so the previous user's values must not show through
+static void reset_uniforms(GLuint prog) {
+	GLint num = 0;
+	glGetProgramiv(prog, GL_ACTIVE_UNIFORMS, &num);
+	gl_state_push();
+	glUseProgram(prog);
+	for (int i = 0; i < num; i++) {
+		GLchar name[128];
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(prog, i, sizeof(name), NULL, &size, &type, name);
+		GLint loc = glGetUniformLocation(prog, name);
+		GLfloat *zero = (GLfloat *)calloc(size * 16, sizeof(GLfloat));
+		if (loc == -1 || !zero) {
+			free(zero);
+			continue;
+		}
+		switch (type) {
+		case GL_FLOAT: glUniform1fv(loc, size, zero); break;
+		case GL_FLOAT_VEC2: glUniform2fv(loc, size, zero); break;
+		case GL_FLOAT_VEC3: glUniform3fv(loc, size, zero); break;
+		case GL_FLOAT_VEC4: glUniform4fv(loc, size, zero); break;
+		case GL_FLOAT_MAT2: glUniformMatrix2fv(loc, size, GL_FALSE, zero); break;
+		case GL_FLOAT_MAT3: glUniformMatrix3fv(loc, size, GL_FALSE, zero); break;
+		case GL_FLOAT_MAT4: glUniformMatrix4fv(loc, size, GL_FALSE, zero); break;
+		case GL_INT_VEC2: case GL_BOOL_VEC2: glUniform2iv(loc, size, (const GLint *)zero); break;
+		case GL_INT_VEC3: case GL_BOOL_VEC3: glUniform3iv(loc, size, (const GLint *)zero); break;
+		case GL_INT_VEC4: case GL_BOOL_VEC4: glUniform4iv(loc, size, (const GLint *)zero); break;
+		default: glUniform1iv(loc, size, (const GLint *)zero); break; // Ints, bools and samplers
+		}
+		free(zero);
+	}
+	gl_state_pop();
+}
+
+// The game id stops standing for a cached program, which becomes free for the next rebuild
+static void release_alias(program_slot *p) {
+	cached_program *c = find_by_prog(p->alias);
+	if (c)
+		c->user = 0;
+	forget_program(p->alias);
+	p->alias = 0;
+}
+
+void program_cache_set_shader_hash(GLuint shader, const uint32_t *sha1) {
+	shader_slot *s = get_shader_slot(shader);
+	if (s) {
+		memcpy(s->hash, sha1, sizeof(s->hash));
+		s->hashed = 1;
+	}
+}
+
+void program_cache_set_shader_layout(GLuint shader, const glsl_translation *layout) {
+	shader_slot *s = get_shader_slot(shader);
+	if (s)
+		s->layout = layout;
+}
+
+GLenum program_cache_get_shader_type(GLuint shader) {
+	shader_slot *s = get_shader_slot(shader);
+	return s ? s->type : 0;
+}
+
+GLuint program_cache_resolve(GLuint program) {
+	program_slot *p = get_program_slot(program);
+	return (p && p->alias) ? p->alias : program;
+}
+
+void program_cache_frame(void) {
+	if (scene_links || scene_hits) {
+		printf("[ProgramCache] Scene change: %d programs linked in %llu us, %d reused (%llu us saved), %d cached\n",
+			scene_links, scene_link_us, scene_hits, scene_saved_us, cache_num);
+		scene_links = scene_hits = 0;
+		scene_link_us = scene_saved_us = 0;
+	}
+}
+
+GLuint glCreateShader_hook(GLenum type) {
+	GLuint shader = glCreateShader(type);
+	shader_slot *s = get_shader_slot(shader);
+	if (s) {
+		s->type = type;
+		s->hashed = 0;
+		s->layout = NULL;
+	}
+	return shader;
+}
+
+void glAttachShader_hook(GLuint program, GLuint shader) {
+	program_slot *p = get_program_slot(program);
+	shader_slot *s = get_shader_slot(shader);
+	if (p && s) {
+		if (s->type == GL_VERTEX_SHADER)
+			p->vert = shader;
+		else
+			p->frag = shader;
+	}
+	glAttachShader(program, shader);
+}
+
+void glBindAttribLocation_hook(GLuint program, GLuint index, const GLchar *name) {
+	program_slot *p = get_program_slot(program);
+	if (p) {
+		if (p->linked) {
+			p->attribs = 0;
+			p->linked = 0;
+		}
+		p->attribs = hash_attrib(p->attribs, index, name);
+	}
+	glBindAttribLocation(program, index, name);
+}
+
+void glLinkProgram_hook(GLuint program) {
+	forget_program(program);
+	program_slot *p = get_program_slot(program);
+	if (!p) {
+		glLinkProgram(program);
+		return;
+	}
+	if (p->alias)
+		release_alias(p);
+
+	// Relinking a program which backs a cache entry invalidates the entry
+	if (p->owner) {
+		cached_program *c = find_by_prog(program);
+		if (c)
+			*c = cache[--cache_num];
+		p->owner = 0;
+		// Ids still standing for the old program get their own link
+		for (GLuint i = 1; i < MAX_PROGRAM_IDS; i++) {
+			if (programs[i].alias == program) {
+				programs[i].alias = 0;
+				glLinkProgram(i);
+			}
+		}
+	}
+
+	// Bindings made before this link are kept for later relinks unless the game binds again
+	uint32_t attribs = p->attribs;
+	p->linked = 1;
+	shader_slot *vs = get_shader_slot(p->vert);
+	shader_slot *fs = get_shader_slot(p->frag);
+	if (vs && vs->layout) {
+		// GLSL ES 1.00 has no layout qualifiers, so translated locations are bound explicitly
+		for (int i = 0; i < vs->layout->num_attribs; i++) {
+			const glsl_attrib_location *a = &vs->layout->attribs[i];
+			attribs = hash_attrib(attribs, a->location, a->name);
+			glBindAttribLocation(program, a->location, a->name);
+		}
+	}
+	if (!vs || !fs || !vs->hashed || !fs->hashed) {
+		glLinkProgram(program);
+		return;
+	}
+
+	program_key key;
+	memcpy(key.vert, vs->hash, sizeof(key.vert));
+	memcpy(key.frag, fs->hash, sizeof(key.frag));
+	key.attribs = attribs;
+
+	// A program still used by a live id is not shared, as the two would share uniforms too
+	cached_program *c = find_by_key(&key);
+	if (c && !c->user) {
+		reset_uniforms(c->prog);
+		forget_program(c->prog);
+		c->user = program;
+		p->alias = c->prog;
+		scene_hits++;
+		stats_cur.program_hits++;
+		scene_saved_us += c->link_us;
+		return;
+	}
+
+	uint64_t t = sceKernelGetProcessTimeWide();
+	glLinkProgram(program);
+	t = sceKernelGetProcessTimeWide() - t;
+	scene_links++;
+	stats_cur.program_links++;
+	scene_link_us += t;
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked && !c && cache_num < MAX_CACHED_PROGRAMS) {
+		c = &cache[cache_num++];
+		c->key = key;
+		c->prog = program;
+		c->user = program;
+		c->link_us = (uint32_t)t;
+		p->owner = 1;
+	}
+}
+
+void glDeleteProgram_hook(GLuint program) {
+	program_slot *p = get_program_slot(program);
+	if (!p) {
+		forget_program(program);
+		glDeleteProgram(program);
+		return;
+	}
+
+	if (p->owner) {
+		// The game is done with this id but the cache keeps the program alive for the next rebuild
+		cached_program *c = find_by_prog(program);
+		if (c && c->user == program)
+			c->user = 0;
+		forget_program(program);
+		p->vert = p->frag = 0;
+		p->attribs = 0;
+		p->linked = 0;
+		return;
+	}
+
+	if (p->alias)
+		release_alias(p);
+	memset(p, 0, sizeof(program_slot));
+	forget_program(program);
+	glDeleteProgram(program);
+}
+
+void glUseProgram_hook(GLuint program) {
+	GLuint real = program_cache_resolve(program);
+	mvp_fold_use_program(real);
+	batch2d_use_program(real);
+	vertex_compress_use_program(real);
+	uniform_cache_use_program(real);
+	gl_state_use_program(real);
+}
+
+void glGetProgramiv_hook(GLuint program, GLenum pname, GLint *params) {
+	glGetProgramiv(program_cache_resolve(program), pname, params);
+}
+
+void glGetProgramInfoLog_hook(GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog) {
+	glGetProgramInfoLog(program_cache_resolve(program), bufSize, length, infoLog);
+}
+
+GLint glGetUniformLocation_hook(GLuint program, const GLchar *name) {
+	return mvp_fold_get_uniform_location(program_cache_resolve(program), name);
+}
+
+GLint glGetAttribLocation_hook(GLuint program, const GLchar *name) {
+	return glGetAttribLocation(program_cache_resolve(program), name);
+}
+
+void glGetActiveUniform_hook(GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLint *size, GLenum *type, GLchar *name) {
+	glGetActiveUniform(program_cache_resolve(program), index, bufSize, length, size, type, name);
+}
+
+void glGetActiveAttrib_hook(GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLint *size, GLenum *type, GLchar *name) {
+	glGetActiveAttrib(program_cache_resolve(program), index, bufSize, length, size, type, name);
+}
+
+void glValidateProgram_hook(GLuint program) {
+	glValidateProgram(program_cache_resolve(program));
+}
@@ -0,0 +1,28 @@
+#ifndef __PROGRAM_CACHE_H__
+#define __PROGRAM_CACHE_H__
+
+#include <vitaGL.h>
+#include <stdint.h>
+#include "glsl_translate.h"
+
+void program_cache_set_shader_hash(GLuint shader, const uint32_t *sha1);
+void program_cache_set_shader_layout(GLuint shader, const glsl_translation *layout);
+GLenum program_cache_get_shader_type(GLuint shader);
+GLuint program_cache_resolve(GLuint program);
+void program_cache_frame(void);
+
+GLuint glCreateShader_hook(GLenum type);
+void glAttachShader_hook(GLuint program, GLuint shader);
+void glBindAttribLocation_hook(GLuint program, GLuint index, const GLchar *name);
+void glLinkProgram_hook(GLuint program);
+void glDeleteProgram_hook(GLuint program);
+void glUseProgram_hook(GLuint program);
+void glGetProgramiv_hook(GLuint program, GLenum pname, GLint *params);
+void glGetProgramInfoLog_hook(GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+GLint glGetUniformLocation_hook(GLuint program, const GLchar *name);
+GLint glGetAttribLocation_hook(GLuint program, const GLchar *name);
+void glGetActiveUniform_hook(GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLint *size, GLenum *type, GLchar *name);
+void glGetActiveAttrib_hook(GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLint *size, GLenum *type, GLchar *name);
+void glValidateProgram_hook(GLuint program);
+
+#endif
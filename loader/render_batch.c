@@ -0,0 +1,145 @@
+/* render_batch.c -- batching of the game's SDL_Renderer copies and fills
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * SDL_RenderCopy and SDL_RenderFillRect quads are not handed to SDL one by
+ * one: as long as the texture (none for fills) and its blend mode stay the
+ * same, they are appended to a single vertex stream, with the texture color
+ * and alpha mods (or the draw color) baked per vertex, and submitted with one
+ * SDL_RenderGeometry. The stream is drawn on a texture or blend mode change,
+ * when full, and by batch2d_flush, so before anything else reaching vitaGL.
+ * At most one of the two batches holds draws at any time: appending to one
+ * flushes the other.
+ */
+
+#include <vitaGL.h>
+#include <SDL2/SDL.h>
+
+#include "batch2d.h"
+#include "gl_state.h"
+#include "render_batch.h"
+#include "render_target.h"
+#include "stats.h"
+
+#define MAX_QUADS 1024
+
+static SDL_Vertex verts[MAX_QUADS * 4];
+static int indices[MAX_QUADS * 6];
+static int quads_num = 0;
+static SDL_Renderer *cur_renderer;
+static SDL_Texture *cur_tex;
+static SDL_BlendMode cur_blend;
+
+void render_batch_flush(void) {
+	if (!quads_num)
+		return;
+	int n = quads_num;
+	quads_num = 0;
+
+	// SDL_RenderGeometry takes the blend mode from the texture, or the renderer for fills, at submission time
+	SDL_BlendMode prev;
+	if (cur_tex) {
+		SDL_GetTextureBlendMode(cur_tex, &prev);
+		SDL_SetTextureBlendMode(cur_tex, cur_blend);
+	} else {
+		SDL_GetRenderDrawBlendMode(cur_renderer, &prev);
+		SDL_SetRenderDrawBlendMode(cur_renderer, cur_blend);
+	}
+	SDL_RenderGeometry(cur_renderer, cur_tex, verts, n * 4, indices, n * 6);
+	if (cur_tex)
+		SDL_SetTextureBlendMode(cur_tex, prev);
+	else
+		SDL_SetRenderDrawBlendMode(cur_renderer, prev);
+	stats_cur.render_flushes++;
+	gl_state_invalidate();
+}
+
+static SDL_Vertex *add_quad(SDL_Renderer *renderer, SDL_Texture *texture, SDL_BlendMode blend) {
+	if (quads_num && (renderer != cur_renderer || texture != cur_tex || blend != cur_blend || quads_num == MAX_QUADS))
+		render_batch_flush();
+	if (!quads_num) {
+		// Older draws of the GL batch and the downscaled 3D pass go first
+		batch2d_flush();
+		render_target_end_3d();
+		cur_renderer = renderer;
+		cur_tex = texture;
+		cur_blend = blend;
+	}
+
+	int *idx = &indices[quads_num * 6];
+	int base = quads_num * 4;
+	idx[0] = base;
+	idx[1] = base + 1;
+	idx[2] = base + 2;
+	idx[3] = base + 2;
+	idx[4] = base + 1;
+	idx[5] = base + 3;
+	stats_cur.render_draws++;
+	return &verts[quads_num++ * 4];
+}
+
+static void set_quad(SDL_Vertex *v, const SDL_Rect *dst, SDL_Color color) {
+	for (int i = 0; i < 4; i++) {
+		v[i].position.x = dst->x + ((i & 1) ? dst->w : 0);
+		v[i].position.y = dst->y + ((i & 2) ? dst->h : 0);
+		v[i].color = color;
+	}
+}
+
+static void full_viewport(SDL_Renderer *renderer, SDL_Rect *r) {
+	SDL_RenderGetViewport(renderer, r);
+	r->x = r->y = 0;
+}
+
+int render_batch_copy(SDL_Renderer *renderer, SDL_Texture *texture, const SDL_Rect *srcrect, const SDL_Rect *dstrect) {
+	int w, h;
+	if (SDL_QueryTexture(texture, NULL, NULL, &w, &h) < 0)
+		return -1;
+	SDL_Rect src = {0, 0, w, h}, dst;
+	if (srcrect && !SDL_IntersectRect(srcrect, &src, &src))
+		return 0;
+	if (dstrect)
+		dst = *dstrect;
+	else
+		full_viewport(renderer, &dst);
+	if (dst.w <= 0 || dst.h <= 0)
+		return 0;
+
+	SDL_Color c;
+	SDL_BlendMode blend;
+	SDL_GetTextureColorMod(texture, &c.r, &c.g, &c.b);
+	SDL_GetTextureAlphaMod(texture, &c.a);
+	SDL_GetTextureBlendMode(texture, &blend);
+
+	SDL_Vertex *v = add_quad(renderer, texture, blend);
+	set_quad(v, &dst, c);
+	for (int i = 0; i < 4; i++) {
+		v[i].tex_coord.x = (float)(src.x + ((i & 1) ? src.w : 0)) / w;
+		v[i].tex_coord.y = (float)(src.y + ((i & 2) ? src.h : 0)) / h;
+	}
+	return 0;
+}
+
+int render_batch_fill_rect(SDL_Renderer *renderer, const SDL_Rect *rect) {
+	SDL_Rect dst;
+	if (rect)
+		dst = *rect;
+	else
+		full_viewport(renderer, &dst);
+	if (dst.w <= 0 || dst.h <= 0)
+		return 0;
+
+	SDL_Color c;
+	SDL_BlendMode blend;
+	SDL_GetRenderDrawColor(renderer, &c.r, &c.g, &c.b, &c.a);
+	SDL_GetRenderDrawBlendMode(renderer, &blend);
+
+	SDL_Vertex *v = add_quad(renderer, NULL, blend);
+	set_quad(v, &dst, c);
+	for (int i = 0; i < 4; i++)
+		v[i].tex_coord.x = v[i].tex_coord.y = 0.0f;
+	return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef __RENDER_BATCH_H__
+#define __RENDER_BATCH_H__
+
+// Also included by batch2d.c, which is built without SDL for tools/gl_replay
+typedef struct SDL_Renderer SDL_Renderer;
+typedef struct SDL_Texture SDL_Texture;
+typedef struct SDL_Rect SDL_Rect;
+
+void render_batch_flush(void); // Called by batch2d_flush
+int render_batch_copy(SDL_Renderer *renderer, SDL_Texture *texture, const SDL_Rect *srcrect, const SDL_Rect *dstrect);
+int render_batch_fill_rect(SDL_Renderer *renderer, const SDL_Rect *rect);
+
+#endif
@@ -0,0 +1,370 @@
+/* render_target.c -- offscreen render targets set up by glFramebufferTexture2D_hook
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * The game attaches its shadow maps as GL_DEPTH_ATTACHMENT textures. Each one
+ * gets a SHADOW_MAP_SIZE GL_DEPTH_COMPONENT16 renderbuffer, which the texture
+ * then samples through vglTexImageDepthBuffer, so depth_fp's gl_FragDepth is
+ * what the 3D shaders read back. vitaGL still wants a color surface, so a
+ * single RGB565 texture is shared by every shadow framebuffer.
+ * Everything is created on the first attach and reused on the following ones.
+ * shadow_quality (see settings.c) halves SHADOW_MAP_SIZE on low, while off
+ * leaves shadow framebuffers unbound with their clears and draws skipped, and
+ * makes the game's texture a single white texel, so everything reads as lit.
+ *
+ * Color targets are pooled by (width, height, format, type): a texture attached
+ * to a framebuffer joins the pool, and is kept alive when the game deletes it.
+ * A later storage-less glTexImage2D with the same key gets the pooled texture
+ * instead of a fresh allocation (the game's name is aliased onto it), so scene
+ * transitions stop fragmenting vitaGL's memory. Released shadow depth buffers
+ * are recycled the same way.
+ *
+ * While dynres.c scales the 3D pass down, framebuffer 0 stands for its scaled
+ * target until the pass gets upscaled (see render_target_end_3d).
+ */
+
+#include <vitaGL.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "batch2d.h"
+#include "config.h"
+#include "dynres.h"
+#include "gl_state.h"
+#include "render_target.h"
+#include "settings.h"
+
+#define MAX_SHADOW_TARGETS 8
+#define MAX_POOLED_TARGETS 32
+#define MAX_FREE_DEPTHS 8
+#define MAX_TEXTURE_IDS 16384
+#define MAX_ALLOCATIONS 64
+
+typedef struct {
+	GLuint fb;
+	GLuint tex;
+	GLuint depth;
+	GLsizei size;
+	uint8_t skipped; // Shadows off
+} shadow_target;
+
+typedef struct {
+	GLsizei w, h;
+	GLenum format;
+	GLenum type;
+} target_key;
+
+typedef struct {
+	GLuint real; // Texture backing the target
+	GLuint owner; // Game's texture name using it (0 if free)
+	target_key key;
+	uint32_t bytes;
+} pooled_target;
+
+typedef struct {
+	GLuint tex;
+	target_key key;
+} allocation;
+
+static shadow_target shadows[MAX_SHADOW_TARGETS];
+static int shadows_num = 0;
+static GLuint dummy_color = 0;
+
+static GLuint cur_fb = 0;
+static shadow_target *cur_shadow = NULL;
+
+static pooled_target pool[MAX_POOLED_TARGETS];
+static int pool_num = 0;
+static GLuint free_depths[MAX_FREE_DEPTHS];
+static int free_depths_num = 0;
+static GLuint tex_alias[MAX_TEXTURE_IDS];
+
+// Last storage-less allocations, their key is needed once they get attached
+static allocation allocations[MAX_ALLOCATIONS];
+static int allocations_next = 0;
+
+static uint32_t rt_bytes = 0, rt_peak_bytes = 0, rt_reported_peak = 0;
+static int rt_reused = 0;
+
+static uint32_t target_bytes(const target_key *k) {
+	int bpp;
+	switch (k->type) {
+	case GL_UNSIGNED_SHORT_5_6_5:
+	case GL_UNSIGNED_SHORT_4_4_4_4:
+	case GL_UNSIGNED_SHORT_5_5_5_1:
+		bpp = 2;
+		break;
+	case GL_FLOAT:
+		bpp = 16;
+		break;
+	default:
+		bpp = k->format == GL_RGB ? 3 : (k->format == GL_RGBA ? 4 : 1);
+		break;
+	}
+	return k->w * k->h * bpp;
+}
+
+static void account(int32_t bytes) {
+	rt_bytes += bytes;
+	if (rt_bytes > rt_peak_bytes)
+		rt_peak_bytes = rt_bytes;
+}
+
+GLuint render_target_resolve(GLuint texture) {
+	return (texture < MAX_TEXTURE_IDS && tex_alias[texture]) ? tex_alias[texture] : texture;
+}
+
+static pooled_target *find_pooled(GLuint real) {
+	for (int i = 0; i < pool_num; i++) {
+		if (pool[i].real == real)
+			return &pool[i];
+	}
+	return NULL;
+}
+static shadow_target *find_shadow_by_fb(GLuint fb) {
+	for (int i = 0; i < shadows_num; i++) {
+		if (shadows[i].fb == fb)
+			return &shadows[i];
+	}
+	return NULL;
+}
+
+static void release_depth(shadow_target *s) {
+	if (free_depths_num < MAX_FREE_DEPTHS) {
+		free_depths[free_depths_num++] = s->depth;
+	} else {
+		glDeleteRenderbuffers(1, &s->depth);
+		account(-(s->size * s->size * 2));
+	}
+}
+
+static void setup_shadow(shadow_target *s) {
+	if (free_depths_num) {
+		s->depth = free_depths[--free_depths_num];
+	} else {
+		glGenRenderbuffers(1, &s->depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, s->depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, s->size, s->size);
+		account(s->size * s->size * 2);
+	}
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, s->depth);
+
+	if (!dummy_color) {
+		glGenTextures(1, &dummy_color);
+		gl_state_bind_texture(GL_TEXTURE_2D, dummy_color);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, s->size, s->size, 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, NULL);
+		account(s->size * s->size * 2);
+	}
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dummy_color, 0);
+
+	// The game's texture becomes a view of the depth buffer
+	gl_state_bind_texture(GL_TEXTURE_2D, s->tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, s->size, s->size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	vglFree(vglGetTexDataPointer(GL_TEXTURE_2D));
+	vglTexImageDepthBuffer(GL_TEXTURE_2D);
+
+	printf("[RenderTarget] Shadow map %u on framebuffer %u: %dx%d D16\n", s->tex, s->fb, s->size, s->size);
+}
+
+static void setup_lit(shadow_target *s) {
+	static const uint8_t lit[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+	gl_state_bind_texture(GL_TEXTURE_2D, s->tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, lit);
+
+	printf("[RenderTarget] Shadow map %u on framebuffer %u: pass skipped, always lit\n", s->tex, s->fb);
+}
+
+void render_target_attach(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) {
+	batch2d_flush();
+	if (attachment == GL_COLOR_ATTACHMENT0) {
+		texture = render_target_resolve(texture);
+		if (texture && !find_pooled(texture) && pool_num < MAX_POOLED_TARGETS) {
+			for (int i = 0; i < MAX_ALLOCATIONS; i++) {
+				if (allocations[i].tex == texture) {
+					pooled_target *p = &pool[pool_num++];
+					p->real = texture;
+					p->owner = texture;
+					p->key = allocations[i].key;
+					p->bytes = target_bytes(&p->key);
+					account(p->bytes);
+					allocations[i].tex = 0;
+					break;
+				}
+			}
+		}
+		glFramebufferTexture2D(target, attachment, textarget, texture, level);
+		return;
+	}
+
+	// Shadow maps get their own storage, drop any pooled texture handed out to this name
+	if (texture < MAX_TEXTURE_IDS && tex_alias[texture]) {
+		pooled_target *p = find_pooled(tex_alias[texture]);
+		if (p)
+			p->owner = 0;
+		tex_alias[texture] = 0;
+	}
+
+	shadow_target *s = find_shadow_by_fb(cur_fb);
+	if (s && s->tex == texture) {
+		// Already set up, the attachments are still in place
+		return;
+	}
+	if (!s) {
+		if (shadows_num == MAX_SHADOW_TARGETS) {
+			printf("[RenderTarget] Too many shadow maps, raise MAX_SHADOW_TARGETS\n");
+			return;
+		}
+		s = &shadows[shadows_num++];
+		memset(s, 0, sizeof(shadow_target));
+		s->fb = cur_fb;
+	}
+	if (s->depth)
+		release_depth(s);
+	s->depth = 0;
+	s->tex = texture;
+	s->size = shadow_quality == SHADOWS_LOW ? SHADOW_MAP_SIZE / 2 : SHADOW_MAP_SIZE;
+	s->skipped = shadow_quality == SHADOWS_OFF;
+	if (s->skipped)
+		setup_lit(s);
+	else
+		setup_shadow(s);
+	cur_shadow = s;
+}
+
+void render_target_bind_framebuffer(GLenum target, GLuint framebuffer) {
+	if (target == GL_FRAMEBUFFER) {
+		cur_fb = framebuffer;
+		cur_shadow = find_shadow_by_fb(framebuffer);
+		if (cur_shadow && cur_shadow->skipped)
+			return;
+		if (!framebuffer)
+			framebuffer = dynres_framebuffer();
+	}
+	gl_state_bind_framebuffer(target, framebuffer);
+}
+
+int render_target_skip_pass(void) {
+	return cur_shadow && cur_shadow->skipped;
+}
+
+void render_target_viewport(void) {
+	if (render_target_skip_pass()) {
+		return;
+	} else if (cur_shadow) {
+		gl_state_viewport(0, 0, cur_shadow->size, cur_shadow->size);
+	} else if (!cur_fb && dynres_framebuffer()) {
+		GLsizei w, h;
+		dynres_size(&w, &h);
+		gl_state_viewport(0, 0, w, h);
+	} else {
+		gl_state_viewport(0, 0, SCREEN_W, SCREEN_H);
+	}
+}
+
+void render_target_end_3d(void) {
+	if (!cur_fb && dynres_blit())
+		render_target_viewport();
+}
+
+void render_target_begin_frame(void) {
+	dynres_frame_begin();
+	if (!render_target_skip_pass())
+		gl_state_bind_framebuffer(GL_FRAMEBUFFER, cur_fb ? cur_fb : dynres_framebuffer());
+	render_target_viewport();
+}
+
+void render_target_delete_framebuffers(GLsizei n, const GLuint *framebuffers) {
+	for (int i = 0; i < n; i++) {
+		shadow_target *s = find_shadow_by_fb(framebuffers[i]);
+		if (s) {
+			if (s->depth)
+				release_depth(s);
+			if (cur_shadow == s)
+				cur_shadow = NULL;
+			*s = shadows[--shadows_num];
+			if (cur_shadow == &shadows[shadows_num])
+				cur_shadow = s;
+		}
+		if (cur_fb == framebuffers[i])
+			cur_fb = 0;
+	}
+}
+
+int render_target_tex_image(GLenum target, GLint level, GLenum format, GLsizei width, GLsizei height, GLenum type, const void *pixels) {
+	if (target != GL_TEXTURE_2D || level != 0)
+		return 0;
+	GLuint bound = gl_state_get_texture(GL_TEXTURE_2D);
+	if (!bound || bound == GL_STATE_UNKNOWN)
+		return 0;
+
+	target_key key = {width, height, format, type};
+	pooled_target *p = find_pooled(bound);
+	if (p) {
+		// Respecified by its owner, the pooled texture follows
+		if (memcmp(&p->key, &key, sizeof(key))) {
+			account(-(int32_t)p->bytes);
+			p->key = key;
+			p->bytes = target_bytes(&key);
+			account(p->bytes);
+		}
+		return 0;
+	}
+	if (pixels || bound >= MAX_TEXTURE_IDS)
+		return 0;
+
+	for (int i = 0; i < pool_num; i++) {
+		p = &pool[i];
+		if (!p->owner && !memcmp(&p->key, &key, sizeof(key))) {
+			p->owner = bound;
+			tex_alias[bound] = p->real;
+			gl_state_bind_texture(GL_TEXTURE_2D, p->real);
+			rt_reused++;
+			return 1;
+		}
+	}
+
+	allocation *a = &allocations[allocations_next];
+	allocations_next = (allocations_next + 1) % MAX_ALLOCATIONS;
+	a->tex = bound;
+	a->key = key;
+	return 0;
+}
+
+int render_target_delete_texture(GLuint texture) {
+	GLuint real = render_target_resolve(texture);
+	pooled_target *p = find_pooled(real);
+	if (texture < MAX_TEXTURE_IDS)
+		tex_alias[texture] = 0;
+	for (int i = 0; i < MAX_ALLOCATIONS; i++) {
+		if (allocations[i].tex == texture)
+			allocations[i].tex = 0;
+	}
+	if (!p || p->owner != texture)
+		return 0;
+
+	// The pool keeps the storage, an aliased name has none and can really go
+	p->owner = 0;
+	return p->real == texture;
+}
+
+uint32_t render_target_memory(void) {
+	return rt_bytes;
+}
+
+void render_target_frame(void) {
+	// Nothing 2D drawn this frame, the 3D pass still has to reach the screen
+	if (dynres_blit() && !render_target_skip_pass()) {
+		gl_state_bind_framebuffer(GL_FRAMEBUFFER, cur_fb);
+		render_target_viewport();
+	}
+	dynres_frame_end();
+	if (rt_peak_bytes > rt_reported_peak) {
+		printf("[RenderTarget] New peak render target memory: %u KB (%d pooled targets, %d allocations reused)\n",
+			rt_peak_bytes / 1024, pool_num, rt_reused);
+		rt_reported_peak = rt_peak_bytes;
+	}
+}
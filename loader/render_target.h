@@ -0,0 +1,19 @@
+#ifndef __RENDER_TARGET_H__
+#define __RENDER_TARGET_H__
+
+#include <vitaGL.h>
+
+GLuint render_target_resolve(GLuint texture);
+int render_target_tex_image(GLenum target, GLint level, GLenum format, GLsizei width, GLsizei height, GLenum type, const void *pixels); // 1 if served from the pool
+int render_target_delete_texture(GLuint texture); // 1 if the pool keeps the texture alive
+uint32_t render_target_memory(void); // Bytes used by shadow maps and pooled targets
+void render_target_frame(void);
+void render_target_begin_frame(void);
+void render_target_end_3d(void); // Upscales a scaled 3D pass before 2D drawing starts
+void render_target_attach(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+void render_target_bind_framebuffer(GLenum target, GLuint framebuffer);
+int render_target_skip_pass(void); // 1 while a skipped shadow pass is bound
+void render_target_viewport(void);
+void render_target_delete_framebuffers(GLsizei n, const GLuint *framebuffers);
+
+#endif
@@ -0,0 +1,89 @@
+/* settings.c -- user settings read from SETTINGS_PATH at boot
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * One "key=value" per line, lines starting with # are ignored:
+ *   shadows=off|low|full
+ *   texformat=<path pattern> keep|auto|rgb565|rgba5551|rgba4444 (any number of them, see tex_format.c)
+ *   async=<path pattern> (any number of them, see async_load.c)
+ *   textatlas=on|off (see glyph_atlas.c)
+ *   framecap=60|30|20|off (see frame_pacing.c)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "async_load.h"
+#include "config.h"
+#include "settings.h"
+#include "tex_format.h"
+
+static const char *shadow_names[] = {"off", "low", "full"};
+
+int shadow_quality = SHADOW_QUALITY;
+int text_atlas = 1;
+int framecap = FRAMECAP;
+
+int settings_match(const char *p, const char *s) {
+	if (*p == '*') {
+		while (*p == '*')
+			p++;
+		if (!*p)
+			return 1;
+		for (; *s; s++) {
+			if (settings_match(p, s))
+				return 1;
+		}
+		return 0;
+	}
+	if (!*s)
+		return !*p;
+	if (*p != '?' && *p != *s)
+		return 0;
+	return settings_match(p + 1, s + 1);
+}
+
+void settings_load(void) {
+	FILE *f = fopen(SETTINGS_PATH, "r");
+	if (f) {
+		char line[256], key[32], val[96], mode[16];
+		while (fgets(line, sizeof(line), f)) {
+			if (line[0] == '#' || sscanf(line, " %31[^= ] = %95s", key, val) != 2)
+				continue;
+			if (!strcmp(key, "shadows")) {
+				int i = 0;
+				while (i < 3 && strcmp(val, shadow_names[i]))
+					i++;
+				if (i < 3)
+					shadow_quality = i;
+				else
+					printf("[Settings] Unknown shadows value %s\n", val);
+			} else if (!strcmp(key, "textatlas")) {
+				if (!strcmp(val, "on") || !strcmp(val, "off"))
+					text_atlas = !strcmp(val, "on");
+				else
+					printf("[Settings] Unknown textatlas value %s\n", val);
+			} else if (!strcmp(key, "framecap")) {
+				if (!strcmp(val, "off") || !strcmp(val, "0"))
+					framecap = 0;
+				else if (!strcmp(val, "60") || !strcmp(val, "30") || !strcmp(val, "20"))
+					framecap = atoi(val);
+				else
+					printf("[Settings] Unknown framecap value %s\n", val);
+			} else if (!strcmp(key, "async")) {
+				async_load_add_pattern(val);
+			} else if (!strcmp(key, "texformat")) {
+				if (sscanf(strchr(line, '=') + 1, " %*s %15s", mode) != 1 || !tex_format_add_rule(val, mode))
+					printf("[Settings] Bad texformat rule for %s\n", val);
+			} else {
+				printf("[Settings] Unknown setting %s\n", key);
+			}
+		}
+		fclose(f);
+	}
+	printf("[Settings] Shadows: %s\n", shadow_names[shadow_quality]);
+}
@@ -0,0 +1,17 @@
+#ifndef __SETTINGS_H__
+#define __SETTINGS_H__
+
+enum {
+	SHADOWS_OFF,
+	SHADOWS_LOW, // Half of SHADOW_MAP_SIZE
+	SHADOWS_FULL
+};
+
+extern int shadow_quality;
+extern int text_atlas;
+extern int framecap;
+
+void settings_load(void);
+int settings_match(const char *pattern, const char *path); // Shell style, * also matches across '/'
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef __SHADER_PATCHES_H__
+#define __SHADER_PATCHES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Replacement shaders, shared between the loader and tools/shader_manifest.c.
+// Their SHA1 is the shader cache key, so any edit here invalidates the cached gxp.
+// u_Projection * u_View * u_Model is folded on the CPU (see mvp_fold.c) into u_MVP.
+
+static const char simple_shd_vp[] = R"(
+	attribute vec4 a_Location;
+	attribute vec4 a_Color;
+	uniform mat4 u_MVP;
+	varying vec4 var_color;
+	void main() {
+		gl_Position =  u_MVP * a_Location;
+		var_color = a_Color;
+	}
+)";
+
+static const char depth_fp[] = R"(
+	void main() {
+		gl_FragDepth =  gl_FragCoord.z;
+	}
+)";
+
+static const char simple_shd_fp[] = R"(
+	varying vec4 var_color;
+	void main() {
+		gl_FragColor =  var_color;
+	}
+)";
+
+static const char vp_3d[] = R"(
+	attribute vec4 a_Location;
+	attribute vec3 a_Normal;
+	attribute vec2 a_TexCoords;
+	uniform mat4 u_MVP;
+	uniform mat4 u_Model;
+	uniform mat3 u_NormalMatrix;
+	uniform mat4 u_DepthMVP;
+	varying vec3 var_normal;
+	varying vec3 var_worldPos;
+	varying vec2 var_texCoords;
+	varying vec4 var_shadowLoc;
+	void main(void)
+	{
+		var_texCoords = a_TexCoords;
+		var_worldPos = vec3(u_Model * a_Location);
+		var_normal = u_NormalMatrix * a_Normal;
+		gl_Position =  u_MVP * a_Location;
+		var_shadowLoc = u_DepthMVP * a_Location;
+	}
+)";
+
+static const char vp_2d[] = R"(
+	attribute vec2 a_Location;
+	attribute vec2 a_TexCoords;
+	attribute vec4 a_Color;
+	uniform vec2 u_WH;
+	uniform float u_Zoom;
+	uniform vec2 u_CamPos;
+	varying vec4 var_color;
+	varying vec2 var_TexCoords;
+	void main() {
+		gl_Position =  vec4((a_Location - u_CamPos) / (u_WH * 0.5) * u_Zoom, 0.0, 1.0);
+		var_color = a_Color;
+		var_TexCoords = a_TexCoords;
+	}
+)";
+
+static const char fp_2d[] = R"(
+	varying vec4 var_color;
+	varying vec2 var_TexCoords;
+	uniform int u_UseTexture;
+	uniform sampler2D u_Texture;
+	void main() {
+		vec4 texColor = vec4(1.0, 1.0, 1.0, 1.0);
+		if (u_UseTexture>0)
+			texColor = texture2D( u_Texture, var_TexCoords );
+		gl_FragColor = texColor * var_color;
+	}
+)";
+
+typedef struct {
+	uint32_t vp_match; // Offset of the game's vertex source triggering the patch (0 = none)
+	uint32_t fp_match; // Offset of the game's fragment source triggering the patch (0 = none)
+	uint32_t vp_offs; // Replacement vertex source as an offset in the game's image...
+	const char *vp; // ...or as a loader source
+	uint32_t fp_offs;
+	const char *fp;
+	const char *desc;
+} shader_patch;
+
+static const shader_patch shader_patches[] = {
+	// Game has a brainfart and attempts to use GLSL ES 3.00 shader even if it has a GLSL ES 1.3 variant
+	{ 0, 0x000BF5E9, 0, NULL, 0x000C5022, NULL, "fp from 0x000BF5E9 (3.00 -> 1.00)" },
+	{ 0, 0x000DFD3C, 0, NULL, 0x000C5022, NULL, "fp from 0x000DFD3C (3.00 -> 1.00)" },
+	{ 0x000D2EC1, 0, 0, vp_2d, 0, fp_2d, "2D shaders (2D)" },
+	{ 0x000D3CC2, 0x000D3CC2, 0, simple_shd_vp, 0, simple_shd_fp, "from 0x000D3CC2 (Simple)" },
+	{ 0, 0x000E4722, 0, NULL, 0, depth_fp, "fp from 0x000E4722 (Depth Replace)" },
+	{ 0x000D264F, 0, 0, vp_3d, 0, NULL, "vp from 0x000D264F (Mesh Vertex)" },
+};
+
+static inline int apply_shader_patch(uintptr_t base, const shader_patch *p, const char **vp, const char **fp) {
+	if (!((p->vp_match && *vp == (const char *)(base + p->vp_match)) ||
+		(p->fp_match && *fp == (const char *)(base + p->fp_match))))
+		return 0;
+	if (p->vp)
+		*vp = p->vp;
+	else if (p->vp_offs)
+		*vp = (const char *)(base + p->vp_offs);
+	if (p->fp)
+		*fp = p->fp;
+	else if (p->fp_offs)
+		*fp = (const char *)(base + p->fp_offs);
+	return 1;
+}
+
+#endif
@@ -0,0 +1,50 @@
+/* stats.c -- per-frame rendering counters
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "stats.h"
+
+frame_stats stats_cur;
+frame_stats stats_last;
+
+static frame_stats stats_sum;
+static uint32_t stats_frames = 0;
+
+void stats_frame(void) {
+	stats_last = stats_cur;
+	memset(&stats_cur, 0, sizeof(frame_stats));
+
+#if STATS_LOG_INTERVAL > 0
+	// frame_stats only holds 32 bit counters
+	uint32_t *src = (uint32_t *)&stats_last;
+	uint32_t *dst = (uint32_t *)&stats_sum;
+	for (int i = 0; i < sizeof(frame_stats) / sizeof(uint32_t); i++)
+		dst[i] += src[i];
+	if (++stats_frames == STATS_LOG_INTERVAL) {
+		printf("[Stats] Per frame over %d frames: %u state changes issued, %u elided, %u draws (%u after batching)\n", STATS_LOG_INTERVAL,
+			(stats_sum.state_calls - stats_sum.state_elided) / STATS_LOG_INTERVAL, stats_sum.state_elided / STATS_LOG_INTERVAL,
+			stats_sum.draws / STATS_LOG_INTERVAL, stats_sum.draws_issued / STATS_LOG_INTERVAL);
+		printf("[Stats] %u texture switches, %u saved by atlasing, %u atlas pages at %u%% occupancy\n",
+			stats_sum.tex_binds / STATS_LOG_INTERVAL, stats_sum.tex_binds_saved / STATS_LOG_INTERVAL,
+			stats_sum.atlas_pages / STATS_LOG_INTERVAL, stats_sum.atlas_occupancy / STATS_LOG_INTERVAL);
+		printf("[Stats] %u uniform uploads, %u elided, %u KB streamed\n",
+			(stats_sum.uniform_calls - stats_sum.uniform_elided) / STATS_LOG_INTERVAL, stats_sum.uniform_elided / STATS_LOG_INTERVAL,
+			stats_sum.stream_bytes / STATS_LOG_INTERVAL / 1024);
+		printf("[Stats] %u SDL renderer draws in %u batches\n",
+			stats_sum.render_draws / STATS_LOG_INTERVAL, stats_sum.render_flushes / STATS_LOG_INTERVAL);
+		printf("[Stats] %u text renders and sizes, %u%% from the text cache\n",
+			(stats_sum.text_hits + stats_sum.text_misses) / STATS_LOG_INTERVAL,
+			stats_sum.text_hits + stats_sum.text_misses ? stats_sum.text_hits * 100 / (stats_sum.text_hits + stats_sum.text_misses) : 0);
+		memset(&stats_sum, 0, sizeof(frame_stats));
+		stats_frames = 0;
+	}
+#endif
+}
@@ -0,0 +1,33 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdint.h>
+
+typedef struct {
+	uint32_t state_calls; // GL state changes requested by the game
+	uint32_t state_elided; // ...of which filtered out as no-ops
+	uint32_t draws; // Draw calls issued by the game
+	uint32_t draws_issued; // Draw calls reaching vitaGL after 2D batching
+	uint32_t tex_binds; // Texture switches requested through SDL
+	uint32_t tex_binds_saved; // ...of which absorbed by an atlas page already in use
+	uint32_t atlas_pages; // Atlas pages allocated (gauge)
+	uint32_t atlas_occupancy; // Percentage of atlas pages in use (gauge)
+	uint32_t shader_hits; // Shaders loaded from a precompiled gxp
+	uint32_t shader_misses; // ...and compiled at runtime
+	uint32_t program_hits; // Programs served by program_cache.c
+	uint32_t program_links; // ...and really linked
+	uint32_t uniform_calls; // glUniform* uploads requested by the game and mvp_fold.c
+	uint32_t uniform_elided; // ...of which dropped as matching the last value
+	uint32_t stream_bytes; // Bytes copied to the ring by stream_ring.c
+	uint32_t text_hits; // SDL_ttf renders and sizes served by ttf_cache.c
+	uint32_t text_misses; // ...and left to SDL_ttf
+	uint32_t render_draws; // SDL_RenderCopy/SDL_RenderFillRect quads
+	uint32_t render_flushes; // ...submitted by render_batch.c as this many draws
+} frame_stats;
+
+extern frame_stats stats_cur; // Frame being recorded
+extern frame_stats stats_last; // Last completed frame
+
+void stats_frame(void);
+
+#endif
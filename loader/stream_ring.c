@@ -0,0 +1,240 @@
+/* stream_ring.c -- ring sub-allocation for buffers re-specified every frame
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * HUD and telemetry geometry is uploaded again with glBufferData every frame,
+ * and each time vitaGL frees the buffer's memory once the GPU is done with it
+ * and allocates a new block. Buffers flagged as dynamic by their usage, or
+ * caught being re-specified on STREAM_DETECT_FRAMES frames in a row, are
+ * instead copied to the next free bytes of one large buffer kept mapped for
+ * good (vitaGL hands out the buffer's own memory and doesn't check the
+ * mapping at draw time), and draws reading them are pointed there.
+ * vitaGL has no fences, so the ring doesn't reuse bytes written in the last
+ * STREAM_RING_FRAMES frames. A buffer drawn in a later frame than the one its
+ * bytes were written in is first copied to fresh ones, so no draw reads bytes
+ * older than its own frame, and a streamed buffer not uploaded again for
+ * that long is handed back to vitaGL.
+ */
+
+#include <vitaGL.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "buffer_table.h"
+#include "config.h"
+#include "stats.h"
+#include "stream_ring.h"
+
+#define STREAM_RING_SIZE (STREAM_RING_SIZE_MB * 1024 * 1024)
+#define STREAM_RING_FRAMES 3 // Frames the GPU may still be reading from
+#define STREAM_DETECT_FRAMES 3
+#define STREAM_ALIGN 16
+#define MAX_STREAM_BUFFERS 256 // Power of two
+
+typedef struct {
+	GLuint id;
+	GLenum target;
+	uint8_t streamed;
+	uint8_t demoted; // Handed back to vitaGL once, its usage hint isn't trusted anymore
+	uint8_t used; // Drawn from since its last upload
+	uint8_t respecs; // Consecutive frames with a glBufferData
+	uint32_t uploaded; // Frame of the last glBufferData
+	uint32_t frame; // Of the ring allocation holding its bytes
+	uint32_t offset; // In the ring
+	GLsizeiptr size;
+	GLenum usage;
+} stream_buffer;
+
+static stream_buffer buffers[MAX_STREAM_BUFFERS];
+static GLuint ring = 0;
+static uint8_t *ring_mem = NULL;
+static uint8_t ring_failed = 0, ring_full_warned = 0;
+static uint32_t head = 0; // Bytes allocated since boot, wrapping padding included
+static uint32_t frame_head[STREAM_RING_FRAMES]; // head at the start of the frames in flight
+static uint32_t frame = 0;
+static GLuint bound[2]; // GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER
+
+static stream_buffer *find_buffer(GLuint id, int create) {
+	return (stream_buffer *)buffer_table_find(buffers, MAX_STREAM_BUFFERS, sizeof(stream_buffer), id, create);
+}
+
+static int binding_index(GLenum target) {
+	return target == GL_ELEMENT_ARRAY_BUFFER;
+}
+
+static int ring_init(void) {
+	if (ring_mem)
+		return 1;
+	if (ring_failed)
+		return 0;
+
+	glGenBuffers(1, &ring);
+	glBindBuffer(GL_ARRAY_BUFFER, ring);
+	glBufferData(GL_ARRAY_BUFFER, STREAM_RING_SIZE, NULL, GL_DYNAMIC_DRAW);
+	ring_mem = (uint8_t *)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+	glBindBuffer(GL_ARRAY_BUFFER, bound[0]);
+	if (!ring_mem) {
+		printf("[Stream] Failed to map a %d MB ring, dynamic buffers are left to vitaGL\n", STREAM_RING_SIZE_MB);
+		glDeleteBuffers(1, &ring);
+		ring = 0;
+		ring_failed = 1;
+		return 0;
+	}
+	printf("[Stream] Mapped a %d MB ring\n", STREAM_RING_SIZE_MB);
+	return 1;
+}
+
+static int ring_alloc(GLsizeiptr size, uint32_t *offset) {
+	uint32_t n = (size + STREAM_ALIGN - 1) & ~(STREAM_ALIGN - 1);
+	uint32_t start = head;
+	uint32_t phys = start % STREAM_RING_SIZE;
+	if (phys + n > STREAM_RING_SIZE)
+		start += STREAM_RING_SIZE - phys; // Never split an allocation across the wrap
+	// Bytes written by the oldest frame in flight must survive
+	if (start + n - frame_head[(frame + 1) % STREAM_RING_FRAMES] > STREAM_RING_SIZE) {
+		if (!ring_full_warned) {
+			printf("[Stream] Ring full, consider raising STREAM_RING_SIZE_MB\n");
+			ring_full_warned = 1;
+		}
+		return 0;
+	}
+	*offset = start % STREAM_RING_SIZE;
+	head = start + n;
+	return 1;
+}
+
+// Gives the buffer's data back to vitaGL, its ring bytes are about to be reused or it can't be streamed anymore
+static void demote(stream_buffer *b, const void *data) {
+	b->streamed = 0;
+	b->demoted = 1;
+	b->respecs = 0;
+	int bi = binding_index(b->target);
+	glBindBuffer(b->target, b->id);
+	glBufferData(b->target, b->size, data, b->usage);
+	glBindBuffer(b->target, bound[bi]);
+}
+
+void stream_ring_bind(GLenum target, GLuint buffer) {
+	if (target == GL_ARRAY_BUFFER || target == GL_ELEMENT_ARRAY_BUFFER)
+		bound[binding_index(target)] = buffer;
+}
+
+int stream_ring_buffer_data(GLenum target, GLuint buffer, GLsizeiptr size, const void *data, GLenum usage) {
+	stream_buffer *b = find_buffer(buffer, 1);
+	if (!b || (target != GL_ARRAY_BUFFER && target != GL_ELEMENT_ARRAY_BUFFER))
+		return 0;
+
+	if (!b->streamed) {
+		if (!b->respecs || b->uploaded != frame)
+			b->respecs = (b->respecs && b->uploaded + 1 == frame) ? b->respecs + 1 : 1;
+		b->uploaded = frame;
+		int dynamic = !b->demoted && (usage == GL_DYNAMIC_DRAW || usage == GL_STREAM_DRAW);
+		if (!dynamic && b->respecs < STREAM_DETECT_FRAMES)
+			return 0;
+		if (size > STREAM_RING_SIZE / 4 || !ring_init())
+			return 0;
+		if (!dynamic)
+			printf("[Stream] Buffer %u re-specified every frame, streaming it\n", buffer);
+	} else if (size > STREAM_RING_SIZE / 4) {
+		b->streamed = 0;
+		return 0;
+	}
+
+	uint32_t offset;
+	if (!ring_alloc(size, &offset)) {
+		b->streamed = 0;
+		return 0;
+	}
+	if (data) {
+		memcpy(ring_mem + offset, data, size);
+		stats_cur.stream_bytes += size;
+	}
+	b->target = target;
+	b->streamed = 1;
+	b->used = 0;
+	b->uploaded = frame;
+	b->frame = frame;
+	b->offset = offset;
+	b->size = size;
+	b->usage = usage;
+	return 1;
+}
+
+int stream_ring_buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data) {
+	stream_buffer *b = find_buffer(buffer, 0);
+	if (!b || !b->streamed)
+		return 0;
+	if (offset + size > b->size)
+		return 1; // GL_INVALID_VALUE, the data is left untouched
+
+	if (b->used) {
+		// The GPU may still read the current bytes, the whole buffer moves to fresh ones
+		uint32_t dst;
+		if (!ring_alloc(b->size, &dst)) {
+			demote(b, ring_mem + b->offset);
+			return 0;
+		}
+		memcpy(ring_mem + dst, ring_mem + b->offset, b->size);
+		stats_cur.stream_bytes += b->size - size;
+		b->offset = dst;
+		b->uploaded = frame;
+		b->frame = frame;
+		b->used = 0;
+	}
+	memcpy(ring_mem + b->offset + offset, data, size);
+	stats_cur.stream_bytes += size;
+	return 1;
+}
+
+void stream_ring_delete(GLuint buffer) {
+	stream_buffer *b = find_buffer(buffer, 0);
+	if (b) {
+		// Everything but the id goes, see buffer_table.c
+		memset(b, 0, sizeof(stream_buffer));
+		b->id = buffer;
+	}
+}
+
+GLuint stream_ring_buffer(void) {
+	return ring;
+}
+
+int stream_ring_offset(GLuint buffer, uintptr_t *offset) {
+	stream_buffer *b = find_buffer(buffer, 0);
+	if (!b || !b->streamed)
+		return 0;
+	if (b->frame != frame) {
+		// Bytes of an older frame are reused sooner than this draw may be done with them
+		uint32_t dst;
+		if (!ring_alloc(b->size, &dst)) {
+			demote(b, ring_mem + b->offset);
+			return 0;
+		}
+		memcpy(ring_mem + dst, ring_mem + b->offset, b->size);
+		stats_cur.stream_bytes += b->size;
+		b->offset = dst;
+		b->frame = frame;
+	}
+	b->used = 1;
+	*offset = b->offset;
+	return 1;
+}
+
+void stream_ring_frame(void) {
+	if (!ring_mem)
+		return;
+
+	for (int i = 0; i < MAX_STREAM_BUFFERS; i++) {
+		stream_buffer *b = &buffers[i];
+		if (b->streamed && frame - b->uploaded >= STREAM_RING_FRAMES - 1) {
+			printf("[Stream] Buffer %u not uploaded anymore, handing it back to vitaGL\n", b->id);
+			demote(b, ring_mem + b->offset);
+		}
+	}
+	frame++;
+	frame_head[frame % STREAM_RING_FRAMES] = head;
+}
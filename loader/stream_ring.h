@@ -0,0 +1,15 @@
+#ifndef __STREAM_RING_H__
+#define __STREAM_RING_H__
+
+#include <vitaGL.h>
+
+void stream_ring_bind(GLenum target, GLuint buffer);
+// 1 if the upload went to the ring instead of vitaGL, buffer must be bound to target
+int stream_ring_buffer_data(GLenum target, GLuint buffer, GLsizeiptr size, const void *data, GLenum usage);
+int stream_ring_buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data);
+void stream_ring_delete(GLuint buffer);
+GLuint stream_ring_buffer(void);
+int stream_ring_offset(GLuint buffer, uintptr_t *offset); // 1 if buffer is streamed, right before a draw reading it
+void stream_ring_frame(void);
+
+#endif
@@ -0,0 +1,382 @@
+/* tex_format.c -- 16 bit down-conversion of RGBA8 texture uploads
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Most UI and background art is opaque or only uses 1 bit alpha, yet it is
+ * uploaded as RGBA8. Images loaded through IMG_Load are tagged with the first
+ * texformat rule of settings.txt matching their path, and when their pixels
+ * get uploaded (glTexImage2D or SDL_CreateTextureFromSurface) they are
+ * converted to RGB565, RGBA5551 or RGBA4444. In auto mode the format follows
+ * the alpha channel and is only used if the PSNR of the converted image is
+ * at least TEX_FORMAT_MIN_PSNR.
+ */
+
+#include <vitaGL.h>
+#include <SDL2/SDL.h>
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "settings.h"
+#include "tex_format.h"
+
+#define MAX_RULES 32
+#define MAX_TAGGED 64
+#define MAX_CONVERTED 256
+
+enum {
+	MODE_KEEP,
+	MODE_AUTO,
+	MODE_RGB565,
+	MODE_RGBA5551,
+	MODE_RGBA4444,
+	MODE_NUM
+};
+
+enum {
+	ALPHA_OPAQUE,
+	ALPHA_BINARY,
+	ALPHA_FULL
+};
+
+static const char *mode_names[MODE_NUM] = {"keep", "auto", "rgb565", "rgba5551", "rgba4444"};
+
+static const struct {
+	GLenum format;
+	GLenum type;
+	const char *name;
+} formats[MODE_NUM] = {
+	[MODE_RGB565] = {GL_RGB, GL_UNSIGNED_SHORT_5_6_5, "RGB565"},
+	[MODE_RGBA5551] = {GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, "RGBA5551"},
+	[MODE_RGBA4444] = {GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, "RGBA4444"},
+};
+
+typedef struct {
+	char pattern[96];
+	uint8_t mode;
+} format_rule;
+
+typedef struct {
+	SDL_Surface *surface;
+	const void *pixels;
+	uint8_t mode;
+	char rel[64];
+} tagged_surface;
+
+typedef struct {
+	SDL_Texture *texture;
+	uint8_t mode;
+	uint8_t opaque;
+} converted_texture;
+
+static format_rule rules[MAX_RULES];
+static int rules_num = 0;
+static tagged_surface tagged[MAX_TAGGED];
+static int tagged_next = 0;
+static converted_texture converted[MAX_CONVERTED];
+static uint8_t err4[256], err5[256], err6[256]; // Squared error of a channel once quantized
+static uint32_t saved_bytes = 0;
+
+// Rounded v * n / 255 for 4, 5 and 6 bits, exact over 0-255 and within 16 bits for NEON
+static inline int quant4(int v) { return (v * 15 + 135) >> 8; }
+static inline int quant5(int v) { return (v * 249 + 1014) >> 11; }
+static inline int quant6(int v) { return (v * 253 + 505) >> 10; }
+
+static void init_tables(void) {
+	for (int v = 0; v < 256; v++) {
+		int e4 = v - quant4(v) * 17;
+		int e5 = v - (quant5(v) * 255 + 15) / 31;
+		int e6 = v - (quant6(v) * 255 + 31) / 63;
+		err4[v] = e4 * e4;
+		err5[v] = e5 * e5;
+		err6[v] = e6 * e6;
+	}
+}
+
+int tex_format_add_rule(const char *pattern, const char *mode) {
+	int m = 0;
+	while (m < MODE_NUM && strcmp(mode, mode_names[m]))
+		m++;
+	if (m == MODE_NUM)
+		return 0;
+	if (rules_num == MAX_RULES) {
+		printf("[TexFormat] Too many rules, %s ignored\n", pattern);
+		return 1;
+	}
+	if (!rules_num)
+		init_tables();
+	strncpy(rules[rules_num].pattern, pattern, sizeof(rules[0].pattern) - 1);
+	rules[rules_num++].mode = m;
+	return 1;
+}
+
+void tex_format_tag(SDL_Surface *surface, const char *rel) {
+	if (!surface || !rules_num)
+		return;
+	while (rel[0] == '.' && rel[1] == '/')
+		rel += 2;
+	int i = 0;
+	while (i < rules_num && !settings_match(rules[i].pattern, rel))
+		i++;
+	if (i == rules_num || rules[i].mode == MODE_KEEP)
+		return;
+
+	// Oldest tags are dropped if the game holds too many surfaces, their upload just won't be converted
+	tagged_surface *t = &tagged[tagged_next];
+	tagged_next = (tagged_next + 1) % MAX_TAGGED;
+	t->surface = surface;
+	t->pixels = surface->pixels;
+	t->mode = rules[i].mode;
+	size_t len = strlen(rel);
+	strcpy(t->rel, len < sizeof(t->rel) ? rel : rel + len - sizeof(t->rel) + 1);
+}
+
+void tex_format_untag(SDL_Surface *surface) {
+	for (int i = 0; i < MAX_TAGGED; i++) {
+		if (surface && tagged[i].surface == surface)
+			memset(&tagged[i], 0, sizeof(tagged_surface));
+	}
+}
+
+static int alpha_class(const uint8_t *px, int w, int h, int pitch) {
+	int res = ALPHA_OPAQUE;
+	for (int y = 0; y < h; y++, px += pitch) {
+		for (int x = 0; x < w; x++) {
+			uint8_t a = px[x * 4 + 3];
+			if (a != 0 && a != 255)
+				return ALPHA_FULL;
+			if (a == 0)
+				res = ALPHA_BINARY;
+		}
+	}
+	return res;
+}
+
+// Fully transparent texels don't count, their colour only shows through filtering
+static float psnr(const uint8_t *px, int w, int h, int pitch, int mode, int opaque) {
+	uint64_t sum = 0;
+	uint32_t num = 0;
+	for (int y = 0; y < h; y++, px += pitch) {
+		for (int x = 0; x < w; x++) {
+			const uint8_t *p = &px[x * 4];
+			if (!opaque && !p[3])
+				continue;
+			switch (mode) {
+			case MODE_RGB565:
+				sum += err5[p[0]] + err6[p[1]] + err5[p[2]];
+				break;
+			case MODE_RGBA5551:
+				sum += err5[p[0]] + err5[p[1]] + err5[p[2]];
+				break;
+			default:
+				sum += err4[p[0]] + err4[p[1]] + err4[p[2]] + (opaque ? 0 : err4[p[3]]);
+				break;
+			}
+			num++;
+		}
+	}
+	if (!sum || !num)
+		return 99.0f;
+	float mse = (float)sum / (num * (mode == MODE_RGBA4444 && !opaque ? 4 : 3));
+	return 10.0f * log10f(255.0f * 255.0f / mse);
+}
+
+static inline uint16_t pack(int r, int g, int b, int a, int mode) {
+	switch (mode) {
+	case MODE_RGB565:
+		return (quant5(r) << 11) | (quant6(g) << 5) | quant5(b);
+	case MODE_RGBA5551:
+		return (quant5(r) << 11) | (quant5(g) << 6) | (quant5(b) << 1) | (a >> 7);
+	default:
+		return (quant4(r) << 12) | (quant4(g) << 8) | (quant4(b) << 4) | quant4(a);
+	}
+}
+
+#ifdef __ARM_NEON__
+static inline uint16x8_t pack_neon(uint8x8_t r8, uint8x8_t g8, uint8x8_t b8, uint8x8_t a8, int mode) {
+	uint16x8_t r = vmovl_u8(r8), g = vmovl_u8(g8), b = vmovl_u8(b8), a = vmovl_u8(a8);
+	switch (mode) {
+	case MODE_RGB565:
+		r = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(1014), r, 249), 11);
+		g = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(505), g, 253), 10);
+		b = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(1014), b, 249), 11);
+		return vorrq_u16(vorrq_u16(vshlq_n_u16(r, 11), vshlq_n_u16(g, 5)), b);
+	case MODE_RGBA5551:
+		r = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(1014), r, 249), 11);
+		g = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(1014), g, 249), 11);
+		b = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(1014), b, 249), 11);
+		return vorrq_u16(vorrq_u16(vshlq_n_u16(r, 11), vshlq_n_u16(g, 6)), vorrq_u16(vshlq_n_u16(b, 1), vshrq_n_u16(a, 7)));
+	default:
+		r = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(135), r, 15), 8);
+		g = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(135), g, 15), 8);
+		b = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(135), b, 15), 8);
+		a = vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(135), a, 15), 8);
+		return vorrq_u16(vorrq_u16(vshlq_n_u16(r, 12), vshlq_n_u16(g, 8)), vorrq_u16(vshlq_n_u16(b, 4), a));
+	}
+}
+#endif
+
+static void convert(const uint8_t *src, int w, int h, int pitch, int mode, int opaque, uint16_t *dst, int dst_pitch) {
+	for (int y = 0; y < h; y++, src += pitch, dst += dst_pitch) {
+		int x = 0;
+#ifdef __ARM_NEON__
+		for (; x + 16 <= w; x += 16) {
+			uint8x16x4_t px = vld4q_u8(&src[x * 4]);
+			if (opaque)
+				px.val[3] = vdupq_n_u8(255);
+			vst1q_u16(&dst[x], pack_neon(vget_low_u8(px.val[0]), vget_low_u8(px.val[1]), vget_low_u8(px.val[2]), vget_low_u8(px.val[3]), mode));
+			vst1q_u16(&dst[x + 8], pack_neon(vget_high_u8(px.val[0]), vget_high_u8(px.val[1]), vget_high_u8(px.val[2]), vget_high_u8(px.val[3]), mode));
+		}
+#endif
+		for (; x < w; x++) {
+			const uint8_t *p = &src[x * 4];
+			dst[x] = pack(p[0], p[1], p[2], opaque ? 255 : p[3], mode);
+		}
+	}
+}
+
+static int pick_format(const uint8_t *px, int w, int h, int pitch, int mode, int opaque, const char *rel, float *quality) {
+	int m = mode;
+	if (mode == MODE_AUTO) {
+		int a = opaque ? ALPHA_OPAQUE : alpha_class(px, w, h, pitch);
+		m = a == ALPHA_OPAQUE ? MODE_RGB565 : (a == ALPHA_BINARY ? MODE_RGBA5551 : MODE_RGBA4444);
+	}
+	*quality = psnr(px, w, h, pitch, m, opaque);
+	if (mode == MODE_AUTO && *quality < TEX_FORMAT_MIN_PSNR) {
+		printf("[TexFormat] %s: kept as RGBA8 (%.1f dB as %s)\n", rel, *quality, formats[m].name);
+		return MODE_KEEP;
+	}
+	return m;
+}
+
+static void count_saved(const char *rel, int w, int h, int mode, float quality) {
+	saved_bytes += w * h * 2;
+	printf("[TexFormat] %s: %dx%d RGBA8 -> %s (%.1f dB, %u KB saved so far)\n", rel, w, h, formats[mode].name, quality, saved_bytes / 1024);
+}
+
+// Texture to be filled must be bound
+static int upload(GLenum target, GLint level, GLint x, GLint y, int w, int h, const uint8_t *px, int pitch, int mode, int opaque, int sub) {
+	uint16_t *buf = (uint16_t *)malloc(w * h * sizeof(uint16_t));
+	if (!buf)
+		return 0;
+	convert(px, w, h, pitch, mode, opaque, buf, w);
+
+	// Rows are tightly packed, whatever alignment the game or SDL left set
+	GLint align = 4;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &align);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	if (sub)
+		glTexSubImage2D(target, level, x, y, w, h, formats[mode].format, formats[mode].type, buf);
+	else
+		glTexImage2D(target, level, formats[mode].format, w, h, 0, formats[mode].format, formats[mode].type, buf);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, align);
+	free(buf);
+	return 1;
+}
+
+static tagged_surface *find_tagged(SDL_Surface *surface, const void *pixels) {
+	for (int i = 0; i < MAX_TAGGED; i++) {
+		tagged_surface *t = &tagged[i];
+		if (t->surface && (t->surface == surface || (pixels && t->pixels == pixels)))
+			return t;
+	}
+	return NULL;
+}
+
+static converted_texture *find_converted(SDL_Texture *texture) {
+	for (int i = 0; i < MAX_CONVERTED; i++) {
+		if (converted[i].texture == texture)
+			return &converted[i];
+	}
+	return NULL;
+}
+
+int tex_format_tex_image(GLenum target, GLint level, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels) {
+	if (!rules_num || !pixels || target != GL_TEXTURE_2D || level != 0 || format != GL_RGBA || type != GL_UNSIGNED_BYTE)
+		return 0;
+	tagged_surface *t = find_tagged(NULL, pixels);
+	if (!t || t->surface->w != width || t->surface->h != height)
+		return 0;
+
+	float q;
+	int m = pick_format((const uint8_t *)pixels, width, height, width * 4, t->mode, 0, t->rel, &q);
+	if (m == MODE_KEEP || !upload(target, level, 0, 0, width, height, (const uint8_t *)pixels, width * 4, m, 0, 0))
+		return 0;
+	count_saved(t->rel, width, height, m, q);
+	return 1;
+}
+
+int tex_format_sdl_texture(SDL_Texture *texture, SDL_Surface *surface) {
+	if (!rules_num || !texture || !surface)
+		return 0;
+	tagged_surface *t = find_tagged(surface, NULL);
+	if (!t)
+		return 0;
+
+	// The GL texture holds the bytes of the SDL format, swizzled back by SDL's shaders
+	Uint32 fmt;
+	if (SDL_QueryTexture(texture, &fmt, NULL, NULL, NULL) < 0)
+		return 0;
+	if (fmt != SDL_PIXELFORMAT_ARGB8888 && fmt != SDL_PIXELFORMAT_ABGR8888 && fmt != SDL_PIXELFORMAT_RGB888 && fmt != SDL_PIXELFORMAT_BGR888)
+		return 0;
+	int opaque = !SDL_ISPIXELFORMAT_ALPHA(fmt);
+	SDL_Surface *conv = surface;
+	if (surface->format->format != fmt || SDL_HasColorKey(surface)) {
+		conv = SDL_ConvertSurfaceFormat(surface, fmt, 0);
+		if (!conv)
+			return 0;
+	}
+
+	// Later SDL_UpdateTexture calls need to know about the conversion
+	converted_texture *c = find_converted(NULL);
+	int res = 0;
+	float q;
+	int m = c ? pick_format((const uint8_t *)conv->pixels, conv->w, conv->h, conv->pitch, t->mode, opaque, t->rel, &q) : MODE_KEEP;
+	if (m != MODE_KEEP && !SDL_GL_BindTexture(texture, NULL, NULL)) {
+		if (upload(GL_TEXTURE_2D, 0, 0, 0, conv->w, conv->h, (const uint8_t *)conv->pixels, conv->pitch, m, opaque, 0)) {
+			c->texture = texture;
+			c->mode = m;
+			c->opaque = opaque;
+			count_saved(t->rel, conv->w, conv->h, m, q);
+			res = 1;
+		}
+		SDL_GL_UnbindTexture(texture);
+	}
+	if (conv != surface)
+		SDL_FreeSurface(conv);
+	return res;
+}
+
+int tex_format_is_converted(SDL_Texture *texture) {
+	return texture && find_converted(texture);
+}
+
+int tex_format_update_texture(SDL_Texture *texture, const SDL_Rect *rect, const void *pixels, int pitch) {
+	converted_texture *c = find_converted(texture);
+	SDL_Rect full = {0, 0, 0, 0};
+	if (!rect) {
+		SDL_QueryTexture(texture, NULL, NULL, &full.w, &full.h);
+		rect = &full;
+	}
+	if (SDL_GL_BindTexture(texture, NULL, NULL) < 0)
+		return -1;
+	// Same bytes order as the texture, so the rect goes through the same conversion
+	upload(GL_TEXTURE_2D, 0, rect->x, rect->y, rect->w, rect->h, (const uint8_t *)pixels, pitch, c->mode, c->opaque, 1);
+	SDL_GL_UnbindTexture(texture);
+	return 0;
+}
+
+void tex_format_forget_texture(SDL_Texture *texture) {
+	converted_texture *c = find_converted(texture);
+	if (c)
+		c->texture = NULL;
+}
@@ -0,0 +1,21 @@
+#ifndef __TEX_FORMAT_H__
+#define __TEX_FORMAT_H__
+
+#include <vitaGL.h>
+
+// Also included by settings.c, which is built without SDL for tools/gl_replay
+typedef struct SDL_Surface SDL_Surface;
+typedef struct SDL_Texture SDL_Texture;
+typedef struct SDL_Rect SDL_Rect;
+
+int tex_format_add_rule(const char *pattern, const char *mode); // 0 if mode is unknown
+void tex_format_tag(SDL_Surface *surface, const char *rel); // Right after IMG_Load decoded rel
+void tex_format_untag(SDL_Surface *surface);
+// 1 if the upload went to vitaGL in a 16 bit format
+int tex_format_tex_image(GLenum target, GLint level, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels);
+int tex_format_sdl_texture(SDL_Texture *texture, SDL_Surface *surface); // Right after SDL_CreateTextureFromSurface, 1 if converted
+int tex_format_is_converted(SDL_Texture *texture);
+int tex_format_update_texture(SDL_Texture *texture, const SDL_Rect *rect, const void *pixels, int pitch);
+void tex_format_forget_texture(SDL_Texture *texture);
+
+#endif
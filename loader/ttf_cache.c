@@ -0,0 +1,323 @@
+/* ttf_cache.c -- cache of SDL_ttf rendered strings and metrics
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * SDL_ttf is linked statically in the game, which renders and measures the
+ * same standings, lap times and labels every frame. Its entry points are
+ * hooked so that a string already rasterized with the same font, size,
+ * style, outline, hinting and color gives back the same surface, referenced
+ * once more so that SDL_FreeSurface only drops the game's reference. Sizes
+ * are memoized the same way. The fonts state is tracked through the setters,
+ * since the game's TTF_Font layout isn't ours to read. Entries are evicted
+ * least recently used first to fit TTF_CACHE_BUDGET_KB, and a closed font
+ * drops all of its entries. Latin-1 calls go through the UTF-8 ones.
+ */
+
+#include <vitasdk.h>
+#include <kubridge.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "glyph_atlas.h"
+#include "so_util.h"
+#include "stats.h"
+#include "ttf_cache.h"
+
+#define MAX_FONTS 32
+#define MAX_ENTRIES 1024
+#define HASH_BITS 9
+#define MAX_LATIN1_LEN 256
+
+enum {
+	KIND_SIZE,
+	KIND_BLENDED
+};
+
+typedef struct {
+	TTF_Font *font;
+	int ptsize; // -1 if not opened through TTF_OpenFontRW
+	int style;
+	int outline;
+	int hinting;
+} font_state;
+
+typedef struct {
+	uint32_t hash;
+	int16_t next; // In the same bucket, -1 terminated
+	uint8_t kind;
+	font_state key;
+	uint32_t color;
+	char *text;
+	SDL_Surface *surface; // KIND_BLENDED
+	int w, h; // KIND_SIZE
+	uint32_t bytes;
+	uint32_t last_use;
+} text_entry;
+
+static font_state fonts[MAX_FONTS];
+static text_entry entries[MAX_ENTRIES];
+static int16_t buckets[1 << HASH_BITS];
+static uint32_t cache_bytes = 0;
+static uint32_t use_tick = 0;
+
+static so_hook open_font_hook, close_font_hook, set_style_hook, set_outline_hook, set_hinting_hook;
+static so_hook size_utf8_hook, render_utf8_hook, size_text_hook, render_text_hook;
+
+static font_state *get_font(TTF_Font *font) {
+	font_state *empty = NULL;
+	for (int i = 0; i < MAX_FONTS; i++) {
+		if (fonts[i].font == font)
+			return &fonts[i];
+		if (!empty && !fonts[i].font)
+			empty = &fonts[i];
+	}
+	// Every setter is hooked from boot, so the defaults are still in effect
+	if (empty) {
+		memset(empty, 0, sizeof(font_state));
+		empty->font = font;
+		empty->ptsize = -1;
+	}
+	return empty;
+}
+
+static uint32_t key_hash(int kind, const font_state *f, uint32_t color, const char *text) {
+	uint32_t h = 0x811C9DC5;
+	const uint8_t *p = (const uint8_t *)f;
+	for (int i = 0; i < sizeof(font_state); i++) {
+		h ^= p[i];
+		h *= 0x01000193;
+	}
+	h ^= color + kind;
+	h *= 0x01000193;
+	while (*text) {
+		h ^= (uint8_t)*text++;
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+static text_entry *lookup(int kind, const font_state *f, uint32_t color, const char *text, uint32_t hash) {
+	for (int i = buckets[hash & ((1 << HASH_BITS) - 1)]; i >= 0; i = entries[i].next) {
+		text_entry *e = &entries[i];
+		if (e->hash == hash && e->kind == kind && e->color == color && !memcmp(&e->key, f, sizeof(font_state)) && !strcmp(e->text, text)) {
+			e->last_use = ++use_tick;
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static void evict(text_entry *e) {
+	int16_t *link = &buckets[e->hash & ((1 << HASH_BITS) - 1)];
+	while (*link != e - entries)
+		link = &entries[*link].next;
+	*link = e->next;
+	if (e->surface) {
+		glyph_atlas_free_surface(e->surface);
+		SDL_FreeSurface(e->surface); // The game may still hold its own reference
+	}
+	free(e->text);
+	cache_bytes -= e->bytes;
+	memset(e, 0, sizeof(text_entry));
+}
+
+static text_entry *insert(int kind, const font_state *f, uint32_t color, const char *text, uint32_t hash, uint32_t bytes) {
+	bytes += sizeof(text_entry) + strlen(text) + 1;
+	if (bytes > TTF_CACHE_BUDGET_KB * 1024 / 4)
+		return NULL;
+
+	// Least recently used entries go first until the new one fits
+	text_entry *slot;
+	for (;;) {
+		text_entry *lru = NULL;
+		slot = NULL;
+		for (int i = 0; i < MAX_ENTRIES; i++) {
+			if (!entries[i].text) {
+				if (!slot)
+					slot = &entries[i];
+			} else if (!lru || entries[i].last_use < lru->last_use) {
+				lru = &entries[i];
+			}
+		}
+		if (slot && cache_bytes + bytes <= TTF_CACHE_BUDGET_KB * 1024)
+			break;
+		evict(lru);
+	}
+
+	slot->text = strdup(text);
+	if (!slot->text)
+		return NULL;
+	slot->hash = hash;
+	slot->kind = kind;
+	slot->key = *f;
+	slot->color = color;
+	slot->bytes = bytes;
+	slot->last_use = ++use_tick;
+	slot->next = buckets[hash & ((1 << HASH_BITS) - 1)];
+	buckets[hash & ((1 << HASH_BITS) - 1)] = slot - entries;
+	cache_bytes += bytes;
+	return slot;
+}
+
+static TTF_Font *TTF_OpenFontRW_hook(SDL_RWops *src, int freesrc, int ptsize) {
+	TTF_Font *font = SO_CONTINUE(TTF_Font *, open_font_hook, src, freesrc, ptsize);
+	if (font) {
+		font_state *f = get_font(font);
+		if (f)
+			f->ptsize = ptsize;
+	}
+	return font;
+}
+
+// The setters return void, the int SO_CONTINUE reads back is just r0
+
+static void TTF_CloseFont_hook(TTF_Font *font) {
+	for (int i = 0; i < MAX_ENTRIES; i++) {
+		if (entries[i].text && entries[i].key.font == font)
+			evict(&entries[i]);
+	}
+	glyph_atlas_forget_font(font);
+	for (int i = 0; i < MAX_FONTS; i++) {
+		if (fonts[i].font == font)
+			fonts[i].font = NULL;
+	}
+	SO_CONTINUE(int, close_font_hook, font);
+}
+
+static void TTF_SetFontStyle_hook(TTF_Font *font, int style) {
+	font_state *f = get_font(font);
+	if (f)
+		f->style = style;
+	SO_CONTINUE(int, set_style_hook, font, style);
+}
+
+static void TTF_SetFontOutline_hook(TTF_Font *font, int outline) {
+	font_state *f = get_font(font);
+	if (f)
+		f->outline = outline;
+	SO_CONTINUE(int, set_outline_hook, font, outline);
+}
+
+static void TTF_SetFontHinting_hook(TTF_Font *font, int hinting) {
+	font_state *f = get_font(font);
+	if (f)
+		f->hinting = hinting;
+	SO_CONTINUE(int, set_hinting_hook, font, hinting);
+}
+
+static int TTF_SizeUTF8_hook(TTF_Font *font, const char *text, int *w, int *h) {
+	font_state *f = get_font(font);
+	if (!f || !text)
+		return SO_CONTINUE(int, size_utf8_hook, font, text, w, h);
+
+	uint32_t hash = key_hash(KIND_SIZE, f, 0, text);
+	text_entry *e = lookup(KIND_SIZE, f, 0, text, hash);
+	if (e) {
+		stats_cur.text_hits++;
+	} else {
+		int tw, th;
+		int res = SO_CONTINUE(int, size_utf8_hook, font, text, &tw, &th);
+		stats_cur.text_misses++;
+		if (res < 0 || !(e = insert(KIND_SIZE, f, 0, text, hash, 0))) {
+			if (w)
+				*w = tw;
+			if (h)
+				*h = th;
+			return res;
+		}
+		e->w = tw;
+		e->h = th;
+	}
+	if (w)
+		*w = e->w;
+	if (h)
+		*h = e->h;
+	return 0;
+}
+
+static SDL_Surface *TTF_RenderUTF8_Blended_hook(TTF_Font *font, const char *text, SDL_Color fg) {
+	font_state *f = get_font(font);
+	if (!f || !text)
+		return SO_CONTINUE(SDL_Surface *, render_utf8_hook, font, text, fg);
+
+	uint32_t color = fg.r | (fg.g << 8) | (fg.b << 16) | (fg.a << 24);
+	uint32_t hash = key_hash(KIND_BLENDED, f, color, text);
+	text_entry *e = lookup(KIND_BLENDED, f, color, text, hash);
+	if (e) {
+		stats_cur.text_hits++;
+		// Undo whatever the previous owner did to the surface state
+		SDL_SetSurfaceColorMod(e->surface, 255, 255, 255);
+		SDL_SetSurfaceAlphaMod(e->surface, 255);
+		SDL_SetSurfaceBlendMode(e->surface, SDL_BLENDMODE_BLEND);
+		e->surface->refcount++;
+		return e->surface;
+	}
+
+	SDL_Surface *s = glyph_atlas_render(font, f->style, f->outline, f->hinting, text, fg);
+	if (!s)
+		s = SO_CONTINUE(SDL_Surface *, render_utf8_hook, font, text, fg);
+	stats_cur.text_misses++;
+	if (s && (e = insert(KIND_BLENDED, f, color, text, hash, s->pitch * s->h))) {
+		e->surface = s;
+		s->refcount++;
+	}
+	return s;
+}
+
+SDL_Surface *ttf_cache_render_uncached(TTF_Font *font, const char *text, SDL_Color fg) {
+	return SO_CONTINUE(SDL_Surface *, render_utf8_hook, font, text, fg);
+}
+
+static const char *latin1_to_utf8(const char *text, char *out) {
+	char *p = out;
+	for (; *text; text++) {
+		uint8_t c = *text;
+		if (p - out >= MAX_LATIN1_LEN * 2 - 2)
+			return NULL;
+		if (c < 0x80) {
+			*p++ = c;
+		} else {
+			*p++ = 0xC0 | (c >> 6);
+			*p++ = 0x80 | (c & 0x3F);
+		}
+	}
+	*p = 0;
+	return out;
+}
+
+// Converted here so that both encodings share the entries, the game's own conversion is only left for long strings
+
+static int TTF_SizeText_hook(TTF_Font *font, const char *text, int *w, int *h) {
+	char utf8[MAX_LATIN1_LEN * 2];
+	if (!text || !latin1_to_utf8(text, utf8))
+		return SO_CONTINUE(int, size_text_hook, font, text, w, h);
+	return TTF_SizeUTF8_hook(font, utf8, w, h);
+}
+
+static SDL_Surface *TTF_RenderText_Blended_hook(TTF_Font *font, const char *text, SDL_Color fg) {
+	char utf8[MAX_LATIN1_LEN * 2];
+	if (!text || !latin1_to_utf8(text, utf8))
+		return SO_CONTINUE(SDL_Surface *, render_text_hook, font, text, fg);
+	return TTF_RenderUTF8_Blended_hook(font, utf8, fg);
+}
+
+void ttf_cache_patch(so_module *mod) {
+	memset(buckets, 0xFF, sizeof(buckets));
+	open_font_hook = hook_addr(so_symbol(mod, "TTF_OpenFontRW"), (uintptr_t)&TTF_OpenFontRW_hook);
+	close_font_hook = hook_addr(so_symbol(mod, "TTF_CloseFont"), (uintptr_t)&TTF_CloseFont_hook);
+	set_style_hook = hook_addr(so_symbol(mod, "TTF_SetFontStyle"), (uintptr_t)&TTF_SetFontStyle_hook);
+	set_outline_hook = hook_addr(so_symbol(mod, "TTF_SetFontOutline"), (uintptr_t)&TTF_SetFontOutline_hook);
+	set_hinting_hook = hook_addr(so_symbol(mod, "TTF_SetFontHinting"), (uintptr_t)&TTF_SetFontHinting_hook);
+	size_utf8_hook = hook_addr(so_symbol(mod, "TTF_SizeUTF8"), (uintptr_t)&TTF_SizeUTF8_hook);
+	render_utf8_hook = hook_addr(so_symbol(mod, "TTF_RenderUTF8_Blended"), (uintptr_t)&TTF_RenderUTF8_Blended_hook);
+	size_text_hook = hook_addr(so_symbol(mod, "TTF_SizeText"), (uintptr_t)&TTF_SizeText_hook);
+	render_text_hook = hook_addr(so_symbol(mod, "TTF_RenderText_Blended"), (uintptr_t)&TTF_RenderText_Blended_hook);
+}
@@ -0,0 +1,11 @@
+#ifndef __TTF_CACHE_H__
+#define __TTF_CACHE_H__
+
+#include <SDL2/SDL_ttf.h>
+
+#include "so_util.h"
+
+void ttf_cache_patch(so_module *mod); // Hooks the SDL_ttf linked in mod
+SDL_Surface *ttf_cache_render_uncached(TTF_Font *font, const char *text, SDL_Color fg); // The game's own TTF_RenderUTF8_Blended
+
+#endif
@@ -0,0 +1,119 @@
+/* uniform_cache.c -- per-program shadow copies of uniform values
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * The game sets most of its uniforms again before every draw, and every
+ * glUniform* reaching vitaGL dirties the program's uniform buffer. Values up
+ * to a mat4 are kept per program and location, and an upload whose bytes
+ * match the last one is dropped. A table is made on the first upload to a
+ * program and reset when the program is relinked or deleted.
+ */
+
+#include <vitaGL.h>
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+#include "uniform_cache.h"
+
+#define MAX_PROGRAMS 128
+#define UNIFORM_BITS 5
+#define MAX_UNIFORMS (1 << UNIFORM_BITS) // Per program
+#define MAX_UNIFORM_SIZE 64 // mat4
+
+typedef struct {
+	GLint loc;
+	uint8_t used;
+	uint8_t size;
+	float val[MAX_UNIFORM_SIZE / sizeof(float)];
+} cached_uniform;
+
+typedef struct {
+	GLuint prog;
+	cached_uniform *uniforms; // MAX_UNIFORMS entries
+} program_uniforms;
+
+static program_uniforms programs[MAX_PROGRAMS];
+static int programs_num = 0;
+static program_uniforms *cur = NULL;
+static GLuint cur_prog = 0;
+
+int uniform_cache_mat4_equal(const float *a, const float *b) {
+#ifdef __ARM_NEON__
+	// Bitwise, like memcmp, but a single pass over 4 quad registers per matrix
+	uint32x4_t d = veorq_u32(vld1q_u32((const uint32_t *)a), vld1q_u32((const uint32_t *)b));
+	d = vorrq_u32(d, veorq_u32(vld1q_u32((const uint32_t *)a + 4), vld1q_u32((const uint32_t *)b + 4)));
+	d = vorrq_u32(d, veorq_u32(vld1q_u32((const uint32_t *)a + 8), vld1q_u32((const uint32_t *)b + 8)));
+	d = vorrq_u32(d, veorq_u32(vld1q_u32((const uint32_t *)a + 12), vld1q_u32((const uint32_t *)b + 12)));
+	uint32x2_t r = vorr_u32(vget_low_u32(d), vget_high_u32(d));
+	return !(vget_lane_u32(r, 0) | vget_lane_u32(r, 1));
+#else
+	return !memcmp(a, b, 16 * sizeof(float));
+#endif
+}
+
+static program_uniforms *find_program(GLuint prog, int create) {
+	for (int i = 0; i < programs_num; i++) {
+		if (programs[i].prog == prog)
+			return &programs[i];
+	}
+	if (!create || !prog || programs_num == MAX_PROGRAMS)
+		return NULL;
+
+	cached_uniform *u = (cached_uniform *)calloc(MAX_UNIFORMS, sizeof(cached_uniform));
+	if (!u)
+		return NULL;
+	program_uniforms *p = &programs[programs_num++];
+	p->prog = prog;
+	p->uniforms = u;
+	return p;
+}
+
+void uniform_cache_use_program(GLuint program) {
+	cur_prog = program;
+	cur = find_program(program, 0);
+}
+
+void uniform_cache_forget_program(GLuint program) {
+	program_uniforms *p = find_program(program, 0);
+	if (p)
+		memset(p->uniforms, 0, MAX_UNIFORMS * sizeof(cached_uniform));
+}
+
+int uniform_cache_unchanged(GLint location, const void *value, int size) {
+	stats_cur.uniform_calls++;
+	if (location == -1 || size > MAX_UNIFORM_SIZE)
+		return 0;
+	if (!cur) {
+		cur = find_program(cur_prog, 1);
+		if (!cur)
+			return 0;
+	}
+
+	// vitaGL locations are pointers, so the hash is taken from the high bits of the product
+	uint32_t h = ((uint32_t)location * 2654435761u) >> (32 - UNIFORM_BITS);
+	for (int i = 0; i < MAX_UNIFORMS; i++) {
+		cached_uniform *u = &cur->uniforms[(h + i) & (MAX_UNIFORMS - 1)];
+		if (u->used && u->loc != location)
+			continue;
+		if (u->used && u->size == size) {
+			if (size == MAX_UNIFORM_SIZE ? uniform_cache_mat4_equal(u->val, (const float *)value) : !memcmp(u->val, value, size)) {
+				stats_cur.uniform_elided++;
+				return 1;
+			}
+		}
+		u->loc = location;
+		u->used = 1;
+		u->size = size;
+		memcpy(u->val, value, size);
+		return 0;
+	}
+	return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef __UNIFORM_CACHE_H__
+#define __UNIFORM_CACHE_H__
+
+#include <vitaGL.h>
+
+void uniform_cache_use_program(GLuint program);
+void uniform_cache_forget_program(GLuint program); // Relinked or deleted, its uniforms are back to their defaults
+int uniform_cache_unchanged(GLint location, const void *value, int size); // 1 if the upload can be dropped
+int uniform_cache_mat4_equal(const float *a, const float *b);
+
+#endif
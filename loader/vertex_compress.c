@@ -0,0 +1,450 @@
+/* vertex_compress.c -- smaller vertex formats for the static meshes of the 3D view
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * GL_STATIC_DRAW array buffers are kept on the CPU until they're first drawn
+ * with a program reading a_Normal (vp_3d), which is when their interleaved
+ * layout is known. They are then re-uploaded with a_Location and a_TexCoords
+ * as half floats and a_Normal as normalized shorts, for every attribute whose
+ * values survive the conversion within the VCOMP_*_ERROR bounds; the others
+ * are copied as they are. Pointers the game sets on a converted buffer are
+ * rewritten to the new layout, and anything not matching it (other stride
+ * or offsets, partial updates) puts the original data back for good.
+ */
+
+#include <vitaGL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer_table.h"
+#include "vertex_compress.h"
+#include "vertex_formats.h"
+
+#define MAX_ATTRIBS 16
+#define MAX_PROGRAMS 64
+#define MAX_BUFFERS 1024 // Power of two
+#define MAX_ELEMS 8
+#define VCOMP_MIN_SIZE 1024
+#define VCOMP_COPY_BUDGET (16 * 1024 * 1024) // CPU copies kept for conversion and fallback
+
+#define VCOMP_POS_ERROR (1.0f / 256.0f) // In the mesh's own units, so far away track geometry stays in floats
+#define VCOMP_UV_ERROR (1.0f / 2048.0f) // Half a texel of a 1024x1024 texture
+#define VCOMP_NORMAL_RANGE 1.001f
+
+enum {
+	ROLE_POSITION,
+	ROLE_NORMAL,
+	ROLE_TEXCOORD,
+	ROLE_NUM
+};
+
+static const char *role_names[ROLE_NUM] = {
+	"a_Location",
+	"a_Normal",
+	"a_TexCoords"
+};
+
+enum {
+	BUFFER_NONE,
+	BUFFER_PENDING, // CPU copy waiting for the first draw
+	BUFFER_CONVERTED,
+	BUFFER_REJECTED
+};
+
+typedef struct {
+	GLuint prog;
+	GLint loc[ROLE_NUM];
+} program_roles;
+
+typedef struct {
+	GLint size;
+	GLenum type, new_type;
+	GLboolean normalized, new_normalized;
+	uint32_t offset, new_offset;
+} vertex_elem;
+
+typedef struct {
+	GLuint id;
+	uint8_t state;
+	uint8_t *data;
+	GLsizeiptr size;
+	GLenum usage;
+	GLsizei stride, new_stride;
+	int num_verts;
+	int num_elems;
+	vertex_elem elems[MAX_ELEMS];
+} vertex_buffer;
+
+typedef struct {
+	GLuint buffer;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLsizei stride;
+	const void *ptr;
+} attrib_rec;
+
+static program_roles programs[MAX_PROGRAMS];
+static int programs_num = 0;
+static program_roles *cur = NULL;
+
+static vertex_buffer buffers[MAX_BUFFERS];
+static attrib_rec recs[MAX_ATTRIBS];
+static uint32_t copies_size = 0;
+static uint32_t saved_bytes = 0;
+
+static int type_size(GLenum type) {
+	switch (type) {
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+	case GL_HALF_FLOAT_OES:
+		return 2;
+	case GL_FLOAT:
+	case GL_FIXED:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static vertex_buffer *find_buffer(GLuint id, int create) {
+	return (vertex_buffer *)buffer_table_find(buffers, MAX_BUFFERS, sizeof(vertex_buffer), id, create);
+}
+
+static uint32_t savings(vertex_buffer *b) {
+	return b->size - b->num_verts * b->new_stride;
+}
+
+static void free_copy(vertex_buffer *b) {
+	if (b->data) {
+		copies_size -= b->size;
+		free(b->data);
+		b->data = NULL;
+	}
+}
+
+static vertex_elem *find_elem(vertex_buffer *b, GLsizei stride, uintptr_t offset, GLint size, GLenum type) {
+	for (int j = 0; j < b->num_elems; j++) {
+		vertex_elem *e = &b->elems[j];
+		if (stride == b->stride && offset == e->offset && size == e->size && type == e->type)
+			return e;
+	}
+	return NULL;
+}
+
+// Reissues a pointer in the layout of b (original layout if NULL), 0 if it doesn't match any element of b
+static int issue_pointer(int i, vertex_buffer *b) {
+	attrib_rec *r = &recs[i];
+	if (b) {
+		vertex_elem *e = find_elem(b, r->stride, (uintptr_t)r->ptr, r->size, r->type);
+		if (!e)
+			return 0;
+		glVertexAttribPointer(i, e->size, e->new_type, e->new_normalized, b->new_stride, (const void *)(uintptr_t)e->new_offset);
+		return 1;
+	}
+	glVertexAttribPointer(i, r->size, r->type, r->normalized, r->stride, r->ptr);
+	return 1;
+}
+
+// Puts the original data back, with b bound to GL_ARRAY_BUFFER
+static void revert(vertex_buffer *b, int skip_index) {
+	glBufferData(GL_ARRAY_BUFFER, b->size, b->data, b->usage);
+	b->state = BUFFER_REJECTED;
+	saved_bytes -= savings(b);
+	for (int i = 0; i < MAX_ATTRIBS; i++) {
+		if (i != skip_index && recs[i].buffer == b->id)
+			issue_pointer(i, NULL);
+	}
+	free_copy(b);
+	printf("[VertexCompress] Buffer %u restored to its original layout\n", b->id);
+}
+
+static program_roles *get_program_roles(GLuint prog) {
+	for (int i = 0; i < programs_num; i++) {
+		if (programs[i].prog == prog)
+			return &programs[i];
+	}
+	if (!prog || programs_num == MAX_PROGRAMS)
+		return NULL;
+
+	program_roles *p = &programs[programs_num++];
+	p->prog = prog;
+	for (int i = 0; i < ROLE_NUM; i++)
+		p->loc[i] = glGetAttribLocation(prog, role_names[i]);
+	return p;
+}
+
+void vertex_compress_use_program(GLuint program) {
+	cur = get_program_roles(program);
+}
+
+void vertex_compress_buffer_data(GLuint buffer, GLsizeiptr size, const void *data, GLenum usage) {
+	int candidate = data && usage == GL_STATIC_DRAW && size >= VCOMP_MIN_SIZE && copies_size + size <= VCOMP_COPY_BUDGET;
+	vertex_buffer *b = find_buffer(buffer, candidate);
+	if (!b)
+		return;
+
+	if (b->state == BUFFER_CONVERTED) {
+		// The game will upload with this buffer bound, so its attributes just need their original format back
+		saved_bytes -= savings(b);
+		for (int i = 0; i < MAX_ATTRIBS; i++) {
+			if (recs[i].buffer == buffer)
+				issue_pointer(i, NULL);
+		}
+	}
+	free_copy(b);
+	b->state = BUFFER_NONE;
+	if (!candidate)
+		return;
+
+	b->data = (uint8_t *)malloc(size);
+	if (!b->data)
+		return;
+	memcpy(b->data, data, size);
+	copies_size += size;
+	b->size = size;
+	b->usage = usage;
+	b->state = BUFFER_PENDING;
+}
+
+void vertex_compress_buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data) {
+	vertex_buffer *b = find_buffer(buffer, 0);
+	if (!b || !b->data)
+		return;
+	if (offset + size <= b->size)
+		memcpy(b->data + offset, data, size);
+	if (b->state == BUFFER_CONVERTED) {
+		revert(b, -1);
+	} else {
+		b->state = BUFFER_REJECTED; // Not that static
+		free_copy(b);
+	}
+}
+
+void vertex_compress_delete(GLuint buffer) {
+	vertex_buffer *b = find_buffer(buffer, 0);
+	if (b) {
+		if (b->state == BUFFER_CONVERTED)
+			saved_bytes -= savings(b);
+		free_copy(b);
+		b->state = BUFFER_NONE;
+	}
+	for (int i = 0; i < MAX_ATTRIBS; i++) {
+		if (recs[i].buffer == buffer)
+			recs[i].buffer = 0;
+	}
+}
+
+void vertex_compress_pointer(GLuint index, GLuint buffer, GLint *size, GLenum *type, GLboolean *normalized, GLsizei *stride, const void **pointer) {
+	if (index >= MAX_ATTRIBS)
+		return;
+	attrib_rec *r = &recs[index];
+	r->buffer = buffer;
+	r->size = *size;
+	r->type = *type;
+	r->normalized = *normalized;
+	r->stride = *stride;
+	r->ptr = *pointer;
+
+	vertex_buffer *b = find_buffer(buffer, 0);
+	if (!b || b->state != BUFFER_CONVERTED)
+		return;
+	vertex_elem *e = find_elem(b, *stride, (uintptr_t)*pointer, *size, *type);
+	if (e) {
+		*type = e->new_type;
+		*normalized = e->new_normalized;
+		*stride = b->new_stride;
+		*pointer = (const void *)(uintptr_t)e->new_offset;
+		return;
+	}
+	revert(b, index);
+}
+
+static float read_float(const uint8_t *p) {
+	float f;
+	memcpy(&f, p, 4);
+	return f;
+}
+
+// Picks the new format of every element, 0 if nothing can be made smaller
+static int choose_formats(vertex_buffer *b, int num_verts, const int *roles) {
+	int saved = 0;
+
+	for (int j = 0; j < b->num_elems; j++) {
+		vertex_elem *e = &b->elems[j];
+		e->new_type = e->type;
+		e->new_normalized = e->normalized;
+		if (e->type != GL_FLOAT || roles[j] < 0)
+			continue;
+
+		int ok = 1;
+		switch (roles[j]) {
+		case ROLE_POSITION:
+			for (int v = 0; v < num_verts && ok; v++) {
+				const uint8_t *src = b->data + v * b->stride + e->offset;
+				for (int c = 0; c < e->size && ok; c++) {
+					float f = read_float(src + c * 4), d = half_to_float(float_to_half(f)) - f;
+					ok = (d < 0 ? -d : d) <= VCOMP_POS_ERROR;
+				}
+			}
+			if (ok)
+				e->new_type = GL_HALF_FLOAT_OES;
+			break;
+		case ROLE_TEXCOORD:
+			for (int v = 0; v < num_verts && ok; v++) {
+				const uint8_t *src = b->data + v * b->stride + e->offset;
+				for (int c = 0; c < e->size && ok; c++) {
+					float f = read_float(src + c * 4), d = half_to_float(float_to_half(f)) - f;
+					ok = (d < 0 ? -d : d) <= VCOMP_UV_ERROR;
+				}
+			}
+			if (ok)
+				e->new_type = GL_HALF_FLOAT_OES;
+			break;
+		case ROLE_NORMAL:
+			for (int v = 0; v < num_verts && ok; v++) {
+				const uint8_t *src = b->data + v * b->stride + e->offset;
+				for (int c = 0; c < e->size && ok; c++) {
+					float f = read_float(src + c * 4);
+					ok = f >= -VCOMP_NORMAL_RANGE && f <= VCOMP_NORMAL_RANGE;
+				}
+			}
+			if (ok) {
+				e->new_type = GL_SHORT;
+				e->new_normalized = GL_TRUE;
+			}
+			break;
+		}
+		if (e->new_type != e->type)
+			saved++;
+	}
+	return saved;
+}
+
+static void convert(vertex_buffer *b) {
+	int roles[MAX_ELEMS];
+	uint32_t end = 0;
+
+	// Only interleaved layouts with the role of every float attribute known are handled
+	for (int j = 0; j < b->num_elems; j++) {
+		vertex_elem *e = &b->elems[j];
+		uint32_t elem_size = e->size * type_size(e->type);
+		if (!elem_size || e->offset + elem_size > (uint32_t)b->stride)
+			return;
+		if (e->offset + elem_size > end)
+			end = e->offset + elem_size;
+		roles[j] = -1;
+		for (int r = 0; r < ROLE_NUM; r++) {
+			GLint i = cur->loc[r];
+			if (i >= 0 && i < MAX_ATTRIBS && recs[i].buffer == b->id && recs[i].stride == b->stride && (uintptr_t)recs[i].ptr == e->offset)
+				roles[j] = r;
+		}
+		if (roles[j] == ROLE_NORMAL && e->size != 3)
+			roles[j] = -1;
+	}
+	if (end > (uint32_t)b->size)
+		return;
+	int num_verts = (b->size - end) / b->stride + 1;
+	if (!choose_formats(b, num_verts, roles))
+		return;
+
+	// New layout, every element 4 bytes aligned
+	b->new_stride = 0;
+	for (int j = 0; j < b->num_elems; j++) {
+		vertex_elem *e = &b->elems[j];
+		e->new_offset = b->new_stride;
+		b->new_stride += (e->size * type_size(e->new_type) + 3) & ~3;
+	}
+
+	uint8_t *out = (uint8_t *)calloc(num_verts, b->new_stride);
+	if (!out)
+		return;
+	for (int v = 0; v < num_verts; v++) {
+		const uint8_t *src = b->data + v * b->stride;
+		uint8_t *dst = out + v * b->new_stride;
+		for (int j = 0; j < b->num_elems; j++) {
+			vertex_elem *e = &b->elems[j];
+			if (e->new_type == e->type) {
+				memcpy(dst + e->new_offset, src + e->offset, e->size * type_size(e->type));
+				continue;
+			}
+			for (int c = 0; c < e->size; c++) {
+				float f = read_float(src + e->offset + c * 4);
+				uint16_t val;
+				if (e->new_type == GL_SHORT) {
+					int16_t s = float_to_snorm16(f);
+					memcpy(&val, &s, 2);
+				} else {
+					val = float_to_half(f);
+				}
+				memcpy(dst + e->new_offset + c * 2, &val, 2);
+			}
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, b->id);
+	glBufferData(GL_ARRAY_BUFFER, num_verts * b->new_stride, out, b->usage);
+	free(out);
+	b->state = BUFFER_CONVERTED;
+	b->num_verts = num_verts;
+	saved_bytes += savings(b);
+	for (int i = 0; i < MAX_ATTRIBS; i++) {
+		if (recs[i].buffer == b->id && !issue_pointer(i, b)) {
+			revert(b, -1);
+			return;
+		}
+	}
+
+	printf("[VertexCompress] Buffer %u: %d vertices, stride %d -> %d bytes (%u KB saved so far)\n",
+		b->id, num_verts, b->stride, b->new_stride, saved_bytes / 1024);
+}
+
+void vertex_compress_draw(uint32_t enabled_mask, GLuint array_buffer) {
+	if (!cur || cur->loc[ROLE_NORMAL] < 0)
+		return;
+
+	int converted = 0;
+	for (int i = 0; i < MAX_ATTRIBS; i++) {
+		if (!(enabled_mask & (1 << i)))
+			continue;
+		vertex_buffer *b = find_buffer(recs[i].buffer, 0);
+		if (!b || b->state != BUFFER_PENDING)
+			continue;
+
+		// Layout of the buffer as read by every attribute pointing into it, disabled ones may be enabled later
+		b->stride = recs[i].stride;
+		b->num_elems = 0;
+		int ok = b->stride > 0;
+		for (int j = 0; j < MAX_ATTRIBS && ok; j++) {
+			if (recs[j].buffer != b->id || find_elem(b, recs[j].stride, (uintptr_t)recs[j].ptr, recs[j].size, recs[j].type))
+				continue;
+			if (recs[j].stride != b->stride || b->num_elems == MAX_ELEMS)
+				ok = 0;
+			else {
+				vertex_elem *e = &b->elems[b->num_elems++];
+				e->size = recs[j].size;
+				e->type = recs[j].type;
+				e->normalized = recs[j].normalized;
+				e->offset = (uintptr_t)recs[j].ptr;
+			}
+		}
+		if (ok)
+			convert(b);
+		if (b->state == BUFFER_CONVERTED) {
+			converted = 1;
+		} else {
+			b->state = BUFFER_REJECTED;
+			free_copy(b);
+		}
+	}
+	if (converted)
+		glBindBuffer(GL_ARRAY_BUFFER, array_buffer);
+}
@@ -0,0 +1,14 @@
+#ifndef __VERTEX_COMPRESS_H__
+#define __VERTEX_COMPRESS_H__
+
+#include <vitaGL.h>
+
+void vertex_compress_use_program(GLuint program);
+void vertex_compress_buffer_data(GLuint buffer, GLsizeiptr size, const void *data, GLenum usage);
+void vertex_compress_buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data);
+void vertex_compress_delete(GLuint buffer);
+// Records the game's pointer for index and turns it into the one matching buffer's compressed layout, buffer must be bound
+void vertex_compress_pointer(GLuint index, GLuint buffer, GLint *size, GLenum *type, GLboolean *normalized, GLsizei *stride, const void **pointer);
+void vertex_compress_draw(uint32_t enabled_mask, GLuint array_buffer); // Right before a non batched draw
+
+#endif
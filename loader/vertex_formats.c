@@ -0,0 +1,62 @@
+/* vertex_formats.c -- conversions to the smaller vertex formats of vertex_compress.c
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Shared with tools/vertex_format_check.c, which compares them with the
+ * host compiler's own half float conversions.
+ */
+
+#include <string.h>
+
+#include "vertex_formats.h"
+
+uint16_t float_to_half(float f) {
+	uint32_t x;
+	memcpy(&x, &f, 4);
+	uint32_t sign = (x >> 16) & 0x8000;
+	int32_t exp = (int32_t)((x >> 23) & 0xFF) - 127 + 15;
+	uint32_t mant = x & 0x7FFFFF;
+	if (exp == 0xFF - 127 + 15)
+		return sign | 0x7C00 | (mant ? 0x200 | (mant >> 13) : 0); // Infinity, or NaN kept quiet
+	if (exp >= 31)
+		return sign | 0x7C00;
+	if (exp <= 0) {
+		// Denormals, rounded to nearest even
+		if (exp < -10)
+			return sign;
+		mant |= 0x800000;
+		uint32_t shift = 14 - exp;
+		uint32_t h = mant >> shift, rem = mant & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+		if (rem > halfway || (rem == halfway && (h & 1)))
+			h++;
+		return sign | h;
+	}
+	uint32_t h = ((uint32_t)exp << 10) | (mant >> 13), rem = mant & 0x1FFF;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+		h++; // May carry into the exponent, which is still the right rounding
+	return sign | h;
+}
+
+float half_to_float(uint16_t h) {
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16, exp = (h >> 10) & 0x1F, mant = h & 0x3FF;
+	uint32_t x;
+	if (!exp) {
+		float f = mant * (1.0f / 16777216.0f);
+		return sign ? -f : f;
+	}
+	if (exp == 31)
+		x = sign | 0x7F800000 | (mant << 13);
+	else
+		x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+	float f;
+	memcpy(&f, &x, 4);
+	return f;
+}
+
+int16_t float_to_snorm16(float f) {
+	f = f > 1.0f ? 1.0f : (f < -1.0f ? -1.0f : f);
+	return (int16_t)(f * 32767.0f + (f < 0 ? -0.5f : 0.5f));
+}
@@ -0,0 +1,10 @@
+#ifndef __VERTEX_FORMATS_H__
+#define __VERTEX_FORMATS_H__
+
+#include <stdint.h>
+
+uint16_t float_to_half(float f); // Rounded to nearest even, as the GPU would
+float half_to_float(uint16_t h);
+int16_t float_to_snorm16(float f); // Clamped to [-1, 1], for normalized GL_SHORT attributes
+
+#endif
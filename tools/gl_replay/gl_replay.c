@@ -0,0 +1,437 @@
+/* gl_replay.c -- host replayer for GL captures made by loader/gl_capture.c
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Host tool, build with:
+ *   gcc -O2 -Iloader -Itools/gl_replay/include tools/gl_replay/gl_replay.c tools/gl_replay/null_gl.c \
+ *     loader/gl_hooks.c loader/gl_state.c loader/batch2d.c loader/stats.c loader/render_target.c loader/dynres.c loader/vertex_compress.c loader/index_reorder.c loader/settings.c loader/uniform_cache.c loader/stream_ring.c \
+ *     loader/program_cache.c loader/mvp_fold.c loader/glsl_translate.c loader/sha1.c -lm -o gl_replay
+ *
+ * Usage:
+ *   gl_replay [-shadows off|low|full] capture.bin
+ *
+ * Every recorded call goes through the same loader function default_dynlib
+ * maps it to on the Vita, down to null_gl.c, which does nothing but count
+ * what reaches it. Object names and uniform locations are remapped to the
+ * ones handed out during the replay, client side arrays are restored from
+ * the capture and texture uploads get a dummy payload of the right size.
+ * The CPU time spent per frame and the calls reaching the backend are
+ * printed at the end, so runs are comparable across loader changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vitaGL.h>
+
+#include "batch2d.h"
+#include "gl_capture_format.h"
+#include "gl_hooks.h"
+#include "gl_state.h"
+#include "index_reorder.h"
+#include "mvp_fold.h"
+#include "program_cache.h"
+#include "render_target.h"
+#include "settings.h"
+#include "stats.h"
+#include "stream_ring.h"
+
+#define MAX_NAMES 65536
+#define MAX_LOCATIONS 8192 // Power of two
+#define MAX_ATTRIBS 16
+#define CLIENT_ARRAY_SIZE (4 * 1024 * 1024)
+#define MAX_FRAMES 100000
+
+enum {
+	NAME_TEXTURE,
+	NAME_BUFFER,
+	NAME_FRAMEBUFFER,
+	NAME_RENDERBUFFER,
+	NAME_SHADER,
+	NAME_PROGRAM,
+	NAME_NUM
+};
+
+typedef struct {
+	uint32_t prog;
+	int32_t loc;
+	GLint mapped;
+	uint8_t used;
+} location_map;
+
+static const char *op_names[OP_NUM] = {
+#define CAPTURE_OP_NAME(name) #name,
+	CAPTURE_OPS(CAPTURE_OP_NAME)
+#undef CAPTURE_OP_NAME
+	"SDL_GL_SwapWindow"
+};
+
+static GLuint names[NAME_NUM][MAX_NAMES];
+static location_map locations[MAX_LOCATIONS];
+static uint32_t cur_program = 0, array_buffer = 0;
+static uint8_t *client_arrays[MAX_ATTRIBS];
+static uint8_t *dummy_pixels = NULL;
+static size_t dummy_pixels_size = 0;
+static uint64_t frame_ns[MAX_FRAMES];
+static int frames = 0;
+static uint32_t op_counts[OP_NUM];
+
+void null_gl_report(void);
+
+static GLuint map(int type, uint32_t id) {
+	return (id && id < MAX_NAMES && names[type][id]) ? names[type][id] : id;
+}
+
+static void map_names(int type, uint32_t n, const uint32_t *captured, const GLuint *replayed) {
+	for (uint32_t i = 0; i < n; i++) {
+		if (captured[i] < MAX_NAMES)
+			names[type][captured[i]] = replayed[i];
+	}
+}
+
+static location_map *find_location(uint32_t prog, int32_t loc, int create) {
+	uint32_t h = (prog * 0x9E3779B1 ^ (uint32_t)loc * 0x85EBCA6B) & (MAX_LOCATIONS - 1);
+	for (int i = 0; i < MAX_LOCATIONS; i++) {
+		location_map *l = &locations[(h + i) & (MAX_LOCATIONS - 1)];
+		if (!l->used) {
+			if (!create)
+				return NULL;
+			l->used = 1;
+			l->prog = prog;
+			l->loc = loc;
+			return l;
+		}
+		if (l->prog == prog && l->loc == loc)
+			return l;
+	}
+	return NULL;
+}
+
+static GLint map_location(uint32_t loc) {
+	if ((int32_t)loc == -1)
+		return -1;
+	location_map *l = find_location(cur_program, loc, 0);
+	return l ? l->mapped : (GLint)loc;
+}
+
+static float word_f(uint32_t w) {
+	float f;
+	memcpy(&f, &w, 4);
+	return f;
+}
+
+static const void *dummy_image(uint32_t size) {
+	if (size > dummy_pixels_size) {
+		dummy_pixels = realloc(dummy_pixels, size);
+		for (uint32_t i = dummy_pixels_size; i < size; i++)
+			dummy_pixels[i] = i * 31;
+		dummy_pixels_size = size;
+	}
+	return dummy_pixels;
+}
+
+static const uint8_t *restore_client_arrays(const uint8_t *p, uint32_t num) {
+	for (uint32_t i = 0; i < num; i++) {
+		capture_client_array c;
+		memcpy(&c, p, sizeof(c));
+		p += sizeof(c);
+		if (c.index < MAX_ATTRIBS)
+			memcpy(client_arrays[c.index], p, c.size < CLIENT_ARRAY_SIZE ? c.size : CLIENT_ARRAY_SIZE);
+		p += (c.size + 3) & ~3;
+	}
+	return p;
+}
+
+// IMG_Load isn't captured, so settings.txt rules on images have nothing to apply to
+int tex_format_add_rule(const char *pattern, const char *mode) {
+	return 1;
+}
+
+void async_load_add_pattern(const char *pattern) {
+}
+
+void async_load_forget_gl_texture(GLuint texture) {
+}
+
+// Neither are SDL renderer calls, so render_batch.c never holds anything
+void render_batch_flush(void) {
+}
+
+static void swap_window(void) {
+	// Same order as SDL_GL_SwapWindow_hook, minus what only concerns SDL
+	batch2d_flush();
+	program_cache_frame();
+	stream_ring_frame();
+	render_target_frame();
+	stats_frame();
+	render_target_begin_frame();
+}
+
+static void replay(int op, const uint32_t *w, const uint8_t *p) {
+	GLuint ids[256];
+	switch (op) {
+	case OP_glActiveTexture: glActiveTexture_hook(w[0]); break;
+	case OP_glBindTexture: glBindTexture_hook(w[0], map(NAME_TEXTURE, w[1])); break;
+	case OP_glEnable: glEnable_hook(w[0]); break;
+	case OP_glDisable: glDisable_hook(w[0]); break;
+	case OP_glBlendFunc: glBlendFunc_hook(w[0], w[1]); break;
+	case OP_glBlendFuncSeparate: glBlendFuncSeparate_hook(w[0], w[1], w[2], w[3]); break;
+	case OP_glBlendEquation: glBlendEquation_hook(w[0]); break;
+	case OP_glBlendEquationSeparate: glBlendEquationSeparate_hook(w[0], w[1]); break;
+	case OP_glBlendColor: glBlendColor_hook(word_f(w[0]), word_f(w[1]), word_f(w[2]), word_f(w[3])); break;
+	case OP_glViewport: glViewport_hook(w[0], w[1], w[2], w[3]); break;
+	case OP_glScissor: glScissor_hook(w[0], w[1], w[2], w[3]); break;
+	case OP_glDepthMask: glDepthMask_hook(w[0]); break;
+	case OP_glColorMask: glColorMask_hook(w[0], w[1], w[2], w[3]); break;
+	case OP_glDepthFunc: glDepthFunc_hook(w[0]); break;
+	case OP_glCullFace: glCullFace_hook(w[0]); break;
+	case OP_glFrontFace: glFrontFace(w[0]); break;
+	case OP_glClear: glClear_hook(w[0]); break;
+	case OP_glClearColor: glClearColor(word_f(w[0]), word_f(w[1]), word_f(w[2]), word_f(w[3])); break;
+	case OP_glClearDepthf: glClearDepthf(word_f(w[0])); break;
+	case OP_glStencilFunc: glStencilFunc(w[0], w[1], w[2]); break;
+	case OP_glStencilOp: glStencilOp(w[0], w[1], w[2]); break;
+	case OP_glStencilMask: glStencilMask(w[0]); break;
+	case OP_glPolygonOffset: glPolygonOffset(word_f(w[0]), word_f(w[1])); break;
+	case OP_glLineWidth: glLineWidth(word_f(w[0])); break;
+	case OP_glTexParameteri: glTexParameteri_hook(w[0], w[1], w[2]); break;
+	case OP_glTexParameterf: glTexParameterf(w[0], w[1], word_f(w[2])); break;
+	case OP_glGenerateMipmap: glGenerateMipmap(w[0]); break;
+	case OP_glFinish: glFinish_hook(); break;
+	case OP_glFlush: glFlush(); break;
+	case OP_glBindFramebuffer: glBindFramebuffer_hook(w[0], map(NAME_FRAMEBUFFER, w[1])); break;
+	case OP_glFramebufferTexture2D: glFramebufferTexture2D_hook(w[0], w[1], w[2], map(NAME_TEXTURE, w[3]), w[4]); break;
+	case OP_glBindRenderbuffer: glBindRenderbuffer(w[0], map(NAME_RENDERBUFFER, w[1])); break;
+	case OP_glRenderbufferStorage: glRenderbufferStorage(w[0], w[1], w[2], w[3]); break;
+	case OP_glFramebufferRenderbuffer: glFramebufferRenderbuffer(w[0], w[1], w[2], map(NAME_RENDERBUFFER, w[3])); break;
+	case OP_glGenTextures:
+	case OP_glGenBuffers:
+	case OP_glGenFramebuffers:
+	case OP_glGenRenderbuffers: {
+		uint32_t n = w[0] < 256 ? w[0] : 256;
+		int type = op == OP_glGenTextures ? NAME_TEXTURE : (op == OP_glGenBuffers ? NAME_BUFFER : (op == OP_glGenFramebuffers ? NAME_FRAMEBUFFER : NAME_RENDERBUFFER));
+		if (op == OP_glGenTextures)
+			glGenTextures(n, ids);
+		else if (op == OP_glGenBuffers)
+			glGenBuffers(n, ids);
+		else if (op == OP_glGenFramebuffers)
+			glGenFramebuffers(n, ids);
+		else
+			glGenRenderbuffers(n, ids);
+		map_names(type, n, (const uint32_t *)p, ids);
+		break;
+	}
+	case OP_glDeleteTextures:
+	case OP_glDeleteBuffers:
+	case OP_glDeleteFramebuffers:
+	case OP_glDeleteRenderbuffers: {
+		uint32_t n = w[0] < 256 ? w[0] : 256;
+		int type = op == OP_glDeleteTextures ? NAME_TEXTURE : (op == OP_glDeleteBuffers ? NAME_BUFFER : (op == OP_glDeleteFramebuffers ? NAME_FRAMEBUFFER : NAME_RENDERBUFFER));
+		for (uint32_t i = 0; i < n; i++)
+			ids[i] = map(type, ((const uint32_t *)p)[i]);
+		if (op == OP_glDeleteTextures)
+			glDeleteTextures_hook(n, ids);
+		else if (op == OP_glDeleteBuffers)
+			glDeleteBuffers_hook(n, ids);
+		else if (op == OP_glDeleteFramebuffers)
+			glDeleteFramebuffers_hook(n, ids);
+		else
+			glDeleteRenderbuffers(n, ids);
+		break;
+	}
+	case OP_glCreateShader:
+		ids[0] = glCreateShader_hook(w[0]);
+		map_names(NAME_SHADER, 1, &w[1], ids);
+		break;
+	case OP_glCreateProgram:
+		ids[0] = glCreateProgram();
+		map_names(NAME_PROGRAM, 1, &w[0], ids);
+		break;
+	case OP_glDeleteShader: glDeleteShader(map(NAME_SHADER, w[0])); break;
+	case OP_glDeleteProgram: glDeleteProgram_hook(map(NAME_PROGRAM, w[0])); break;
+	case OP_glShaderSource: {
+		const GLchar *src = (const GLchar *)p;
+		glShaderSource_hook(map(NAME_SHADER, w[0]), 1, &src, NULL);
+		break;
+	}
+	case OP_glAttachShader: glAttachShader_hook(map(NAME_PROGRAM, w[0]), map(NAME_SHADER, w[1])); break;
+	case OP_glBindAttribLocation: glBindAttribLocation_hook(map(NAME_PROGRAM, w[0]), w[1], (const GLchar *)p); break;
+	case OP_glLinkProgram: glLinkProgram_hook(map(NAME_PROGRAM, w[0])); break;
+	case OP_glUseProgram:
+		cur_program = w[0];
+		glUseProgram_hook(map(NAME_PROGRAM, w[0]));
+		break;
+	case OP_glGetUniformLocation:
+	case OP_glGetAttribLocation: {
+		GLuint prog = map(NAME_PROGRAM, w[0]);
+		if (op == OP_glGetAttribLocation) {
+			glGetAttribLocation_hook(prog, (const GLchar *)p);
+		} else {
+			location_map *l = find_location(w[0], w[1], 1);
+			GLint r = glGetUniformLocation_hook(prog, (const GLchar *)p);
+			if (l)
+				l->mapped = r;
+		}
+		break;
+	}
+	case OP_glBindBuffer:
+		if (w[0] == GL_ARRAY_BUFFER)
+			array_buffer = w[1];
+		glBindBuffer_hook(w[0], map(NAME_BUFFER, w[1]));
+		break;
+	case OP_glBufferData: glBufferData_hook(w[0], w[1], w[3] ? p : NULL, w[2]); break;
+	case OP_glBufferSubData: glBufferSubData_hook(w[0], w[1], w[2], p); break;
+	case OP_glVertexAttribPointer: {
+		const void *ptr = (const void *)(uintptr_t)w[5];
+		if (!array_buffer && w[0] < MAX_ATTRIBS)
+			ptr = client_arrays[w[0]];
+		glVertexAttribPointer_hook(w[0], w[1], w[2], w[3], w[4], ptr);
+		break;
+	}
+	case OP_glEnableVertexAttribArray: glEnableVertexAttribArray_hook(w[0]); break;
+	case OP_glDisableVertexAttribArray: glDisableVertexAttribArray_hook(w[0]); break;
+	case OP_glUniform1i: glUniform1i_hook(map_location(w[0]), w[1]); break;
+	case OP_glUniform1f: glUniform1f_hook(map_location(w[0]), word_f(w[1])); break;
+	case OP_glUniform2f: glUniform2f_hook(map_location(w[0]), word_f(w[1]), word_f(w[2])); break;
+	case OP_glUniform3f: glUniform3f_hook(map_location(w[0]), word_f(w[1]), word_f(w[2]), word_f(w[3])); break;
+	case OP_glUniform4f: glUniform4f_hook(map_location(w[0]), word_f(w[1]), word_f(w[2]), word_f(w[3]), word_f(w[4])); break;
+	case OP_glUniform1iv: glUniform1iv_hook(map_location(w[0]), w[1], (const GLint *)p); break;
+	case OP_glUniform1fv: glUniform1fv_hook(map_location(w[0]), w[1], (const GLfloat *)p); break;
+	case OP_glUniform2fv: glUniform2fv_hook(map_location(w[0]), w[1], (const GLfloat *)p); break;
+	case OP_glUniform3fv: glUniform3fv_hook(map_location(w[0]), w[1], (const GLfloat *)p); break;
+	case OP_glUniform4fv: glUniform4fv_hook(map_location(w[0]), w[1], (const GLfloat *)p); break;
+	case OP_glUniformMatrix3fv: glUniformMatrix3fv_hook(map_location(w[0]), w[1], w[2], (const GLfloat *)p); break;
+	case OP_glUniformMatrix4fv: glUniformMatrix4fv_hook(map_location(w[0]), w[1], w[2], (const GLfloat *)p); break;
+	case OP_glTexImage2D: {
+		// Same as dxt_cache.c's glTexImage2D_hook, precompressed textures aside
+		const void *pixels = w[8] ? dummy_image(capture_image_size(w[3], w[4], w[6], w[7])) : NULL;
+		batch2d_flush();
+		if (!render_target_tex_image(w[0], w[1], w[6], w[3], w[4], w[7], pixels))
+			glTexImage2D(w[0], w[1], w[2], w[3], w[4], w[5], w[6], w[7], pixels);
+		break;
+	}
+	case OP_glTexSubImage2D:
+		glTexSubImage2D_hook(w[0], w[1], w[2], w[3], w[4], w[5], w[6], w[7], dummy_image(capture_image_size(w[4], w[5], w[6], w[7])));
+		break;
+	case OP_glCompressedTexImage2D: glCompressedTexImage2D(w[0], w[1], w[2], w[3], w[4], w[5], w[6], dummy_image(w[6])); break;
+	case OP_glReadPixels:
+		glReadPixels_hook(w[0], w[1], w[2], w[3], w[4], w[5], (void *)dummy_image(capture_image_size(w[2], w[3], w[4], w[5])));
+		break;
+	case OP_glDrawArrays:
+		restore_client_arrays(p, w[3]);
+		glDrawArrays_hook(w[0], w[1], w[2]);
+		break;
+	case OP_glDrawElements: {
+		const void *indices = (const void *)(uintptr_t)w[3];
+		if (w[3] == 0xFFFFFFFF) {
+			uint32_t size = w[1] * (w[2] == GL_UNSIGNED_BYTE ? 1 : (w[2] == GL_UNSIGNED_SHORT ? 2 : 4));
+			indices = p;
+			p += (size + 3) & ~3;
+		}
+		restore_client_arrays(p, w[4]);
+		glDrawElements_hook(w[0], w[1], w[2], indices);
+		break;
+	}
+	case OP_FRAME:
+		swap_window();
+		break;
+	default:
+		break;
+	}
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc == 4 && !strcmp(argv[1], "-shadows")) {
+		shadow_quality = !strcmp(argv[2], "off") ? SHADOWS_OFF : (!strcmp(argv[2], "low") ? SHADOWS_LOW : SHADOWS_FULL);
+		argv += 2;
+		argc -= 2;
+	}
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s [-shadows off|low|full] capture.bin\n", argv[0]);
+		return 1;
+	}
+	FILE *f = fopen(argv[1], "rb");
+	if (!f) {
+		fprintf(stderr, "Error could not open %s.\n", argv[1]);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	size_t size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *buf = malloc(size);
+	if (fread(buf, 1, size, f) != size) {
+		fprintf(stderr, "Error could not read %s.\n", argv[1]);
+		return 1;
+	}
+	fclose(f);
+
+	capture_header *hdr = (capture_header *)buf;
+	if (size < sizeof(capture_header) || hdr->magic != CAPTURE_MAGIC || hdr->version != CAPTURE_VERSION) {
+		fprintf(stderr, "Error %s is not a capture of this version.\n", argv[1]);
+		return 1;
+	}
+
+	for (int i = 0; i < MAX_ATTRIBS; i++)
+		client_arrays[i] = calloc(1, CLIENT_ARRAY_SIZE);
+	gl_state_invalidate();
+
+	// Everything before the first swap (loading) is accounted as frame 0
+	const uint8_t *p = buf + sizeof(capture_header), *end = buf + size;
+	uint64_t frame_start = now_ns(), total = 0;
+	while (p + sizeof(capture_record) <= end) {
+		capture_record r;
+		memcpy(&r, p, sizeof(r));
+		p += sizeof(r);
+		const uint32_t *w = (const uint32_t *)p;
+		p += r.num_words * 4;
+		if (p + r.payload_size > end || r.op >= OP_NUM)
+			break;
+		replay(r.op, w, p);
+		p += r.payload_size;
+		op_counts[r.op]++;
+
+		if (r.op == OP_FRAME) {
+			uint64_t t = now_ns();
+			if (frames < MAX_FRAMES)
+				frame_ns[frames++] = t - frame_start;
+			total += t - frame_start;
+			frame_start = t;
+		}
+	}
+
+	printf("\nReplayed %d frames in %.3f ms\n", frames, total / 1000000.0);
+	if (frames > 1) {
+		// Frame 0 holds the loading, leave it out of the percentiles
+		qsort(frame_ns + 1, frames - 1, sizeof(uint64_t), cmp_u64);
+		int n = frames - 1;
+		printf("Per frame CPU time: p50 %.1f us, p95 %.1f us, p99 %.1f us, max %.1f us\n",
+			frame_ns[1 + n / 2] / 1000.0, frame_ns[1 + n * 95 / 100] / 1000.0, frame_ns[1 + n * 99 / 100] / 1000.0, frame_ns[n] / 1000.0);
+	}
+	printf("\nCalls recorded:\n");
+	for (int i = 0; i < OP_NUM; i++) {
+		if (op_counts[i])
+			printf("  %-28s %u\n", op_names[i], op_counts[i]);
+	}
+	float acmr_before, acmr_after;
+	index_reorder_acmr(&acmr_before, &acmr_after);
+	if (acmr_before > 0.0f)
+		printf("\nACMR of the reordered index ranges: %.3f -> %.3f\n", acmr_before, acmr_after);
+	null_gl_report();
+	return 0;
+}
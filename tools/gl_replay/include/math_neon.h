@@ -0,0 +1,14 @@
+/* math_neon.h -- host stand-in for math_neon, implemented by null_gl.c
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#ifndef __MATH_NEON_H__
+#define __MATH_NEON_H__
+
+void matmul4_neon(float m0[16], float m1[16], float d[16]);
+
+#endif
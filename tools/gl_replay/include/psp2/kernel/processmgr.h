@@ -0,0 +1,16 @@
+/* processmgr.h -- host stand-in for the SceLibKernel process functions, implemented by null_gl.c
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#ifndef __PSP2_KERNEL_PROCESSMGR_H__
+#define __PSP2_KERNEL_PROCESSMGR_H__
+
+#include <stdint.h>
+
+uint64_t sceKernelGetProcessTimeWide(void);
+
+#endif
@@ -0,0 +1,26 @@
+/* vitaGL.h -- host stand-in for vitaGL, implemented by null_gl.c
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#ifndef __VITAGL_H__
+#define __VITAGL_H__
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void *vglMalloc(uint32_t size);
+void vglFree(void *addr);
+void *vglGetTexDataPointer(GLenum target);
+void vglTexImageDepthBuffer(GLenum target);
+
+#define GL_WRITE_ONLY GL_WRITE_ONLY_OES
+void *glMapBuffer(GLenum target, GLenum access);
+GLboolean glUnmapBuffer(GLenum target);
+
+#endif
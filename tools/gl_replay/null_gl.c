@@ -0,0 +1,408 @@
+/* null_gl.c -- GL backend for gl_replay that only counts the calls reaching it
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Queries answer just enough for the loader modules to take their usual
+ * paths: links always succeed, uniforms found in the attached sources get a
+ * location, attributes get their bound location or the declaration order.
+ * Uniform locations look like vitaGL's, pointers above 0x80000000 (so negative
+ * as GLint), to catch any check other than == -1.
+ */
+
+#include <vitaGL.h>
+#include <math_neon.h>
+#include <psp2/kernel/processmgr.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_COUNTERS 128
+#define MAX_OBJECTS 65536
+#define MAX_NAMES_PER_PROGRAM 64
+
+typedef struct {
+	const char *name;
+	uint32_t calls;
+} counter;
+
+typedef struct {
+	GLuint shaders[2];
+	char *uniforms[MAX_NAMES_PER_PROGRAM];
+	int num_uniforms;
+	char *attribs[MAX_NAMES_PER_PROGRAM];
+	int attrib_locs[MAX_NAMES_PER_PROGRAM];
+	int num_attribs;
+} program_info;
+
+static counter counters[MAX_COUNTERS];
+static int num_counters = 0;
+static GLuint next_name = 1;
+static char *sources[MAX_OBJECTS];
+static program_info *programs[MAX_OBJECTS];
+
+static void count_call(int *idx, const char *name) {
+	if (*idx < 0) {
+		if (num_counters == MAX_COUNTERS)
+			return;
+		*idx = num_counters++;
+		counters[*idx].name = name;
+	}
+	counters[*idx].calls++;
+}
+
+#define COUNT(name) static int name##_idx = -1; count_call(&name##_idx, #name)
+
+#define NULL_GL(name, params) \
+	void name params { \
+		COUNT(name); \
+	}
+
+static void gen_names(GLsizei n, GLuint *ids) {
+	for (GLsizei i = 0; i < n; i++)
+		ids[i] = next_name++;
+}
+
+static program_info *get_program(GLuint program) {
+	if (!program || program >= MAX_OBJECTS)
+		return NULL;
+	if (!programs[program])
+		programs[program] = calloc(1, sizeof(program_info));
+	return programs[program];
+}
+
+// Identifier as written in the sources, without array subscripts
+static int declared(program_info *p, const char *name) {
+	char base[64];
+	strncpy(base, name, sizeof(base) - 1);
+	base[sizeof(base) - 1] = 0;
+	char *sub = strchr(base, '[');
+	if (sub)
+		*sub = 0;
+	size_t len = strlen(base);
+	for (int i = 0; i < 2; i++) {
+		const char *src = p->shaders[i] < MAX_OBJECTS ? sources[p->shaders[i]] : NULL;
+		while (src && (src = strstr(src, base))) {
+			char next = src[len];
+			if (next != '_' && !(next >= '0' && next <= '9') && !(next >= 'a' && next <= 'z') && !(next >= 'A' && next <= 'Z'))
+				return 1;
+			src += len;
+		}
+	}
+	return 0;
+}
+
+NULL_GL(glActiveTexture, (GLenum texture))
+NULL_GL(glBindTexture, (GLenum target, GLuint texture))
+NULL_GL(glEnable, (GLenum cap))
+NULL_GL(glDisable, (GLenum cap))
+NULL_GL(glBlendFunc, (GLenum sfactor, GLenum dfactor))
+NULL_GL(glBlendFuncSeparate, (GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha))
+NULL_GL(glBlendEquation, (GLenum mode))
+NULL_GL(glBlendEquationSeparate, (GLenum mode_rgb, GLenum mode_alpha))
+NULL_GL(glBlendColor, (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha))
+NULL_GL(glViewport, (GLint x, GLint y, GLsizei width, GLsizei height))
+NULL_GL(glScissor, (GLint x, GLint y, GLsizei width, GLsizei height))
+NULL_GL(glDepthMask, (GLboolean flag))
+NULL_GL(glColorMask, (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha))
+NULL_GL(glDepthFunc, (GLenum func))
+NULL_GL(glCullFace, (GLenum mode))
+NULL_GL(glFrontFace, (GLenum mode))
+NULL_GL(glClear, (GLbitfield mask))
+NULL_GL(glClearColor, (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha))
+NULL_GL(glClearDepthf, (GLfloat d))
+NULL_GL(glStencilFunc, (GLenum func, GLint ref, GLuint mask))
+NULL_GL(glStencilOp, (GLenum fail, GLenum zfail, GLenum zpass))
+NULL_GL(glStencilMask, (GLuint mask))
+NULL_GL(glPolygonOffset, (GLfloat factor, GLfloat units))
+NULL_GL(glLineWidth, (GLfloat width))
+NULL_GL(glTexParameteri, (GLenum target, GLenum pname, GLint param))
+NULL_GL(glTexParameterf, (GLenum target, GLenum pname, GLfloat param))
+NULL_GL(glGenerateMipmap, (GLenum target))
+NULL_GL(glFinish, (void))
+NULL_GL(glFlush, (void))
+NULL_GL(glBindFramebuffer, (GLenum target, GLuint framebuffer))
+NULL_GL(glFramebufferTexture2D, (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level))
+NULL_GL(glBindRenderbuffer, (GLenum target, GLuint renderbuffer))
+NULL_GL(glRenderbufferStorage, (GLenum target, GLenum internalformat, GLsizei width, GLsizei height))
+NULL_GL(glFramebufferRenderbuffer, (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer))
+NULL_GL(glDeleteTextures, (GLsizei n, const GLuint *textures))
+NULL_GL(glDeleteBuffers, (GLsizei n, const GLuint *buffers))
+NULL_GL(glDeleteFramebuffers, (GLsizei n, const GLuint *framebuffers))
+NULL_GL(glDeleteRenderbuffers, (GLsizei n, const GLuint *renderbuffers))
+NULL_GL(glCompileShader, (GLuint shader))
+NULL_GL(glShaderBinary, (GLsizei count, const GLuint *shaders, GLenum binaryFormat, const void *binary, GLsizei length))
+NULL_GL(glValidateProgram, (GLuint program))
+NULL_GL(glUseProgram, (GLuint program))
+NULL_GL(glBindBuffer, (GLenum target, GLuint buffer))
+NULL_GL(glBufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const void *data))
+NULL_GL(glVertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer))
+NULL_GL(glEnableVertexAttribArray, (GLuint index))
+NULL_GL(glDisableVertexAttribArray, (GLuint index))
+NULL_GL(glUniform1i, (GLint location, GLint v0))
+NULL_GL(glUniform1f, (GLint location, GLfloat v0))
+NULL_GL(glUniform2f, (GLint location, GLfloat v0, GLfloat v1))
+NULL_GL(glUniform3f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2))
+NULL_GL(glUniform4f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3))
+NULL_GL(glUniform1iv, (GLint location, GLsizei count, const GLint *value))
+NULL_GL(glUniform2iv, (GLint location, GLsizei count, const GLint *value))
+NULL_GL(glUniform3iv, (GLint location, GLsizei count, const GLint *value))
+NULL_GL(glUniform4iv, (GLint location, GLsizei count, const GLint *value))
+NULL_GL(glUniform1fv, (GLint location, GLsizei count, const GLfloat *value))
+NULL_GL(glUniform2fv, (GLint location, GLsizei count, const GLfloat *value))
+NULL_GL(glUniform3fv, (GLint location, GLsizei count, const GLfloat *value))
+NULL_GL(glUniform4fv, (GLint location, GLsizei count, const GLfloat *value))
+NULL_GL(glUniformMatrix2fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat *value))
+NULL_GL(glUniformMatrix3fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat *value))
+NULL_GL(glUniformMatrix4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat *value))
+NULL_GL(glTexImage2D, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels))
+NULL_GL(glTexSubImage2D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels))
+NULL_GL(glCompressedTexImage2D, (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void *data))
+NULL_GL(glReadPixels, (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *pixels))
+NULL_GL(glDrawArrays, (GLenum mode, GLint first, GLsizei count))
+NULL_GL(glDrawElements, (GLenum mode, GLsizei count, GLenum type, const void *indices))
+
+void glGenTextures(GLsizei n, GLuint *textures) {
+	COUNT(glGenTextures);
+	gen_names(n, textures);
+}
+
+void glGenBuffers(GLsizei n, GLuint *buffers) {
+	COUNT(glGenBuffers);
+	gen_names(n, buffers);
+}
+
+static GLsizeiptr last_buffer_size = 0;
+
+void glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) {
+	COUNT(glBufferData);
+	last_buffer_size = size;
+}
+
+// Only used on a buffer right after sizing it, which is kept mapped for good
+void *glMapBuffer(GLenum target, GLenum access) {
+	COUNT(glMapBuffer);
+	return calloc(1, last_buffer_size);
+}
+
+GLboolean glUnmapBuffer(GLenum target) {
+	COUNT(glUnmapBuffer);
+	return GL_TRUE;
+}
+
+void glGenFramebuffers(GLsizei n, GLuint *framebuffers) {
+	COUNT(glGenFramebuffers);
+	gen_names(n, framebuffers);
+}
+
+void glGenRenderbuffers(GLsizei n, GLuint *renderbuffers) {
+	COUNT(glGenRenderbuffers);
+	gen_names(n, renderbuffers);
+}
+
+GLuint glCreateShader(GLenum type) {
+	COUNT(glCreateShader);
+	return next_name++;
+}
+
+GLuint glCreateProgram(void) {
+	COUNT(glCreateProgram);
+	return next_name++;
+}
+
+void glDeleteShader(GLuint shader) {
+	COUNT(glDeleteShader);
+	if (shader < MAX_OBJECTS) {
+		free(sources[shader]);
+		sources[shader] = NULL;
+	}
+}
+
+void glDeleteProgram(GLuint program) {
+	COUNT(glDeleteProgram);
+	if (program < MAX_OBJECTS && programs[program]) {
+		program_info *p = programs[program];
+		for (int i = 0; i < p->num_uniforms; i++)
+			free(p->uniforms[i]);
+		for (int i = 0; i < p->num_attribs; i++)
+			free(p->attribs[i]);
+		free(p);
+		programs[program] = NULL;
+	}
+}
+
+void glShaderSource(GLuint shader, GLsizei count, const GLchar *const *string, const GLint *length) {
+	COUNT(glShaderSource);
+	if (shader >= MAX_OBJECTS)
+		return;
+	size_t size = 1;
+	for (GLsizei i = 0; i < count; i++)
+		size += length && length[i] >= 0 ? length[i] : strlen(string[i]);
+	free(sources[shader]);
+	sources[shader] = malloc(size);
+	size = 0;
+	for (GLsizei i = 0; i < count; i++) {
+		size_t len = length && length[i] >= 0 ? length[i] : strlen(string[i]);
+		memcpy(sources[shader] + size, string[i], len);
+		size += len;
+	}
+	sources[shader][size] = 0;
+}
+
+void glAttachShader(GLuint program, GLuint shader) {
+	COUNT(glAttachShader);
+	program_info *p = get_program(program);
+	if (p)
+		p->shaders[p->shaders[0] ? 1 : 0] = shader;
+}
+
+void glBindAttribLocation(GLuint program, GLuint index, const GLchar *name) {
+	COUNT(glBindAttribLocation);
+	program_info *p = get_program(program);
+	if (!p || p->num_attribs == MAX_NAMES_PER_PROGRAM)
+		return;
+	p->attribs[p->num_attribs] = strdup(name);
+	p->attrib_locs[p->num_attribs++] = index;
+}
+
+void glLinkProgram(GLuint program) {
+	COUNT(glLinkProgram);
+}
+
+void glGetProgramiv(GLuint program, GLenum pname, GLint *params) {
+	COUNT(glGetProgramiv);
+	*params = (pname == GL_LINK_STATUS || pname == GL_VALIDATE_STATUS) ? GL_TRUE : 0;
+}
+
+void glGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog) {
+	COUNT(glGetProgramInfoLog);
+	if (length)
+		*length = 0;
+	if (bufSize)
+		infoLog[0] = 0;
+}
+
+static GLint uniform_location(GLuint program, int idx) {
+	return (GLint)(0x81000000u + (program << 8) + idx * 4);
+}
+
+GLint glGetUniformLocation(GLuint program, const GLchar *name) {
+	COUNT(glGetUniformLocation);
+	program_info *p = get_program(program);
+	if (!p || !declared(p, name))
+		return -1;
+	for (int i = 0; i < p->num_uniforms; i++) {
+		if (!strcmp(p->uniforms[i], name))
+			return uniform_location(program, i);
+	}
+	if (p->num_uniforms == MAX_NAMES_PER_PROGRAM)
+		return -1;
+	p->uniforms[p->num_uniforms] = strdup(name);
+	return uniform_location(program, p->num_uniforms++);
+}
+
+GLint glGetAttribLocation(GLuint program, const GLchar *name) {
+	COUNT(glGetAttribLocation);
+	program_info *p = get_program(program);
+	if (!p || !declared(p, name))
+		return -1;
+	int next = 0;
+	for (int i = 0; i < p->num_attribs; i++) {
+		if (!strcmp(p->attribs[i], name))
+			return p->attrib_locs[i];
+		if (p->attrib_locs[i] >= next)
+			next = p->attrib_locs[i] + 1;
+	}
+	if (p->num_attribs == MAX_NAMES_PER_PROGRAM)
+		return -1;
+	p->attribs[p->num_attribs] = strdup(name);
+	p->attrib_locs[p->num_attribs++] = next;
+	return next;
+}
+
+void glGetActiveUniform(GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLint *size, GLenum *type, GLchar *name) {
+	COUNT(glGetActiveUniform);
+	if (length)
+		*length = 0;
+	*size = 0;
+	*type = GL_FLOAT;
+	if (bufSize)
+		name[0] = 0;
+}
+
+void glGetActiveAttrib(GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLint *size, GLenum *type, GLchar *name) {
+	COUNT(glGetActiveAttrib);
+	if (length)
+		*length = 0;
+	*size = 0;
+	*type = GL_FLOAT;
+	if (bufSize)
+		name[0] = 0;
+}
+
+void glGetIntegerv(GLenum pname, GLint *data) {
+	COUNT(glGetIntegerv);
+	switch (pname) {
+	case GL_VIEWPORT:
+	case GL_SCISSOR_BOX:
+	case GL_COLOR_WRITEMASK:
+		memset(data, 0, 4 * sizeof(GLint));
+		break;
+	default:
+		*data = 0;
+		break;
+	}
+}
+
+GLboolean glIsEnabled(GLenum cap) {
+	COUNT(glIsEnabled);
+	return GL_FALSE;
+}
+
+void *vglMalloc(uint32_t size) {
+	return malloc(size);
+}
+
+void vglFree(void *addr) {
+	free(addr);
+}
+
+void *vglGetTexDataPointer(GLenum target) {
+	return NULL;
+}
+
+void vglTexImageDepthBuffer(GLenum target) {
+	COUNT(vglTexImageDepthBuffer);
+}
+
+uint64_t sceKernelGetProcessTimeWide(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+void matmul4_neon(float m0[16], float m1[16], float d[16]) {
+	float r[16];
+	for (int c = 0; c < 4; c++) {
+		for (int i = 0; i < 4; i++) {
+			r[c * 4 + i] = m0[i] * m1[c * 4] + m0[4 + i] * m1[c * 4 + 1] + m0[8 + i] * m1[c * 4 + 2] + m0[12 + i] * m1[c * 4 + 3];
+		}
+	}
+	memcpy(d, r, sizeof(r));
+}
+
+static int cmp_counters(const void *a, const void *b) {
+	const counter *x = (const counter *)a, *y = (const counter *)b;
+	return x->calls < y->calls ? 1 : (x->calls > y->calls ? -1 : 0);
+}
+
+void null_gl_report(void) {
+	qsort(counters, num_counters, sizeof(counter), cmp_counters);
+	printf("\nCalls reaching vitaGL:\n");
+	for (int i = 0; i < num_counters; i++)
+		printf("  %-28s %u\n", counters[i].name, counters[i].calls);
+}
@@ -0,0 +1,146 @@
+/* glyph_compare.c -- checks glyph_atlas.c text against SDL_ttf's own
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Host tool, build with:
+ *   gcc -O2 -Iloader tools/glyph_compare.c loader/glyph_layout.c -lSDL2 -lSDL2_ttf -lm -o glyph_compare
+ *
+ * Usage:
+ *   glyph_compare font.ttf ptsize strings.txt
+ *
+ * Renders every line of strings.txt (UTF-8) with TTF_RenderUTF8_Blended, then
+ * composes it again the way the loader draws it: each glyph rendered alone
+ * and blended at the position glyph_layout.c gives. Coverage (alpha) of both
+ * is compared per string, and the exit code is 1 if any string differs by
+ * more than MAX_ALPHA_DIFF on a pixel or has a different size. Link against
+ * the SDL_ttf release the game ships (2.0.15), later ones lay text out
+ * differently.
+ */
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glyph_layout.h"
+
+#define MAX_GLYPHS 256
+#define MAX_ALPHA_DIFF 8 // Glyphs overlapping are blended on the GPU, SDL_ttf ORs them
+
+static int glyph_metrics(TTF_Font *font, Uint16 ch, int *minx, int *maxx, int *miny, int *maxy, int *advance) {
+	return TTF_GlyphMetrics(font, ch, minx, maxx, miny, maxy, advance);
+}
+
+static int get_font_kerning(const TTF_Font *font) {
+	return TTF_GetFontKerning(font);
+}
+
+static int kerning_size_glyphs(TTF_Font *font, Uint16 previous_ch, Uint16 ch) {
+	return TTF_GetFontKerningSizeGlyphs(font, previous_ch, ch);
+}
+
+static uint8_t alpha_at(SDL_Surface *s, int x, int y) {
+	return ((uint32_t *)((uint8_t *)s->pixels + y * s->pitch))[x] >> 24;
+}
+
+// Composes text out of single glyphs, 8 bit coverage per pixel
+static uint8_t *compose(TTF_Font *font, const char *text, int w, int h) {
+	glyph_funcs f = {glyph_metrics, get_font_kerning, kerning_size_glyphs};
+	glyph_pos pos[MAX_GLYPHS];
+	int n = glyph_layout(&f, font, text, pos, MAX_GLYPHS);
+	if (n < 0)
+		return NULL;
+
+	uint8_t *out = (uint8_t *)calloc(w * h, 1);
+	SDL_Color white = {255, 255, 255, 255};
+	for (int i = 0; i < n; i++) {
+		char utf8[4];
+		glyph_utf8(pos[i].ch, utf8);
+		SDL_Surface *g = TTF_RenderUTF8_Blended(font, utf8, white);
+		if (!g)
+			continue;
+		for (int y = 0; y < g->h && y < h; y++) {
+			for (int x = 0; x < g->w; x++) {
+				int dx = pos[i].x + x;
+				if (dx < 0 || dx >= w)
+					continue;
+				// Source over, as SDL_BLENDMODE_BLEND does on screen
+				int a = alpha_at(g, x, y);
+				uint8_t *d = &out[y * w + dx];
+				*d = a + *d * (255 - a) / 255;
+			}
+		}
+		SDL_FreeSurface(g);
+	}
+	return out;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 4) {
+		printf("Usage: %s font.ttf ptsize strings.txt\n", argv[0]);
+		return -1;
+	}
+	if (TTF_Init() < 0) {
+		printf("TTF_Init failed: %s\n", TTF_GetError());
+		return -1;
+	}
+	TTF_Font *font = TTF_OpenFont(argv[1], atoi(argv[2]));
+	FILE *f = fopen(argv[3], "r");
+	if (!font || !f) {
+		printf("Cannot open %s or %s\n", argv[1], argv[3]);
+		return -1;
+	}
+
+	char line[1024];
+	int strings = 0, failed = 0, skipped = 0;
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = 0;
+		if (!line[0])
+			continue;
+		SDL_Color white = {255, 255, 255, 255};
+		SDL_Surface *ref = TTF_RenderUTF8_Blended(font, line, white);
+		int w = 0, h = 0;
+		TTF_SizeUTF8(font, line, &w, &h);
+		uint8_t *ours = ref ? compose(font, line, ref->w, ref->h) : NULL;
+		if (!ours) {
+			// The loader rasterizes these whole too
+			skipped++;
+			if (ref)
+				SDL_FreeSurface(ref);
+			continue;
+		}
+		strings++;
+
+		int max_diff = 0;
+		double sq = 0.0;
+		for (int y = 0; y < ref->h; y++) {
+			for (int x = 0; x < ref->w; x++) {
+				int d = abs(alpha_at(ref, x, y) - ours[y * ref->w + x]);
+				if (d > max_diff)
+					max_diff = d;
+				sq += d * d;
+			}
+		}
+		double mse = sq / (ref->w * ref->h);
+		int bad = max_diff > MAX_ALPHA_DIFF || ref->w != w || ref->h != h;
+		if (bad) {
+			failed++;
+			printf("MISMATCH \"%s\": %dx%d (loader %dx%d), max diff %d, PSNR %.1f dB\n", line, ref->w, ref->h, w, h,
+				max_diff, mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY);
+		}
+		free(ours);
+		SDL_FreeSurface(ref);
+	}
+	fclose(f);
+	printf("%d strings compared, %d mismatching, %d left to SDL_ttf\n", strings, failed, skipped);
+
+	TTF_CloseFont(font);
+	TTF_Quit();
+	return failed ? 1 : 0;
+}
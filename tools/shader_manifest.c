@@ -0,0 +1,322 @@
+/* shader_manifest.c -- offline GLSL extraction and shader cache manifest for libmain.so
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Host tool, build with:
+ *   gcc -O2 -Iloader tools/shader_manifest.c loader/glsl_translate.c loader/sha1.c -o shader_manifest
+ *
+ * Usage:
+ *   shader_manifest libmain.so [-c shaders_dir] [-d dump_dir]
+ *
+ * Maps the loadable segments of libmain.so the same way so_util does (offsets
+ * are relative to text_base), extracts every GLSL source string, applies the
+ * ShaderProgram replacement rules from shader_patches.h and the GLSL ES 3.00
+ * translation from glsl_translate.c, and prints the cache key
+ * glShaderSource_hook will compute for every shader reaching the driver.
+ * Rules match on a vertex/fragment pair, so sources are paired the way the
+ * driver links them: a fragment shader goes with every vertex shader writing
+ * all of its varyings. An original replaced in all of its pairs (e.g. through
+ * a rule matching on its partner) never reaches the driver and isn't listed.
+ * With -c, keys are checked against a folder of precompiled *_glsl.gxp files
+ * and the tool fails if any is missing. With -d, the final sources are dumped
+ * as <key>.glsl so they can be compiled ahead of time (and translations can
+ * be checked against the original sources).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elf.h"
+#include "sha1.h"
+#include "glsl_translate.h"
+#include "shader_patches.h"
+
+#define MAX_SHADERS 512
+#define MAX_VARYINGS 32
+#define MIN_SHADER_LEN 32
+
+typedef struct {
+	const char *src;
+	uint32_t origin; // Offset of the game's string this shader comes from
+	int vertex;
+	const char *desc; // Replacement rule applied, if any
+	const glsl_translation *t; // GLSL ES 3.00 translation, if any
+	char key[41];
+} shader_entry;
+
+typedef struct {
+	uint32_t offs;
+	int vertex;
+	int num_varyings;
+	char varyings[MAX_VARYINGS][64];
+} game_shader;
+
+static shader_entry entries[MAX_SHADERS];
+static int num_entries = 0;
+
+static game_shader originals[MAX_SHADERS];
+static int num_originals = 0;
+
+static uint8_t *image = NULL;
+static size_t image_size = 0;
+
+static int load_image(const char *path) {
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return -1;
+	fseek(f, 0, SEEK_END);
+	size_t size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *so_data = (uint8_t *)malloc(size);
+	fread(so_data, 1, size, f);
+	fclose(f);
+
+	if (memcmp(so_data, ELFMAG, SELFMAG) != 0) {
+		free(so_data);
+		return -1;
+	}
+
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)so_data;
+	Elf32_Phdr *phdr = (Elf32_Phdr *)(so_data + ehdr->e_phoff);
+	for (int i = 0; i < ehdr->e_phnum; i++) {
+		if (phdr[i].p_type == PT_LOAD && phdr[i].p_vaddr + phdr[i].p_memsz > image_size)
+			image_size = phdr[i].p_vaddr + phdr[i].p_memsz;
+	}
+
+	// One extra byte so that a string running up to the end is still terminated
+	image = (uint8_t *)calloc(1, image_size + 1);
+	for (int i = 0; i < ehdr->e_phnum; i++) {
+		if (phdr[i].p_type == PT_LOAD)
+			memcpy(image + phdr[i].p_vaddr, so_data + phdr[i].p_offset, phdr[i].p_filesz);
+	}
+
+	free(so_data);
+	return 0;
+}
+
+static int is_glsl(const char *s) {
+	return strstr(s, "main") && (strstr(s, "gl_Position") || strstr(s, "gl_Frag") || strstr(s, "out ") || strstr(s, "#version"));
+}
+
+static void compute_key(const char *src, char *key) {
+	uint32_t sha1[5];
+	SHA1_CTX ctx;
+
+	// Same as glShaderSource_hook, the game submits every source as a single string
+	sha1_init(&ctx);
+	sha1_update(&ctx, (const BYTE *)src, strlen(src));
+	sha1_final(&ctx, (uint8_t *)sha1);
+	snprintf(key, 41, "%08x%08x%08x%08x%08x", sha1[0], sha1[1], sha1[2], sha1[3], sha1[4]);
+}
+
+static void add_entry(const char *src, uint32_t origin, int vertex, const char *desc) {
+	for (int i = 0; i < num_entries; i++) {
+		if (entries[i].src == src)
+			return;
+	}
+	if (num_entries == MAX_SHADERS) {
+		fprintf(stderr, "Too many shaders, raise MAX_SHADERS\n");
+		return;
+	}
+	shader_entry *e = &entries[num_entries++];
+	e->src = src;
+	e->origin = origin;
+	e->vertex = vertex;
+	e->desc = desc;
+	e->t = glsl_translate(1, &src, NULL, vertex);
+	compute_key(e->t ? e->t->src : src, e->key);
+}
+
+static int is_ident(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Names of the varyings a stage writes (vertex) or reads (fragment), 1.00 and 3.00 syntax
+static void collect_varyings(game_shader *g, const char *src) {
+	const char *out_kw = g->vertex ? "out" : "in";
+	const char *p = src;
+	while (*p) {
+		if (!is_ident(*p)) {
+			p++;
+			continue;
+		}
+		const char *w = p;
+		while (is_ident(*p))
+			p++;
+		size_t len = p - w;
+		if (!((len == 7 && !strncmp(w, "varying", 7)) || (len == strlen(out_kw) && !strncmp(w, out_kw, len))))
+			continue;
+
+		// The name is the last identifier of the declaration, array size aside
+		const char *end = strchr(p, ';');
+		if (!end)
+			break;
+		const char *n = end;
+		while (n > p && n[-1] != ']' && !is_ident(n[-1]))
+			n--;
+		if (n > p && n[-1] == ']') {
+			while (n > p && n[-1] != '[')
+				n--;
+			while (n > p && !is_ident(n[-1]))
+				n--;
+		}
+		const char *n_end = n;
+		while (n > p && is_ident(n[-1]))
+			n--;
+		if (n_end > n && n_end - n < 64 && g->num_varyings < MAX_VARYINGS) {
+			memcpy(g->varyings[g->num_varyings], n, n_end - n);
+			g->varyings[g->num_varyings++][n_end - n] = 0;
+		}
+		p = end;
+	}
+}
+
+static int has_varying(const game_shader *g, const char *name) {
+	for (int i = 0; i < g->num_varyings; i++) {
+		if (!strcmp(g->varyings[i], name))
+			return 1;
+	}
+	return 0;
+}
+
+static int can_link(const game_shader *vs, const game_shader *fs) {
+	for (int i = 0; i < fs->num_varyings; i++) {
+		if (!has_varying(vs, fs->varyings[i]))
+			return 0;
+	}
+	return 1;
+}
+
+static void add_shader(uint32_t offs) {
+	if (num_originals == MAX_SHADERS) {
+		fprintf(stderr, "Too many shaders, raise MAX_SHADERS\n");
+		return;
+	}
+	const char *src = (const char *)(image + offs);
+	game_shader *g = &originals[num_originals++];
+	g->offs = offs;
+	g->vertex = strstr(src, "gl_Position") != NULL;
+	g->num_varyings = 0;
+	collect_varyings(g, src);
+}
+
+// Same as ShaderProgram in main.c, either stage may be missing when it has no partner
+static void process_pair(const game_shader *vs, const game_shader *fs) {
+	const char *vp = vs ? (const char *)(image + vs->offs) : NULL;
+	const char *fp = fs ? (const char *)(image + fs->offs) : NULL;
+	const char *vp_desc = NULL, *fp_desc = NULL;
+
+	for (int i = 0; i < sizeof(shader_patches) / sizeof(*shader_patches); i++) {
+		const char *prev_vp = vp, *prev_fp = fp;
+		if (apply_shader_patch((uintptr_t)image, &shader_patches[i], &vp, &fp)) {
+			if (vp != prev_vp)
+				vp_desc = shader_patches[i].desc;
+			if (fp != prev_fp)
+				fp_desc = shader_patches[i].desc;
+		}
+	}
+
+	if (vp)
+		add_entry(vp, vs->offs, 1, vp_desc);
+	if (fp)
+		add_entry(fp, fs->offs, 0, fp_desc);
+}
+
+static void process_shaders(void) {
+	for (int i = 0; i < num_originals; i++) {
+		game_shader *a = &originals[i];
+		int paired = 0;
+		for (int j = 0; j < num_originals; j++) {
+			game_shader *b = &originals[j];
+			if (a->vertex == b->vertex)
+				continue;
+			game_shader *vs = a->vertex ? a : b;
+			game_shader *fs = a->vertex ? b : a;
+			if (can_link(vs, fs)) {
+				process_pair(vs, fs);
+				paired = 1;
+			}
+		}
+		if (!paired)
+			process_pair(a->vertex ? a : NULL, a->vertex ? NULL : a);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const char *cache_dir = NULL, *dump_dir = NULL;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s libmain.so [-c shaders_dir] [-d dump_dir]\n", argv[0]);
+		return 1;
+	}
+	for (int i = 2; i < argc - 1; i++) {
+		if (!strcmp(argv[i], "-c"))
+			cache_dir = argv[++i];
+		else if (!strcmp(argv[i], "-d"))
+			dump_dir = argv[++i];
+	}
+
+	if (load_image(argv[1]) < 0) {
+		fprintf(stderr, "Error could not load %s.\n", argv[1]);
+		return 1;
+	}
+
+	uint32_t start = 0;
+	for (uint32_t i = 0; i < image_size + 1; i++) {
+		if (image[i])
+			continue;
+		if (i - start >= MIN_SHADER_LEN && is_glsl((const char *)(image + start)))
+			add_shader(start);
+		start = i + 1;
+	}
+	process_shaders();
+
+	int missing = 0;
+	int untranslatable = 0;
+	printf("# key stage origin status translation rule\n");
+	for (int i = 0; i < num_entries; i++) {
+		shader_entry *e = &entries[i];
+		const char *status = "-";
+		char path[512];
+
+		if (cache_dir) {
+			snprintf(path, sizeof(path), "%s/%s_glsl.gxp", cache_dir, e->key);
+			if (access(path, F_OK) == 0) {
+				status = "cached";
+			} else {
+				status = "missing";
+				missing++;
+			}
+		}
+		if (dump_dir) {
+			snprintf(path, sizeof(path), "%s/%s.glsl", dump_dir, e->key);
+			FILE *f = fopen(path, "wb");
+			if (f) {
+				const char *src = e->t ? e->t->src : e->src;
+				fwrite(src, 1, strlen(src), f);
+				fclose(f);
+			}
+		}
+
+		const char *translation = "-";
+		if (e->t) {
+			translation = e->t->unsupported ? "partial" : "300->100";
+			if (e->t->unsupported)
+				untranslatable++;
+		}
+
+		printf("%s %s 0x%08X %s %s %s\n", e->key, e->vertex ? "vp" : "fp", e->origin, status, translation, e->desc ? e->desc : "-");
+	}
+
+	fprintf(stderr, "%d shaders found, %d with untranslated GLSL ES 3.00 constructs", num_entries, untranslatable);
+	if (cache_dir)
+		fprintf(stderr, ", %d missing from %s", missing, cache_dir);
+	fprintf(stderr, "\n");
+
+	return missing ? 2 : 0;
+}
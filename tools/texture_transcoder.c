@@ -0,0 +1,293 @@
+/* texture_transcoder.c -- offline DXT1/DXT5 transcoder for the game's images
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Host tool, build with:
+ *   gcc -O2 -Iloader tools/texture_transcoder.c loader/sha1.c -lSDL2 -lSDL2_image -o texture_transcoder
+ *
+ * Usage:
+ *   texture_transcoder data_dir out_dir
+ *
+ * Decodes every PNG/JPEG/WEBP under data_dir with SDL2_image (so pixels match
+ * what IMG_Load returns on the Vita), picks DXT1 for fully opaque images and
+ * DXT5 otherwise, and writes out_dir/<sha1 of the source>.dxt plus the
+ * out_dir/index.txt read by dxt_cache.c. Identical sources share one file and
+ * already transcoded ones are skipped. Images with a side not multiple of 4
+ * are left out, the loader keeps decoding them as usual.
+ * out_dir goes to ux0:data/rrm/texcache on the Vita.
+ */
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dxt.h"
+#include "sha1.h"
+
+static const char *out_dir;
+static FILE *index_file;
+static int num_transcoded = 0, num_reused = 0, num_skipped = 0;
+static uint64_t bytes_raw = 0, bytes_dxt = 0;
+
+static uint16_t pack_565(const uint8_t *c) {
+	return ((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3);
+}
+
+static void unpack_565(uint16_t c, int *out) {
+	out[0] = ((c >> 11) & 0x1F) * 255 / 31;
+	out[1] = ((c >> 5) & 0x3F) * 255 / 63;
+	out[2] = (c & 0x1F) * 255 / 31;
+}
+
+// Bounding box endpoints inset by 1/16 of the range, then nearest palette entry per texel
+static void encode_color_block(const uint8_t block[16][4], uint8_t *out) {
+	int mn[3] = {255, 255, 255}, mx[3] = {0, 0, 0};
+	for (int i = 0; i < 16; i++) {
+		for (int k = 0; k < 3; k++) {
+			if (block[i][k] < mn[k])
+				mn[k] = block[i][k];
+			if (block[i][k] > mx[k])
+				mx[k] = block[i][k];
+		}
+	}
+	uint8_t c0[3], c1[3];
+	for (int k = 0; k < 3; k++) {
+		int inset = (mx[k] - mn[k]) >> 4;
+		c0[k] = mx[k] - inset;
+		c1[k] = mn[k] + inset;
+	}
+
+	uint16_t e0 = pack_565(c0), e1 = pack_565(c1);
+	if (e0 < e1) {
+		uint16_t t = e0;
+		e0 = e1;
+		e1 = t;
+	}
+
+	int pal[4][3];
+	unpack_565(e0, pal[0]);
+	unpack_565(e1, pal[1]);
+	for (int k = 0; k < 3; k++) {
+		pal[2][k] = (2 * pal[0][k] + pal[1][k]) / 3;
+		pal[3][k] = (pal[0][k] + 2 * pal[1][k]) / 3;
+	}
+
+	uint32_t bits = 0;
+	if (e0 != e1) {
+		for (int i = 15; i >= 0; i--) {
+			int best = 0, best_d = 0x7FFFFFFF;
+			for (int j = 0; j < 4; j++) {
+				int d = 0;
+				for (int k = 0; k < 3; k++)
+					d += (block[i][k] - pal[j][k]) * (block[i][k] - pal[j][k]);
+				if (d < best_d) {
+					best_d = d;
+					best = j;
+				}
+			}
+			bits = (bits << 2) | best;
+		}
+	}
+
+	out[0] = e0 & 0xFF;
+	out[1] = e0 >> 8;
+	out[2] = e1 & 0xFF;
+	out[3] = e1 >> 8;
+	out[4] = bits & 0xFF;
+	out[5] = (bits >> 8) & 0xFF;
+	out[6] = (bits >> 16) & 0xFF;
+	out[7] = bits >> 24;
+}
+
+static void encode_alpha_block(const uint8_t block[16][4], uint8_t *out) {
+	int mn = 255, mx = 0;
+	for (int i = 0; i < 16; i++) {
+		if (block[i][3] < mn)
+			mn = block[i][3];
+		if (block[i][3] > mx)
+			mx = block[i][3];
+	}
+
+	// Eight alphas mode, a0 > a1
+	int pal[8];
+	pal[0] = mx;
+	pal[1] = mn;
+	for (int i = 1; i < 7; i++)
+		pal[i + 1] = ((7 - i) * mx + i * mn) / 7;
+
+	uint64_t bits = 0;
+	if (mx != mn) {
+		for (int i = 15; i >= 0; i--) {
+			int best = 0, best_d = 256;
+			for (int j = 0; j < 8; j++) {
+				int d = abs(block[i][3] - pal[j]);
+				if (d < best_d) {
+					best_d = d;
+					best = j;
+				}
+			}
+			bits = (bits << 3) | best;
+		}
+	}
+
+	out[0] = mx;
+	out[1] = mn;
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (bits >> (8 * i)) & 0xFF;
+}
+
+static int is_image(const char *name) {
+	const char *ext = strrchr(name, '.');
+	return ext && (!strcasecmp(ext, ".png") || !strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg") || !strcasecmp(ext, ".webp"));
+}
+
+static void transcode(const char *path, const char *rel) {
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return;
+	fseek(f, 0, SEEK_END);
+	size_t size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *src = (uint8_t *)malloc(size);
+	fread(src, 1, size, f);
+	fclose(f);
+
+	uint32_t sha1[5];
+	char key[41];
+	SHA1_CTX ctx;
+	sha1_init(&ctx);
+	sha1_update(&ctx, src, size);
+	sha1_final(&ctx, (uint8_t *)sha1);
+	snprintf(key, sizeof(key), "%08x%08x%08x%08x%08x", sha1[0], sha1[1], sha1[2], sha1[3], sha1[4]);
+
+	char out_path[1024];
+	snprintf(out_path, sizeof(out_path), "%s/%s.dxt", out_dir, key);
+	if (access(out_path, F_OK) == 0) {
+		fprintf(index_file, "%s %zu %s\n", key, size, rel);
+		num_reused++;
+		free(src);
+		return;
+	}
+
+	SDL_Surface *img = IMG_Load_RW(SDL_RWFromConstMem(src, size), 1);
+	SDL_Surface *s = img ? SDL_ConvertSurfaceFormat(img, SDL_PIXELFORMAT_ABGR8888, 0) : NULL;
+	free(src);
+	if (img)
+		SDL_FreeSurface(img);
+	if (!s || (s->w & 3) || (s->h & 3)) {
+		fprintf(stderr, "Skipping %s\n", rel);
+		num_skipped++;
+		if (s)
+			SDL_FreeSurface(s);
+		return;
+	}
+
+	int opaque = 1;
+	for (int y = 0; y < s->h && opaque; y++) {
+		const uint8_t *row = (const uint8_t *)s->pixels + y * s->pitch;
+		for (int x = 0; x < s->w; x++) {
+			if (row[x * 4 + 3] != 255) {
+				opaque = 0;
+				break;
+			}
+		}
+	}
+
+	dxt_header hdr;
+	hdr.magic = DXT_MAGIC;
+	hdr.width = s->w;
+	hdr.height = s->h;
+	hdr.format = opaque ? DXT_FORMAT_DXT1 : DXT_FORMAT_DXT5;
+	hdr.size = dxt_size(hdr.format, s->w, s->h);
+
+	uint8_t *blocks = (uint8_t *)malloc(hdr.size);
+	uint8_t *out = blocks;
+	for (int by = 0; by < s->h; by += 4) {
+		for (int bx = 0; bx < s->w; bx += 4) {
+			uint8_t block[16][4];
+			for (int i = 0; i < 16; i++)
+				memcpy(block[i], (const uint8_t *)s->pixels + (by + i / 4) * s->pitch + (bx + i % 4) * 4, 4);
+			if (!opaque) {
+				encode_alpha_block(block, out);
+				out += 8;
+			}
+			encode_color_block(block, out);
+			out += 8;
+		}
+	}
+
+	f = fopen(out_path, "wb");
+	if (f) {
+		fwrite(&hdr, 1, sizeof(hdr), f);
+		fwrite(blocks, 1, hdr.size, f);
+		fclose(f);
+		fprintf(index_file, "%s %zu %s\n", key, size, rel);
+		num_transcoded++;
+		bytes_raw += s->w * s->h * 4;
+		bytes_dxt += hdr.size;
+	}
+
+	free(blocks);
+	SDL_FreeSurface(s);
+}
+
+static void walk(const char *dir, const char *rel) {
+	DIR *d = opendir(dir);
+	if (!d)
+		return;
+	struct dirent *e;
+	while ((e = readdir(d)) != NULL) {
+		if (e->d_name[0] == '.')
+			continue;
+		char path[1024], sub[1024];
+		struct stat st;
+		snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+		if (rel[0])
+			snprintf(sub, sizeof(sub), "%s/%s", rel, e->d_name);
+		else
+			snprintf(sub, sizeof(sub), "%s", e->d_name);
+		if (stat(path, &st) < 0)
+			continue;
+		if (S_ISDIR(st.st_mode))
+			walk(path, sub);
+		else if (is_image(e->d_name))
+			transcode(path, sub);
+	}
+	closedir(d);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s data_dir out_dir\n", argv[0]);
+		return 1;
+	}
+	out_dir = argv[2];
+	mkdir(out_dir, 0777);
+
+	char index_path[1024];
+	snprintf(index_path, sizeof(index_path), "%s/index.txt", out_dir);
+	index_file = fopen(index_path, "w");
+	if (!index_file) {
+		fprintf(stderr, "Error could not create %s.\n", index_path);
+		return 1;
+	}
+
+	IMG_Init(IMG_INIT_PNG | IMG_INIT_JPG | IMG_INIT_WEBP);
+	walk(argv[1], "");
+	IMG_Quit();
+	fclose(index_file);
+
+	fprintf(stderr, "%d images transcoded, %d already cached, %d skipped (%llu KB -> %llu KB)\n",
+		num_transcoded, num_reused, num_skipped, (unsigned long long)bytes_raw / 1024, (unsigned long long)bytes_dxt / 1024);
+	return 0;
+}
@@ -0,0 +1,93 @@
+/* vertex_format_check.c -- checks vertex_formats.c against reference conversions
+ *
+ * Copyright (C) 2023 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ *
+ * Host tool, build with (needs _Float16 and F16C, GCC 12 or later on x86-64):
+ *   gcc -O2 -mf16c -Iloader tools/vertex_format_check.c loader/vertex_formats.c -lm -o vertex_format_check
+ *
+ * Converts every float to a half and compares the bits with the compiler's
+ * own conversion, converts every half back the same way, and checks that
+ * normals packed as normalized shorts decode, as the GPU does it
+ * (max(s / 32767, -1)), within half a step of the original. The exit code
+ * is 1 on any mismatch.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "vertex_formats.h"
+
+#define MAX_REPORTS 8
+
+static int failed = 0;
+
+static void report(const char *what, uint32_t in, uint32_t got, uint32_t expected) {
+	if (failed++ < MAX_REPORTS)
+		printf("MISMATCH %s 0x%08X: got 0x%08X, expected 0x%08X\n", what, in, got, expected);
+}
+
+static uint16_t ref_float_to_half(float f) {
+	_Float16 h = (_Float16)f;
+	uint16_t bits;
+	memcpy(&bits, &h, 2);
+	return bits;
+}
+
+static float ref_half_to_float(uint16_t bits) {
+	_Float16 h;
+	memcpy(&h, &bits, 2);
+	return (float)h;
+}
+
+static void check_float_to_half(void) {
+	uint32_t x = 0;
+	do {
+		float f;
+		memcpy(&f, &x, 4);
+		uint16_t got = float_to_half(f), expected = ref_float_to_half(f);
+		// Any quiet NaN will do, payloads aren't read by the shaders
+		int nan_ok = isnan(f) && (got & 0x7E00) == 0x7E00 && (got & 0x8000) == (expected & 0x8000);
+		if (got != expected && !nan_ok)
+			report("float_to_half", x, got, expected);
+	} while (++x);
+}
+
+static void check_half_to_float(void) {
+	for (uint32_t h = 0; h < 0x10000; h++) {
+		float got = half_to_float(h), expected = ref_half_to_float(h);
+		uint32_t gb, eb;
+		memcpy(&gb, &got, 4);
+		memcpy(&eb, &expected, 4);
+		if (gb != eb && !(isnan(got) && isnan(expected)))
+			report("half_to_float", h, gb, eb);
+	}
+}
+
+static void check_snorm16(void) {
+	const float step = 1.0f / 32767.0f;
+	for (int i = -1001000; i <= 1001000; i++) {
+		float f = i / 1000000.0f;
+		int16_t s = float_to_snorm16(f);
+		float decoded = fmaxf(s / 32767.0f, -1.0f);
+		float clamped = fminf(fmaxf(f, -1.0f), 1.0f);
+		if (fabsf(decoded - clamped) > step * 0.5f + 1e-7f) {
+			uint32_t in, got, expected;
+			memcpy(&in, &f, 4);
+			memcpy(&got, &decoded, 4);
+			memcpy(&expected, &clamped, 4);
+			report("float_to_snorm16", in, got, expected);
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	check_float_to_half();
+	check_half_to_float();
+	check_snorm16();
+	printf("%d mismatching conversions\n", failed);
+	return failed ? 1 : 0;
+}